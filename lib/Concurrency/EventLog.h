@@ -0,0 +1,175 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef EVENT_TEXT_LENGTH
+#define EVENT_TEXT_LENGTH 112
+#endif
+
+enum EventLevel : uint8_t
+{
+    EVENT_DEBUG,
+    EVENT_INFO,
+    EVENT_WARN,
+    EVENT_ERROR
+};
+
+// One structured log entry
+struct Event
+{
+    uint32_t seq;      // 1 for the first event, then one higher for each
+    uint32_t uptimeMs; // millis() when it was logged
+    uint32_t epoch;    // Wall-clock seconds, 0 if the clock was not set
+    uint8_t level;     // EventLevel
+    uint16_t code;     // What happened, for filtering without parsing text
+    char text[EVENT_TEXT_LENGTH];
+};
+
+// Fixed-size ring of the most recent events. Any number of tasks, on either
+// core, may log at the same time; nothing blocks and nothing allocates.
+// Readers keep their own cursor (the seq of the last event they consumed),
+// so the serial drain, the event stream and /serial each read at their own
+// pace.
+//
+// A writer claims the next seq with one atomic increment and owns that
+// slot while it copies the event in; readers detect a slot rewritten under
+// them (seqlock style) and skip it. An entry can only be lost if writers
+// lap the whole ring while another is still mid-copy; readers that fall
+// Capacity events behind jump ahead, and both cases are counted.
+template <size_t Capacity>
+class EventLog
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "EventLog capacity must be a power of two");
+
+public:
+    EventLog() : _last(0), _dropped(0)
+    {
+        for (size_t i = 0; i < Capacity; i++)
+        {
+            _slots[i].state.store(EMPTY, std::memory_order_relaxed);
+        }
+    }
+
+    // Returns the event's seq, or 0 if it had to be dropped
+    uint32_t push(EventLevel level, uint16_t code, uint32_t epoch, uint32_t uptimeMs, const char *text)
+    {
+        uint32_t seq = _last.fetch_add(1, std::memory_order_relaxed) + 1;
+        Slot &slot = _slots[seq & (Capacity - 1)];
+
+        uint32_t state = slot.state.load(std::memory_order_relaxed);
+        do
+        {
+            // Another writer is still in this slot, or a newer event already
+            // took it; never wait for a task that may be preempted
+            if (state == BUSY || (state != EMPTY && (int32_t)(state - seq) > 0))
+            {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return 0;
+            }
+        } while (!slot.state.compare_exchange_weak(state, BUSY, std::memory_order_acquire,
+                                                   std::memory_order_relaxed));
+        std::atomic_thread_fence(std::memory_order_release);
+
+        Event &event = slot.event;
+        event.seq = seq;
+        event.uptimeMs = uptimeMs;
+        event.epoch = epoch;
+        event.level = level;
+        event.code = code;
+        size_t length = 0;
+        while (length < sizeof(event.text) - 1 && text[length] != '\0')
+        {
+            event.text[length] = text[length];
+            length++;
+        }
+        event.text[length] = '\0';
+
+        slot.state.store(seq, std::memory_order_release);
+        return seq;
+    }
+
+    // Copy the event after cursor into event and advance cursor. Returns
+    // false if there is nothing new yet. Events the reader can no longer get
+    // (overwritten, or dropped by their writer) are skipped and added to
+    // *lost.
+    bool read(uint32_t &cursor, Event &event, uint32_t *lost = nullptr)
+    {
+        for (;;)
+        {
+            uint32_t last = _last.load(std::memory_order_acquire);
+            uint32_t want = cursor + 1;
+            if ((int32_t)(last - want) < 0)
+            {
+                return false;
+            }
+            if (last - want >= Capacity)
+            {
+                // Fell behind by a whole ring
+                skip(cursor, last - Capacity, lost);
+                continue;
+            }
+
+            Slot &slot = _slots[want & (Capacity - 1)];
+            uint32_t state = slot.state.load(std::memory_order_acquire);
+            if (state == want)
+            {
+                event = slot.event;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.state.load(std::memory_order_relaxed) == want)
+                {
+                    cursor = want;
+                    return true;
+                }
+                continue; // Rewritten while copying
+            }
+
+            bool newer = state != EMPTY && state != BUSY && (int32_t)(state - want) > 0;
+            if (!newer && last - want < Capacity / 2)
+            {
+                return false; // Still being written
+            }
+            // Overwritten, or its writer gave up; half a ring of later events
+            // means a slow writer is not worth waiting for
+            skip(cursor, want, lost);
+        }
+    }
+
+    // Seq of the newest event claimed so far (0 before the first)
+    uint32_t lastSeq() const { return _last.load(std::memory_order_acquire); }
+
+    // Cursor from which read() returns everything still in the ring
+    uint32_t oldestCursor() const
+    {
+        uint32_t last = lastSeq();
+        return last > Capacity ? last - Capacity : 0;
+    }
+
+    uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+    static const uint32_t EMPTY = 0;
+    static const uint32_t BUSY = 0xFFFFFFFF;
+
+    struct Slot
+    {
+        std::atomic<uint32_t> state; // EMPTY, BUSY or the seq of the event held
+        Event event;
+    };
+
+    static void skip(uint32_t &cursor, uint32_t to, uint32_t *lost)
+    {
+        if (lost)
+        {
+            *lost += to - cursor;
+        }
+        cursor = to;
+    }
+
+    Slot _slots[Capacity];
+    std::atomic<uint32_t> _last;
+    std::atomic<uint32_t> _dropped;
+};
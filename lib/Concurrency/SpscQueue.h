@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded lock-free queue for exactly one producer and one consumer, which
+// may run on different cores. Capacity must be a power of two; one slot is
+// never used so that full and empty can be told apart without a counter.
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscQueue capacity must be a power of two");
+
+public:
+    SpscQueue() : _head(0), _tail(0) {}
+
+    // Producer side. Returns false if the queue is full.
+    bool push(const T &item)
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        uint32_t next = (head + 1) & (Capacity - 1);
+        if (next == _tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        _items[head] = item;
+        _head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false if the queue is empty.
+    bool pop(T &item)
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = _items[tail];
+        _tail.store((tail + 1) & (Capacity - 1), std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire);
+    }
+
+private:
+    T _items[Capacity];
+    std::atomic<uint32_t> _head; // Written only by the producer
+    std::atomic<uint32_t> _tail; // Written only by the consumer
+};
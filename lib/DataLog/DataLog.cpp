@@ -0,0 +1,474 @@
+#include "DataLog.h"
+
+#include <string.h>
+
+#include "Crc32.h"
+
+int16_t toFixedLevel(float cm)
+{
+    float scaled = cm * 10.0f;
+    if (scaled > 32767.0f)
+    {
+        return 32767;
+    }
+    if (scaled < -32768.0f)
+    {
+        return -32768;
+    }
+    return (int16_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+}
+
+float fromFixedLevel(int16_t fixed)
+{
+    return fixed / 10.0f;
+}
+
+uint16_t toQualityFlags(float quality)
+{
+    if (quality < 0.0f)
+    {
+        quality = 0.0f;
+    }
+    if (quality > 1.0f)
+    {
+        quality = 1.0f;
+    }
+    return LOG_FLAG_QUALITY_VALID | (uint16_t)(quality * 100.0f + 0.5f);
+}
+
+int qualityPercent(uint16_t flags)
+{
+    return (flags & LOG_FLAG_QUALITY_VALID) ? (flags & LOG_FLAG_QUALITY_MASK) : -1;
+}
+
+uint16_t toChannelFlags(uint8_t channel)
+{
+    return ((uint16_t)channel << LOG_FLAG_CHANNEL_SHIFT) & LOG_FLAG_CHANNEL_MASK;
+}
+
+uint8_t logChannel(uint16_t flags)
+{
+    return (flags & LOG_FLAG_CHANNEL_MASK) >> LOG_FLAG_CHANNEL_SHIFT;
+}
+
+DataLog::DataLog(LogBackend &backend)
+    : _backend(backend), _open(false), _oldestEpoch(0), _newestEpoch(0), _oldestStale(false),
+      _syncs(0), _bytesWritten(0)
+{
+    memset(&_header, 0, sizeof(_header));
+}
+
+bool DataLog::begin(uint32_t capacity)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if (loadHeader())
+    {
+        _open = true;
+        loadBounds();
+        return true;
+    }
+    return format(capacity);
+}
+
+bool DataLog::format(uint32_t capacity)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if (capacity == 0)
+    {
+        return false;
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.recordSize = sizeof(LogRecord);
+    header.capacity = capacity;
+
+    // The backend only grows by appending, so lay down the header area first.
+    // Both slots are then written so a stale header can never win.
+    uint8_t blank[DATA_OFFSET];
+    memset(blank, 0xFF, sizeof(blank));
+    if (!_backend.write(0, blank, sizeof(blank)) || !writeHeader(header) || !writeHeader(_header))
+    {
+        _open = false;
+        return false;
+    }
+    _open = true;
+    loadBounds();
+    return true;
+}
+
+bool DataLog::append(const LogRecord &record)
+{
+    return append(&record, 1);
+}
+
+bool DataLog::append(const LogRecord *records, uint32_t n)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if (!_open)
+    {
+        return false;
+    }
+    if (n == 0)
+    {
+        return true;
+    }
+
+    // At most two contiguous runs: up to the end of the ring, then from
+    // slot 0. Until the header is written the records are not part of the
+    // log, so a failed or torn batch leaves the previous header in charge;
+    // only records it would have overwritten in a full log are lost.
+    // Records that would go back in time are written from raised copies,
+    // in smaller runs.
+    uint32_t head = _header.head;
+    uint32_t newest = _header.count > 0 ? _newestEpoch : 0;
+    LogRecord raised[RAISE_BATCH];
+    uint32_t done = 0;
+    while (done < n)
+    {
+        uint32_t run = _header.capacity - head;
+        if (run > n - done)
+        {
+            run = n - done;
+        }
+        const LogRecord *source = records + done;
+        if (!inTimeOrder(source, run, newest))
+        {
+            if (run > RAISE_BATCH)
+            {
+                run = RAISE_BATCH;
+            }
+            for (uint32_t i = 0; i < run; i++)
+            {
+                raised[i] = source[i];
+                if (raised[i].epoch < newest)
+                {
+                    raised[i].epoch = newest;
+                    raised[i].flags |= LOG_FLAG_TIME_RAISED;
+                }
+                newest = raised[i].epoch;
+            }
+            source = raised;
+        }
+        uint32_t offset = DATA_OFFSET + head * sizeof(LogRecord);
+        if (!_backend.write(offset, source, run * sizeof(LogRecord)))
+        {
+            return false;
+        }
+        _bytesWritten += run * sizeof(LogRecord);
+        newest = source[run - 1].epoch;
+        head = (head + run) % _header.capacity;
+        done += run;
+    }
+
+    // Nothing in memory changes until the header is on flash, so a failed
+    // append can be retried without the batch going in twice
+    bool overwrote = _header.count + n > _header.capacity;
+    bool wasEmpty = _header.count == 0;
+    Header header = _header;
+    header.head = head;
+    header.count = overwrote ? _header.capacity : _header.count + n;
+    header.appended += n;
+    if (!writeHeader(header))
+    {
+        return false;
+    }
+
+    if (overwrote)
+    {
+        _oldestStale = true; // Overwrote the oldest records
+    }
+    else if (wasEmpty)
+    {
+        _oldestEpoch = records[0].epoch;
+        _oldestStale = false;
+    }
+    _newestEpoch = newest;
+    return true;
+}
+
+bool DataLog::inTimeOrder(const LogRecord *records, uint32_t n, uint32_t newest)
+{
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (records[i].epoch < newest)
+        {
+            return false;
+        }
+        newest = records[i].epoch;
+    }
+    return true;
+}
+
+bool DataLog::clear()
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if (!_open)
+    {
+        return false;
+    }
+    Header header = _header;
+    header.count = 0;
+    if (!writeHeader(header))
+    {
+        return false;
+    }
+    loadBounds();
+    return true;
+}
+
+bool DataLog::discardOldest(uint32_t n)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if (!_open)
+    {
+        return false;
+    }
+    Header header = _header;
+    header.count -= (n < header.count) ? n : header.count;
+    if (!writeHeader(header))
+    {
+        return false;
+    }
+    if (_header.count == 0)
+    {
+        loadBounds();
+    }
+    else
+    {
+        _oldestStale = true;
+    }
+    return true;
+}
+
+bool DataLog::read(uint32_t index, LogRecord &record)
+{
+    return read(index, &record, 1) == 1;
+}
+
+uint32_t DataLog::read(uint32_t index, LogRecord *records, uint32_t n)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if (!_open || index >= _header.count)
+    {
+        return 0;
+    }
+    if (n > _header.count - index)
+    {
+        n = _header.count - index;
+    }
+
+    // At most two contiguous runs: up to the end of the ring, then from slot 0
+    uint32_t done = 0;
+    while (done < n)
+    {
+        uint32_t slot = slotOf(index + done);
+        uint32_t run = _header.capacity - slot;
+        if (run > n - done)
+        {
+            run = n - done;
+        }
+        uint32_t offset = DATA_OFFSET + slot * sizeof(LogRecord);
+        if (!_backend.read(offset, records + done, run * sizeof(LogRecord)))
+        {
+            break;
+        }
+        done += run;
+    }
+    return done;
+}
+
+uint32_t DataLog::lowerBound(uint32_t epoch)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    uint32_t low = 0;
+    uint32_t high = _header.count;
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+        uint32_t stamp;
+        uint32_t offset = DATA_OFFSET + slotOf(mid) * sizeof(LogRecord) + offsetof(LogRecord, epoch);
+        if (!_backend.read(offset, &stamp, sizeof(stamp)))
+        {
+            break;
+        }
+        if (stamp < epoch)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+uint32_t DataLog::seqLowerBound(uint32_t epoch)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return firstSeq() + lowerBound(epoch);
+}
+
+uint32_t DataLog::readSeq(uint32_t seq, LogRecord *records, uint32_t n, uint32_t *firstRead)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    uint32_t first = firstSeq();
+    if (seq < first)
+    {
+        seq = first;
+    }
+    *firstRead = seq;
+    return read(seq - first, records, n);
+}
+
+uint32_t DataLog::firstSeq() const
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return _header.appended - _header.count + 1;
+}
+
+uint32_t DataLog::lastSeq() const
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return _header.appended;
+}
+
+uint32_t DataLog::count() const
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return _header.count;
+}
+
+uint32_t DataLog::capacity() const
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return _header.capacity;
+}
+
+uint32_t DataLog::appended() const
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return _header.appended;
+}
+
+uint32_t DataLog::oldestEpoch()
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if (_oldestStale)
+    {
+        _oldestEpoch = epochAt(0);
+        _oldestStale = false;
+    }
+    return _oldestEpoch;
+}
+
+uint32_t DataLog::newestEpoch()
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return _newestEpoch;
+}
+
+LogStats DataLog::stats()
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    LogStats stats;
+    stats.count = _header.count;
+    stats.capacity = _header.capacity;
+    stats.firstSeq = firstSeq();
+    stats.lastSeq = lastSeq();
+    stats.oldestEpoch = oldestEpoch();
+    stats.newestEpoch = _newestEpoch;
+    stats.bytesUsed = bytesUsed();
+    stats.syncs = _syncs;
+    stats.bytesWritten = _bytesWritten;
+    return stats;
+}
+
+// Epoch of the record at index, 0 if it cannot be read
+uint32_t DataLog::epochAt(uint32_t index)
+{
+    if (!_open || index >= _header.count)
+    {
+        return 0;
+    }
+    uint32_t stamp;
+    uint32_t offset = DATA_OFFSET + slotOf(index) * sizeof(LogRecord) + offsetof(LogRecord, epoch);
+    return _backend.read(offset, &stamp, sizeof(stamp)) ? stamp : 0;
+}
+
+void DataLog::loadBounds()
+{
+    _oldestEpoch = epochAt(0);
+    _newestEpoch = _header.count > 0 ? epochAt(_header.count - 1) : 0;
+    _oldestStale = false;
+}
+
+bool DataLog::loadHeader()
+{
+    Header slots[HEADER_SLOTS];
+    const Header *best = nullptr;
+
+    for (uint32_t i = 0; i < HEADER_SLOTS; i++)
+    {
+        if (!_backend.read(i * sizeof(Header), &slots[i], sizeof(Header)))
+        {
+            continue;
+        }
+        const Header &h = slots[i];
+        if (h.magic != MAGIC || h.version != VERSION ||
+            h.recordSize != sizeof(LogRecord) || h.capacity == 0 ||
+            h.head >= h.capacity || h.count > h.capacity ||
+            h.crc != headerCrc(h))
+        {
+            continue;
+        }
+        if (!best || (int32_t)(h.generation - best->generation) > 0)
+        {
+            best = &h;
+        }
+    }
+
+    if (!best)
+    {
+        return false;
+    }
+    _header = *best;
+    return true;
+}
+
+// Becomes the current header only once it is written and synced; after a
+// failure the next attempt reuses the generation, so it goes to the same
+// slot and the last good header stays intact
+bool DataLog::writeHeader(Header header)
+{
+    header.generation = _header.generation + 1;
+    header.crc = headerCrc(header);
+
+    uint32_t offset = (header.generation % HEADER_SLOTS) * sizeof(Header);
+    if (!_backend.write(offset, &header, sizeof(header)))
+    {
+        return false;
+    }
+    _syncs++;
+    _bytesWritten += sizeof(header);
+    if (!_backend.sync())
+    {
+        return false;
+    }
+    _header = header;
+    return true;
+}
+
+uint32_t DataLog::slotOf(uint32_t index) const
+{
+    uint32_t tail = (_header.head + _header.capacity - _header.count) % _header.capacity;
+    return (tail + index) % _header.capacity;
+}
+
+uint32_t DataLog::headerCrc(const Header &header)
+{
+    return crc32(&header, offsetof(Header, crc));
+}
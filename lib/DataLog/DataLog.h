@@ -0,0 +1,170 @@
+#pragma once
+
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LogBackend.h"
+
+// One stored measurement. Levels are kept as fixed-point tenths of a
+// centimetre so a record is a fixed 12 bytes on flash.
+struct __attribute__((packed)) LogRecord
+{
+    uint32_t epoch;      // Seconds since 1970-01-01 (RTC time), 0 if unknown
+    int16_t levelBlok;   // 0.1 cm
+    int16_t levelParit;  // 0.1 cm
+    int16_t rawDistance; // 0.1 cm
+    uint16_t flags;      // LOG_FLAG_* bits, 0 in records from older firmware
+};
+
+// flags: bit 7 set when bits 0-6 hold the reading's quality in percent;
+// bits 8-9 the channel (sensor) the reading came from, 0 for the primary;
+// bit 10 set when the epoch was raised to keep the log in time order
+#define LOG_FLAG_QUALITY_VALID 0x0080
+#define LOG_FLAG_QUALITY_MASK 0x007F
+#define LOG_FLAG_CHANNEL_MASK 0x0300
+#define LOG_FLAG_CHANNEL_SHIFT 8
+#define LOG_FLAG_TIME_RAISED 0x0400
+#define LOG_CHANNELS 4
+
+// Consistent snapshot of the log's bookkeeping, taken under one lock
+struct LogStats
+{
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t firstSeq;
+    uint32_t lastSeq;
+    uint32_t oldestEpoch; // 0 if the log is empty
+    uint32_t newestEpoch;
+    size_t bytesUsed;
+    uint32_t syncs;        // Header writes since boot, each followed by a sync
+    uint32_t bytesWritten; // Bytes handed to the backend since boot
+};
+
+// Convert between centimetres and the fixed-point record representation
+int16_t toFixedLevel(float cm);
+float fromFixedLevel(int16_t fixed);
+
+// Pack a 0..1 reading quality into LogRecord::flags and back; -1 if the
+// record has none
+uint16_t toQualityFlags(float quality);
+int qualityPercent(uint16_t flags);
+
+// Pack a channel number into LogRecord::flags and back
+uint16_t toChannelFlags(uint8_t channel);
+uint8_t logChannel(uint16_t flags);
+
+// Preallocated circular log of fixed-size records.
+//
+// Layout on the backend:
+//   [header slot 0][header slot 1][record 0][record 1]...[record capacity-1]
+//
+// The header is double-buffered: every update goes to the slot that does not
+// hold the current generation, so a torn header write falls back to the
+// previous one. Appends write one record in place and then the header, so
+// they are O(1) and the oldest record is simply overwritten once the log is
+// full.
+//
+// All methods are safe to call from several tasks (loop() and the async web
+// server). Readers that stream over many calls should walk sequence numbers
+// rather than indices, since indices shift when the oldest record is
+// overwritten.
+class DataLog
+{
+public:
+    static const uint32_t MAGIC = 0x474C4C57; // "WLLG"
+    static const uint16_t VERSION = 1;
+
+    explicit DataLog(LogBackend &backend);
+
+    // Open an existing log, or format a new one with the given capacity
+    bool begin(uint32_t capacity);
+    bool format(uint32_t capacity);
+
+    // A record older than the newest one, because the clock was unknown
+    // (epoch 0) or set back, is stored with the newest one's epoch and
+    // LOG_FLAG_TIME_RAISED, so the log stays in time order for lowerBound()
+    bool append(const LogRecord &record);
+    // Append records in order with one header write; either all of them
+    // are in the log afterwards or none are
+    bool append(const LogRecord *records, uint32_t n);
+    bool clear();
+    // Drop the n oldest records (used once they have been synced elsewhere)
+    bool discardOldest(uint32_t n);
+
+    // Index 0 is the oldest stored record
+    bool read(uint32_t index, LogRecord &record);
+    uint32_t read(uint32_t index, LogRecord *records, uint32_t n);
+
+    // Index of the first record with epoch >= the given time (count() if
+    // none). append() keeps the records in time order, so the log itself
+    // serves as the timestamp index and a lookup costs O(log n) record reads.
+    uint32_t lowerBound(uint32_t epoch);
+
+    // Every appended record gets the next sequence number, starting at 1.
+    // Sequence numbers follow from the ring position, so they cost no space
+    // and keep increasing across wraps, clears and discards.
+    uint32_t firstSeq() const;
+    uint32_t lastSeq() const;
+    uint32_t seqAt(uint32_t index) const { return firstSeq() + index; }
+    // Sequence number of the first record with epoch >= the given time
+    // (lastSeq() + 1 if none)
+    uint32_t seqLowerBound(uint32_t epoch);
+    // Read up to n records starting at sequence number seq. Records that
+    // were already overwritten are skipped; *firstRead receives the sequence
+    // number of records[0].
+    uint32_t readSeq(uint32_t seq, LogRecord *records, uint32_t n, uint32_t *firstRead);
+
+    bool isOpen() const { return _open; }
+    uint32_t count() const;
+    uint32_t capacity() const;
+    uint32_t appended() const;
+    size_t bytesUsed() const { return (size_t)count() * sizeof(LogRecord); }
+
+    // Timestamps of the oldest and newest stored record, 0 if empty. Kept
+    // up to date by every append, discard and clear, so unlike a scan they
+    // cost nothing; at most one record is read after the oldest changed.
+    uint32_t oldestEpoch();
+    uint32_t newestEpoch();
+    LogStats stats();
+
+private:
+    struct __attribute__((packed)) Header
+    {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t recordSize;
+        uint32_t capacity;   // Records
+        uint32_t generation; // Incremented on every header write
+        uint32_t head;       // Slot the next record goes to
+        uint32_t count;      // Records currently stored
+        uint32_t appended;   // Records ever appended
+        uint32_t crc;
+    };
+
+    static const uint32_t HEADER_SLOTS = 2;
+    static const uint32_t DATA_OFFSET = HEADER_SLOTS * sizeof(Header);
+    static const uint32_t RAISE_BATCH = 16; // Records copied at a time to raise their epochs
+
+    bool loadHeader();
+    bool writeHeader(Header header);
+    uint32_t epochAt(uint32_t index);
+    void loadBounds();
+    uint32_t slotOf(uint32_t index) const;
+    // True if no record's epoch is below newest or the one before it
+    static bool inTimeOrder(const LogRecord *records, uint32_t n, uint32_t newest);
+    static uint32_t headerCrc(const Header &header);
+
+    LogBackend &_backend;
+    Header _header;
+    bool _open;
+
+    // Derived from the records at the ends of the ring, so they need no
+    // space in the header
+    uint32_t _oldestEpoch;
+    uint32_t _newestEpoch;
+    bool _oldestStale; // The oldest record changed since _oldestEpoch was read
+    uint32_t _syncs;
+    uint32_t _bytesWritten;
+    mutable std::recursive_mutex _mutex;
+};
@@ -0,0 +1,88 @@
+#include "Downsample.h"
+
+Downsampler::Downsampler(uint32_t from, uint32_t to, uint32_t points, SeriesField field,
+                         Emit emit, void *context)
+    : _from(from), _to(to < from ? from : to), _field(field), _emit(emit), _context(context),
+      _bucket(0), _count(0), _sum(0), _min(0), _max(0)
+{
+    if (points == 0)
+    {
+        points = 1;
+    }
+    uint64_t span = (uint64_t)_to - _from + 1;
+    _width = (uint32_t)((span + points - 1) / points);
+    if (_width == 0)
+    {
+        _width = 1;
+    }
+}
+
+void Downsampler::add(const LogRecord &record)
+{
+    if (record.epoch < _from || record.epoch > _to)
+    {
+        return;
+    }
+
+    int16_t value;
+    switch (_field)
+    {
+    case SERIES_PARIT:
+        value = record.levelParit;
+        break;
+    case SERIES_RAW:
+        value = record.rawDistance;
+        break;
+    default:
+        value = record.levelBlok;
+        break;
+    }
+
+    uint32_t bucket = (record.epoch - _from) / _width;
+    if (_count > 0 && bucket != _bucket)
+    {
+        flush();
+    }
+    if (_count == 0)
+    {
+        _bucket = bucket;
+        _min = value;
+        _max = value;
+    }
+    else
+    {
+        if (value < _min)
+        {
+            _min = value;
+        }
+        if (value > _max)
+        {
+            _max = value;
+        }
+    }
+    _sum += value;
+    _count++;
+}
+
+void Downsampler::finish()
+{
+    if (_count > 0)
+    {
+        flush();
+    }
+}
+
+void Downsampler::flush()
+{
+    SeriesBucket out;
+    out.start = _from + _bucket * _width;
+    out.count = _count;
+    out.min = _min;
+    out.max = _max;
+    int64_t half = _count / 2;
+    out.mean = (int16_t)((_sum >= 0 ? _sum + half : _sum - half) / (int64_t)_count);
+    _emit(out, _context);
+
+    _count = 0;
+    _sum = 0;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "DataLog.h"
+
+enum SeriesField
+{
+    SERIES_BLOK,
+    SERIES_PARIT,
+    SERIES_RAW
+};
+
+// Summary of one time bucket, in the fixed-point units of LogRecord
+struct SeriesBucket
+{
+    uint32_t start; // Epoch of the bucket's first second
+    uint32_t count;
+    int16_t min;
+    int16_t max;
+    int16_t mean;
+};
+
+// Single-pass min/max/mean reduction of time-ordered records into at most
+// `points` equal-width buckets. Memory use is constant: only the bucket
+// being filled is held, and each finished bucket is handed to the caller.
+class Downsampler
+{
+public:
+    typedef void (*Emit)(const SeriesBucket &bucket, void *context);
+
+    Downsampler(uint32_t from, uint32_t to, uint32_t points, SeriesField field,
+                Emit emit, void *context);
+
+    void add(const LogRecord &record);
+    void finish();
+
+    uint32_t bucketSeconds() const { return _width; }
+
+private:
+    void flush();
+
+    uint32_t _from;
+    uint32_t _to;
+    uint32_t _width;
+    SeriesField _field;
+    Emit _emit;
+    void *_context;
+
+    uint32_t _bucket; // Index of the bucket being filled
+    uint32_t _count;
+    int64_t _sum;
+    int16_t _min;
+    int16_t _max;
+};
@@ -0,0 +1,684 @@
+#include "LogArchive.h"
+
+#include <string.h>
+
+#include "Crc32.h"
+
+// Tag byte of an encoded record, see LogArchive
+#define TAG_RAW_MASK 0x0F
+#define TAG_RAW_ESCAPE 0x0F
+#define TAG_CHANNEL_MASK 0x30
+#define TAG_CHANNEL_SHIFT 4
+#define TAG_EPOCH 0x40
+#define TAG_FLAGS 0x80
+// Low bit of the flags varint
+#define FLAGS_LEVELS 0x01
+
+// Longest encoded record: the tag and five 5-byte varints
+#define MAX_ENCODED_RECORD 26
+
+static_assert(LOG_CHANNELS <= (TAG_CHANNEL_MASK >> TAG_CHANNEL_SHIFT) + 1,
+              "every log channel must fit the tag");
+
+static uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static size_t putVarint(uint8_t *out, uint32_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80)
+    {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+// False if the varint runs past end
+static bool getVarint(const uint8_t *data, uint16_t end, uint16_t &pos, uint32_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        if (pos >= end)
+        {
+            return false;
+        }
+        uint8_t byte = data[pos++];
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t blockCrc(const ArchiveBlock &block)
+{
+    uint32_t crc = crc32(&block.header, offsetof(ArchiveBlockHeader, crc));
+    return crc32(block.payload, block.header.length, crc);
+}
+
+// Copies name into an archive station, cut at a UTF-8 character boundary
+static void setStation(ArchiveStation &station, int id, const char *name)
+{
+    size_t length = strlen(name);
+    if (length >= sizeof(station.name))
+    {
+        length = sizeof(station.name) - 1;
+        while (length > 0 && ((uint8_t)name[length] & 0xC0) == 0x80)
+        {
+            length--;
+        }
+    }
+    station.id = id;
+    memcpy(station.name, name, length);
+    station.name[length] = '\0';
+}
+
+BlockEncoder::BlockEncoder(ArchiveBlock &block, uint32_t firstSeq, const StationTable &stations)
+    : _block(block)
+{
+    memset(&_block, 0, sizeof(_block));
+    _block.header.firstSeq = firstSeq;
+    for (uint8_t channel = 0; channel < LOG_CHANNELS; channel++)
+    {
+        setStation(_block.header.stations[channel], stations.ids[channel], stations.names[channel]);
+    }
+    memset(_previous, 0, sizeof(_previous));
+    memset(_previousDelta, 0, sizeof(_previousDelta));
+}
+
+bool BlockEncoder::add(const LogRecord &record)
+{
+    ArchiveBlockHeader &header = _block.header;
+    if (header.count == 0xFFFF)
+    {
+        return false;
+    }
+    uint8_t channel = logChannel(record.flags);
+    if (header.count == 0)
+    {
+        header.first = record;
+        for (uint8_t i = 0; i < LOG_CHANNELS; i++)
+        {
+            _previous[i] = record;
+        }
+    }
+    else
+    {
+        // Deltas wrap like the fields themselves, so any record round-trips
+        const LogRecord &previous = _previous[channel];
+        int32_t delta = (int32_t)(record.epoch - previous.epoch);
+        int32_t raw = record.rawDistance - previous.rawDistance;
+        int32_t blok = record.levelBlok - previous.levelBlok + raw;
+        int32_t parit = record.levelParit - previous.levelParit + raw;
+        int32_t flags = record.flags - previous.flags;
+
+        uint8_t encoded[MAX_ENCODED_RECORD];
+        size_t n = 1;
+        uint8_t tag = (uint8_t)(channel << TAG_CHANNEL_SHIFT);
+        uint32_t rawZigzag = zigzag(raw);
+        if (rawZigzag < TAG_RAW_ESCAPE)
+        {
+            tag |= (uint8_t)rawZigzag;
+        }
+        else
+        {
+            tag |= TAG_RAW_ESCAPE;
+            n += putVarint(encoded + n, rawZigzag);
+        }
+        if (delta != _previousDelta[channel])
+        {
+            tag |= TAG_EPOCH;
+            n += putVarint(encoded + n, zigzag((int32_t)((uint32_t)delta - (uint32_t)_previousDelta[channel])));
+        }
+        // The quality in flags changes with almost every reading, while
+        // the levels part from the raw distance only when the calibration
+        // does, so they share the tag bit
+        bool levels = blok != 0 || parit != 0;
+        if (flags != 0 || levels)
+        {
+            tag |= TAG_FLAGS;
+            n += putVarint(encoded + n, zigzag(flags) << 1 | (levels ? FLAGS_LEVELS : 0));
+        }
+        if (levels)
+        {
+            n += putVarint(encoded + n, zigzag(blok));
+            n += putVarint(encoded + n, zigzag(parit));
+        }
+        encoded[0] = tag;
+
+        if (header.length + n > sizeof(_block.payload))
+        {
+            return false;
+        }
+        memcpy(_block.payload + header.length, encoded, n);
+        header.length += n;
+        _previousDelta[channel] = delta;
+    }
+
+    _previous[channel] = record;
+    header.lastEpoch = record.epoch;
+    header.count++;
+    return true;
+}
+
+BlockDecoder::BlockDecoder(const ArchiveBlock &block)
+    : _block(block), _index(0), _pos(0)
+{
+    memset(_previous, 0, sizeof(_previous));
+    memset(_previousDelta, 0, sizeof(_previousDelta));
+}
+
+void BlockDecoder::reset()
+{
+    _index = 0;
+    _pos = 0;
+    memset(_previousDelta, 0, sizeof(_previousDelta));
+}
+
+bool BlockDecoder::next(LogRecord &record, uint32_t &seq)
+{
+    const ArchiveBlockHeader &header = _block.header;
+    if (_index >= header.count)
+    {
+        return false;
+    }
+
+    if (_index == 0)
+    {
+        record = header.first;
+        for (uint8_t i = 0; i < LOG_CHANNELS; i++)
+        {
+            _previous[i] = record;
+        }
+    }
+    else
+    {
+        uint16_t end = header.length;
+        if (_pos >= end)
+        {
+            return false;
+        }
+        uint8_t tag = _block.payload[_pos++];
+        uint8_t channel = (tag & TAG_CHANNEL_MASK) >> TAG_CHANNEL_SHIFT;
+        const LogRecord &previous = _previous[channel];
+        uint32_t value = tag & TAG_RAW_MASK;
+        int32_t delta = _previousDelta[channel];
+        int32_t blok = 0;
+        int32_t parit = 0;
+        int32_t flags = 0;
+        if ((tag & TAG_RAW_MASK) == TAG_RAW_ESCAPE && !getVarint(_block.payload, end, _pos, value))
+        {
+            return false;
+        }
+        int32_t raw = unzigzag(value);
+        if (tag & TAG_EPOCH)
+        {
+            if (!getVarint(_block.payload, end, _pos, value))
+            {
+                return false;
+            }
+            delta = (int32_t)((uint32_t)delta + (uint32_t)unzigzag(value));
+        }
+        if (tag & TAG_FLAGS)
+        {
+            if (!getVarint(_block.payload, end, _pos, value))
+            {
+                return false;
+            }
+            flags = unzigzag(value >> 1);
+            if (value & FLAGS_LEVELS)
+            {
+                if (!getVarint(_block.payload, end, _pos, value))
+                {
+                    return false;
+                }
+                blok = unzigzag(value);
+                if (!getVarint(_block.payload, end, _pos, value))
+                {
+                    return false;
+                }
+                parit = unzigzag(value);
+            }
+        }
+
+        record.epoch = previous.epoch + (uint32_t)delta;
+        record.rawDistance = (int16_t)(previous.rawDistance + raw);
+        record.levelBlok = (int16_t)(previous.levelBlok + blok - raw);
+        record.levelParit = (int16_t)(previous.levelParit + parit - raw);
+        record.flags = (uint16_t)(previous.flags + flags);
+        _previousDelta[channel] = delta;
+        _previous[channel] = record;
+    }
+
+    seq = header.firstSeq + _index;
+    _index++;
+    return true;
+}
+
+ArchiveCursor::ArchiveCursor(LogArchive &archive, uint32_t startBlock)
+    : _archive(archive), _nextBlock(startBlock), _endBlock(archive.endBlock()),
+      _block(), _decoder(_block)
+{
+}
+
+bool ArchiveCursor::next(LogRecord &record, uint32_t &seq)
+{
+    while (!_decoder.next(record, seq))
+    {
+        if (_nextBlock < _archive.firstBlock())
+        {
+            _nextBlock = _archive.firstBlock(); // Overwritten since the last block
+        }
+        if (_nextBlock >= _endBlock)
+        {
+            return false;
+        }
+        if (!_archive.readBlock(_nextBlock++, _block))
+        {
+            _block.header.count = 0;
+        }
+        _decoder.reset();
+    }
+    return true;
+}
+
+LogArchive::LogArchive(LogBackend &backend) : _backend(backend), _open(false)
+{
+    memset(&_header, 0, sizeof(_header));
+}
+
+bool LogArchive::begin(uint32_t capacity)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if (loadHeader())
+    {
+        _open = true;
+        return true;
+    }
+    return format(capacity);
+}
+
+bool LogArchive::format(uint32_t capacity)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if (capacity == 0)
+    {
+        return false;
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.blockSize = ARCHIVE_BLOCK_SIZE;
+    header.capacity = capacity;
+
+    uint8_t blank[DATA_OFFSET];
+    memset(blank, 0xFF, sizeof(blank));
+    if (!_backend.write(0, blank, sizeof(blank)) || !writeHeader(header) || !writeHeader(_header))
+    {
+        _open = false;
+        return false;
+    }
+    _open = true;
+    return true;
+}
+
+bool LogArchive::clear()
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if (!_open)
+    {
+        return false;
+    }
+    Header header = _header;
+    header.count = 0;
+    header.records = 0;
+    return writeHeader(header);
+}
+
+uint32_t LogArchive::liveStart(DataLog &log)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    uint32_t first = log.firstSeq();
+    // An endSeq past the log's end means the log was reformatted since
+    if (_header.count == 0 || _header.endSeq > log.lastSeq() + 1)
+    {
+        return first;
+    }
+    return _header.endSeq > first ? _header.endSeq : first;
+}
+
+uint32_t LogArchive::archive(DataLog &log, uint32_t endSeq, uint32_t maxBlocks, const StationTable &stations)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if (!_open)
+    {
+        return 0;
+    }
+    if (endSeq > log.lastSeq() + 1)
+    {
+        endSeq = log.lastSeq() + 1;
+    }
+
+    ArchiveBlock block;
+    uint32_t archived = 0;
+    uint32_t seq = liveStart(log);
+    for (uint32_t written = 0; written < maxBlocks && seq < endSeq; written++)
+    {
+        BlockEncoder encoder(block, seq, stations);
+        bool full = false;
+        while (!full && seq < endSeq)
+        {
+            LogRecord batch[16];
+            uint32_t want = endSeq - seq < 16 ? endSeq - seq : 16;
+            uint32_t firstRead;
+            uint32_t n = log.readSeq(seq, batch, want, &firstRead);
+            if (n == 0)
+            {
+                return archived;
+            }
+            if (firstRead != seq)
+            {
+                // Records were overwritten under us; a block holds a
+                // contiguous run, so end it here
+                if (encoder.count() > 0)
+                {
+                    full = true;
+                    break;
+                }
+                block.header.firstSeq = firstRead;
+                seq = firstRead;
+            }
+            for (uint32_t i = 0; i < n; i++)
+            {
+                if (!encoder.add(batch[i]))
+                {
+                    full = true;
+                    break;
+                }
+                seq++;
+            }
+        }
+        if (!full)
+        {
+            break; // Not enough records left for a whole block
+        }
+
+        if (!writeBlock(block))
+        {
+            break;
+        }
+        archived += block.header.count;
+    }
+    return archived;
+}
+
+// The block is part of the archive, and endSeq moves past its records,
+// only once the header naming it is on flash
+bool LogArchive::writeBlock(ArchiveBlock &block)
+{
+    block.header.number = _header.appended;
+    block.header.crc = blockCrc(block);
+
+    Header header = _header;
+    if (header.count == header.capacity)
+    {
+        // Overwriting the oldest block
+        ArchiveBlockHeader oldest;
+        if (readBlockHeader(firstBlock(), oldest))
+        {
+            header.records -= oldest.count < header.records ? oldest.count : header.records;
+        }
+        header.count--;
+    }
+    if (!_backend.write(offsetOf(header.appended), &block, sizeof(block)))
+    {
+        return false;
+    }
+
+    header.head = (header.head + 1) % header.capacity;
+    header.count++;
+    header.appended++;
+    header.records += block.header.count;
+    header.endSeq = block.header.firstSeq + block.header.count;
+    return writeHeader(header);
+}
+
+bool LogArchive::readBlock(uint32_t number, ArchiveBlock &block)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if (!_open || number < firstBlock() || number >= endBlock())
+    {
+        return false;
+    }
+    if (!_backend.read(offsetOf(number), &block, sizeof(block)))
+    {
+        return false;
+    }
+    return block.header.number == number && block.header.length <= sizeof(block.payload) &&
+           block.header.crc == blockCrc(block);
+}
+
+bool LogArchive::readBlockHeader(uint32_t number, ArchiveBlockHeader &header)
+{
+    return _backend.read(offsetOf(number), &header, sizeof(header)) && header.number == number;
+}
+
+uint32_t LogArchive::blockLowerBound(uint32_t epoch)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    uint32_t low = firstBlock();
+    uint32_t high = endBlock();
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+        ArchiveBlockHeader header;
+        if (!readBlockHeader(mid, header))
+        {
+            break;
+        }
+        if (header.lastEpoch < epoch)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+uint32_t LogArchive::blockForSeq(uint32_t seq)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    uint32_t low = firstBlock();
+    uint32_t high = endBlock();
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+        ArchiveBlockHeader header;
+        if (!readBlockHeader(mid, header))
+        {
+            break;
+        }
+        if (header.firstSeq + header.count <= seq)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+uint32_t LogArchive::seqLowerBound(uint32_t epoch)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    ArchiveBlock block;
+    for (uint32_t number = blockLowerBound(epoch); number < endBlock(); number++)
+    {
+        if (!readBlock(number, block))
+        {
+            continue;
+        }
+        BlockDecoder decoder(block);
+        LogRecord record;
+        uint32_t seq;
+        while (decoder.next(record, seq))
+        {
+            if (record.epoch >= epoch)
+            {
+                return seq;
+            }
+        }
+    }
+    return _header.endSeq;
+}
+
+uint32_t LogArchive::firstSeq()
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    ArchiveBlockHeader header;
+    if (!_open || _header.count == 0 || !readBlockHeader(firstBlock(), header))
+    {
+        return _header.endSeq;
+    }
+    return header.firstSeq;
+}
+
+uint32_t LogArchive::endSeq() const
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return _header.endSeq;
+}
+
+uint32_t LogArchive::firstBlock() const
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return _header.appended - _header.count;
+}
+
+uint32_t LogArchive::endBlock() const
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return _header.appended;
+}
+
+uint32_t LogArchive::blocks() const
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return _header.count;
+}
+
+uint32_t LogArchive::capacity() const
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return _header.capacity;
+}
+
+uint32_t LogArchive::records() const
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return _header.records;
+}
+
+ArchiveStats LogArchive::stats()
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    ArchiveStats stats;
+    stats.blocks = _header.count;
+    stats.capacity = _header.capacity;
+    stats.records = _header.records;
+    stats.endSeq = _header.endSeq;
+    stats.oldestEpoch = 0;
+    stats.newestEpoch = 0;
+    stats.bytesUsed = (size_t)_header.count * ARCHIVE_BLOCK_SIZE;
+
+    ArchiveBlockHeader header;
+    if (_open && _header.count > 0)
+    {
+        if (readBlockHeader(firstBlock(), header))
+        {
+            stats.oldestEpoch = header.first.epoch;
+        }
+        if (readBlockHeader(endBlock() - 1, header))
+        {
+            stats.newestEpoch = header.lastEpoch;
+        }
+    }
+    return stats;
+}
+
+uint32_t LogArchive::offsetOf(uint32_t number) const
+{
+    return DATA_OFFSET + (number % _header.capacity) * ARCHIVE_BLOCK_SIZE;
+}
+
+bool LogArchive::loadHeader()
+{
+    Header slots[HEADER_SLOTS];
+    const Header *best = nullptr;
+
+    for (uint32_t i = 0; i < HEADER_SLOTS; i++)
+    {
+        if (!_backend.read(i * sizeof(Header), &slots[i], sizeof(Header)))
+        {
+            continue;
+        }
+        const Header &h = slots[i];
+        if (h.magic != MAGIC || h.version != VERSION ||
+            h.blockSize != ARCHIVE_BLOCK_SIZE || h.capacity == 0 ||
+            h.head >= h.capacity || h.count > h.capacity ||
+            h.crc != headerCrc(h))
+        {
+            continue;
+        }
+        if (!best || (int32_t)(h.generation - best->generation) > 0)
+        {
+            best = &h;
+        }
+    }
+
+    if (!best)
+    {
+        return false;
+    }
+    _header = *best;
+    return true;
+}
+
+// As DataLog::writeHeader(): current only once written and synced
+bool LogArchive::writeHeader(Header header)
+{
+    header.generation = _header.generation + 1;
+    header.crc = headerCrc(header);
+
+    uint32_t offset = (header.generation % HEADER_SLOTS) * sizeof(Header);
+    if (!_backend.write(offset, &header, sizeof(header)) || !_backend.sync())
+    {
+        return false;
+    }
+    _header = header;
+    return true;
+}
+
+uint32_t LogArchive::headerCrc(const Header &header)
+{
+    return crc32(&header, offsetof(Header, crc));
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "DataLog.h"
+#include "LogBackend.h"
+#include "LogFormat.h"
+
+#define ARCHIVE_BLOCK_SIZE 1024
+#define ARCHIVE_STATION_NAME_LENGTH 32
+
+struct __attribute__((packed)) ArchiveStation
+{
+    int32_t id;
+    char name[ARCHIVE_STATION_NAME_LENGTH]; // Always terminated
+};
+
+// Header of one archive block. The block's first record is kept whole; the
+// rest of the payload holds the following records as deltas.
+struct __attribute__((packed)) ArchiveBlockHeader
+{
+    uint32_t number;   // Blocks appended to the archive before this one
+    uint32_t firstSeq; // Sequence number of the first record in the DataLog
+    uint32_t lastEpoch;
+    LogRecord first;
+    uint16_t count;  // Records, including first
+    uint16_t length; // Payload bytes used
+    // Station each channel's records were measured at, so the export does
+    // not depend on the configuration at the time it is read
+    ArchiveStation stations[LOG_CHANNELS];
+    uint32_t crc; // Over the header before this field and the payload
+};
+
+struct ArchiveBlock
+{
+    ArchiveBlockHeader header;
+    uint8_t payload[ARCHIVE_BLOCK_SIZE - sizeof(ArchiveBlockHeader)];
+};
+
+struct ArchiveStats
+{
+    uint32_t blocks;
+    uint32_t capacity; // Blocks
+    uint32_t records;
+    uint32_t endSeq;      // Sequence number after the newest archived record
+    uint32_t oldestEpoch; // 0 if the archive is empty
+    uint32_t newestEpoch;
+    size_t bytesUsed;
+};
+
+// Compressed long-term history behind the DataLog ring.
+//
+// Layout on the backend:
+//   [header slot 0][header slot 1][block 0][block 1]...[block capacity-1]
+//
+// Records move here from the oldest end of the DataLog a whole block at a
+// time. Each record after a block's first is coded against the one before
+// it from the same channel, or the block's first record if there is none:
+// one tag byte, then zigzag varints for whatever the tag does not already
+// hold.
+//
+//   tag bits 0-3: zigzag raw distance delta, or 15 if a varint follows
+//   tag bits 4-5: channel
+//   tag bit 6:    varint epoch delta-of-delta (0 at a steady interval)
+//   tag bit 7:    varint flags delta, shifted up one; its low bit is set
+//                 when varint blok and parit deltas follow, less the one
+//                 the raw delta implies
+//
+// Blok and parit move opposite to the raw distance, so a steady reading
+// costs one byte and a typical one two or three, against 12 in the ring,
+// however the channels are interleaved.
+//
+// Blocks are fixed-size and written once, each with its own CRC, and they
+// form a ring like the DataLog's: when the archive is full the oldest block
+// is overwritten. Block headers carry their time and sequence range, so
+// they double as the index: a time lookup reads O(log n) headers and
+// decodes a single block.
+class LogArchive
+{
+public:
+    static const uint32_t MAGIC = 0x414C4C57; // "WLLA"
+    static const uint16_t VERSION = 2;
+
+    explicit LogArchive(LogBackend &backend);
+
+    // Open an existing archive, or format a new one with room for the given
+    // number of blocks
+    bool begin(uint32_t capacity);
+    bool format(uint32_t capacity);
+    bool clear();
+
+    // Move records from the log into new blocks, starting at liveStart()
+    // and stopping before endSeq. Only whole blocks are written, so the
+    // tail stays in the log; the caller discards what was archived from it.
+    // Returns the number of records archived, counting only blocks whose
+    // header write succeeded.
+    uint32_t archive(DataLog &log, uint32_t endSeq, uint32_t maxBlocks, const StationTable &stations);
+
+    // First sequence number in the log that is not also in the archive
+    uint32_t liveStart(DataLog &log);
+
+    // Blocks are numbered like DataLog records: firstBlock() up to, but not
+    // including, endBlock() are stored. Returns false if the block was
+    // overwritten or fails its CRC.
+    bool readBlock(uint32_t number, ArchiveBlock &block);
+    uint32_t firstBlock() const;
+    uint32_t endBlock() const;
+    // First block holding a record with epoch >= the given time (endBlock()
+    // if none)
+    uint32_t blockLowerBound(uint32_t epoch);
+    // First block holding sequence number seq or a later one (endBlock() if
+    // none)
+    uint32_t blockForSeq(uint32_t seq);
+    // Sequence number of the first archived record with epoch >= the given
+    // time (endSeq() if none); decodes a single block
+    uint32_t seqLowerBound(uint32_t epoch);
+
+    // Sequence numbers firstSeq() up to, but not including, endSeq() are
+    // archived, unless a block in between fails its CRC
+    uint32_t firstSeq();
+    uint32_t endSeq() const;
+
+    bool isOpen() const { return _open; }
+    uint32_t blocks() const;
+    uint32_t capacity() const;
+    uint32_t records() const;
+    ArchiveStats stats();
+
+private:
+    struct __attribute__((packed)) Header
+    {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t blockSize;
+        uint32_t capacity;   // Blocks
+        uint32_t generation; // Incremented on every header write
+        uint32_t head;       // Slot the next block goes to
+        uint32_t count;      // Blocks currently stored
+        uint32_t appended;   // Blocks ever appended
+        uint32_t records;    // Records in the stored blocks
+        uint32_t endSeq;     // Sequence number after the newest archived record
+        uint32_t crc;
+    };
+
+    static const uint32_t HEADER_SLOTS = 2;
+    static const uint32_t DATA_OFFSET = HEADER_SLOTS * sizeof(Header);
+
+    bool writeBlock(ArchiveBlock &block);
+    bool readBlockHeader(uint32_t number, ArchiveBlockHeader &header);
+    uint32_t offsetOf(uint32_t number) const;
+    bool loadHeader();
+    bool writeHeader(Header header);
+    static uint32_t headerCrc(const Header &header);
+
+    LogBackend &_backend;
+    Header _header;
+    bool _open;
+    mutable std::recursive_mutex _mutex;
+};
+
+// Adds records to a block until the next one does not fit
+class BlockEncoder
+{
+public:
+    BlockEncoder(ArchiveBlock &block, uint32_t firstSeq, const StationTable &stations);
+
+    // False if the record does not fit; the block is then complete
+    bool add(const LogRecord &record);
+    uint32_t count() const { return _block.header.count; }
+
+private:
+    ArchiveBlock &_block;
+    // Per channel
+    LogRecord _previous[LOG_CHANNELS];
+    int32_t _previousDelta[LOG_CHANNELS]; // Epoch step into _previous
+};
+
+// Reads a block's records back in order
+class BlockDecoder
+{
+public:
+    explicit BlockDecoder(const ArchiveBlock &block);
+
+    bool next(LogRecord &record, uint32_t &seq);
+    // Start again from the first record, e.g. after the block was reloaded
+    void reset();
+
+private:
+    const ArchiveBlock &_block;
+    uint16_t _index;
+    uint16_t _pos;
+    LogRecord _previous[LOG_CHANNELS];
+    int32_t _previousDelta[LOG_CHANNELS];
+};
+
+// Walks every stored record, oldest first, one decoded block at a time.
+// Blocks overwritten while it runs are skipped.
+class ArchiveCursor
+{
+public:
+    ArchiveCursor(LogArchive &archive, uint32_t startBlock);
+
+    bool next(LogRecord &record, uint32_t &seq);
+    // Header of the block the last record came from
+    const ArchiveBlockHeader &block() const { return _block.header; }
+
+private:
+    LogArchive &_archive;
+    uint32_t _nextBlock;
+    uint32_t _endBlock;
+    ArchiveBlock _block;
+    BlockDecoder _decoder;
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte-addressed storage the DataLog is written to. On the device this is a
+// file on the SPIFFS "storage" partition; on the host it is a plain file
+// standing in for flash.
+class LogBackend
+{
+public:
+    virtual ~LogBackend() {}
+
+    virtual bool read(uint32_t offset, void *buffer, size_t length) = 0;
+    // Writing at the current end of the backend extends it
+    virtual bool write(uint32_t offset, const void *buffer, size_t length) = 0;
+    virtual bool sync() = 0;
+    virtual size_t size() = 0;
+};
+
+#ifdef ARDUINO
+
+#include <FS.h>
+
+class FsLogBackend : public LogBackend
+{
+public:
+    FsLogBackend(fs::FS &fs, const char *path) : _fs(fs), _path(path) {}
+
+    bool open()
+    {
+        if (!_fs.exists(_path))
+        {
+            File created = _fs.open(_path, "w");
+            if (!created)
+            {
+                return false;
+            }
+            created.close();
+        }
+        _file = _fs.open(_path, "r+");
+        return (bool)_file;
+    }
+
+    void close()
+    {
+        if (_file)
+        {
+            _file.close();
+        }
+    }
+
+    bool read(uint32_t offset, void *buffer, size_t length) override
+    {
+        if (!_file || !_file.seek(offset, SeekSet))
+        {
+            return false;
+        }
+        return _file.read((uint8_t *)buffer, length) == length;
+    }
+
+    bool write(uint32_t offset, const void *buffer, size_t length) override
+    {
+        if (!_file || !_file.seek(offset, SeekSet))
+        {
+            return false;
+        }
+        return _file.write((const uint8_t *)buffer, length) == length;
+    }
+
+    bool sync() override
+    {
+        if (!_file)
+        {
+            return false;
+        }
+        _file.flush();
+        return true;
+    }
+
+    size_t size() override
+    {
+        return _file ? _file.size() : 0;
+    }
+
+private:
+    fs::FS &_fs;
+    const char *_path;
+    File _file;
+};
+
+#else
+
+#include <stdio.h>
+
+// File-backed flash stand-in for host builds
+class FileLogBackend : public LogBackend
+{
+public:
+    explicit FileLogBackend(const char *path) : _path(path), _file(nullptr) {}
+    ~FileLogBackend() override { close(); }
+
+    bool open()
+    {
+        _file = fopen(_path, "r+b");
+        if (!_file)
+        {
+            _file = fopen(_path, "w+b");
+        }
+        return _file != nullptr;
+    }
+
+    void close()
+    {
+        if (_file)
+        {
+            fclose(_file);
+            _file = nullptr;
+        }
+    }
+
+    bool read(uint32_t offset, void *buffer, size_t length) override
+    {
+        if (!_file || fseek(_file, offset, SEEK_SET) != 0)
+        {
+            return false;
+        }
+        return fread(buffer, 1, length, _file) == length;
+    }
+
+    bool write(uint32_t offset, const void *buffer, size_t length) override
+    {
+        if (!_file || fseek(_file, offset, SEEK_SET) != 0)
+        {
+            return false;
+        }
+        return fwrite(buffer, 1, length, _file) == length;
+    }
+
+    bool sync() override
+    {
+        return _file && fflush(_file) == 0;
+    }
+
+    size_t size() override
+    {
+        if (!_file || fseek(_file, 0, SEEK_END) != 0)
+        {
+            return 0;
+        }
+        return (size_t)ftell(_file);
+    }
+
+private:
+    const char *_path;
+    FILE *_file;
+};
+
+#endif
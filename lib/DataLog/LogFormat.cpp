@@ -0,0 +1,197 @@
+#include "LogFormat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Days since 1970-01-01 for a proleptic Gregorian date, and back
+// (H. Hinnant's civil calendar algorithms)
+static int32_t daysFromCivil(int year, int month, int day)
+{
+    year -= month <= 2;
+    int32_t era = (year >= 0 ? year : year - 399) / 400;
+    uint32_t yoe = (uint32_t)(year - era * 400);
+    uint32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+static void civilFromDays(int32_t days, int &year, int &month, int &day)
+{
+    days += 719468;
+    int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+    uint32_t doe = (uint32_t)(days - era * 146097);
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp = (5 * doy + 2) / 153;
+    day = doy - (153 * mp + 2) / 5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = (int)yoe + era * 400 + (month <= 2);
+}
+
+uint32_t toEpoch(int year, int month, int day, int hour, int minute, int second)
+{
+    return (uint32_t)daysFromCivil(year, month, day) * 86400UL +
+           hour * 3600UL + minute * 60UL + second;
+}
+
+size_t formatDateTime(char *buffer, size_t size, uint32_t epoch)
+{
+    int written;
+    if (epoch == 0)
+    {
+        written = snprintf(buffer, size, "UNKNOWN");
+    }
+    else
+    {
+        int year, month, day;
+        civilFromDays(epoch / 86400, year, month, day);
+        uint32_t secs = epoch % 86400;
+        written = snprintf(buffer, size, "%04d-%02d-%02d %02u:%02u:%02u",
+                           year, month, day,
+                           (unsigned)(secs / 3600), (unsigned)(secs / 60 % 60), (unsigned)(secs % 60));
+    }
+    return (written > 0 && (size_t)written < size) ? written : 0;
+}
+
+StationTable::StationTable()
+{
+    memset(ids, 0, sizeof(ids));
+    memset(names, 0, sizeof(names));
+}
+
+void StationTable::set(uint8_t channel, int id, const char *name)
+{
+    if (channel >= LOG_CHANNELS)
+    {
+        return;
+    }
+    ids[channel] = id;
+    snprintf(names[channel], sizeof(names[channel]), "%s", name);
+}
+
+size_t formatLevel(char *buffer, size_t size, int16_t value)
+{
+    int v = value;
+    int written = snprintf(buffer, size, "%s%d.%d", v < 0 ? "-" : "", abs(v) / 10, abs(v) % 10);
+    return (written > 0 && (size_t)written < size) ? written : 0;
+}
+
+size_t formatCsvRow(char *buffer, size_t size, int stationId, const char *stationName,
+                    const LogRecord &record)
+{
+    char dateTime[24];
+    char blok[12], parit[12], raw[12];
+    formatDateTime(dateTime, sizeof(dateTime), record.epoch);
+    formatLevel(blok, sizeof(blok), record.levelBlok);
+    formatLevel(parit, sizeof(parit), record.levelParit);
+    formatLevel(raw, sizeof(raw), record.rawDistance);
+
+    // Two decimals, as the old CSV had. A name too long for the buffer is
+    // cut rather than the record left out of the export.
+    int nameLength = (int)strlen(stationName);
+    int written = snprintf(buffer, size, "%d,%.*s,%s,%s0,%s0,%s0\n",
+                           stationId, nameLength, stationName, dateTime, blok, parit, raw);
+    if (written > 0 && (size_t)written >= size)
+    {
+        nameLength -= written - (int)size + 1;
+        while (nameLength > 0 && ((unsigned char)stationName[nameLength] & 0xC0) == 0x80)
+        {
+            nameLength--; // Not inside a UTF-8 sequence
+        }
+        if (nameLength < 0)
+        {
+            return 0;
+        }
+        written = snprintf(buffer, size, "%d,%.*s,%s,%s0,%s0,%s0\n",
+                           stationId, nameLength, stationName, dateTime, blok, parit, raw);
+    }
+    return (written > 0 && (size_t)written < size) ? written : 0;
+}
+
+bool parseCsvRow(const char *line, LogRecord &record)
+{
+    // Split from the right so a comma in the station name cannot shift columns
+    const char *fields[4];
+    const char *end = line + strlen(line);
+    int found = 0;
+    for (const char *p = end; p > line && found < 4; p--)
+    {
+        if (p[-1] == ',')
+        {
+            fields[found++] = p;
+        }
+    }
+    if (found < 4)
+    {
+        return false;
+    }
+
+    // fields[3] is the DateTime column, fields[0..2] the three levels
+    int year, month, day, hour, minute, second;
+    uint32_t epoch = 0;
+    if (sscanf(fields[3], "%d-%d-%d %d:%d:%d", &year, &month, &day, &hour, &minute, &second) == 6)
+    {
+        epoch = toEpoch(year, month, day, hour, minute, second);
+    }
+    else if (strncmp(fields[3], "UPTIME_", 7) != 0 && strncmp(fields[3], "UNKNOWN", 7) != 0 &&
+             strncmp(fields[3], "INVALID_DATE", 12) != 0 && strncmp(fields[3], "RTC_ERROR", 9) != 0)
+    {
+        return false;
+    }
+
+    char *parsedEnd;
+    float blok = strtof(fields[2], &parsedEnd);
+    if (parsedEnd == fields[2])
+    {
+        return false;
+    }
+    float parit = strtof(fields[1], &parsedEnd);
+    if (parsedEnd == fields[1])
+    {
+        return false;
+    }
+    float raw = strtof(fields[0], &parsedEnd);
+    if (parsedEnd == fields[0])
+    {
+        return false;
+    }
+
+    record.epoch = epoch;
+    record.levelBlok = toFixedLevel(blok);
+    record.levelParit = toFixedLevel(parit);
+    record.rawDistance = toFixedLevel(raw);
+    record.flags = 0;
+    return true;
+}
+
+void escapeJson(char *out, size_t size, const char *in)
+{
+    size_t used = 0;
+    for (; *in; in++)
+    {
+        char escaped[7];
+        unsigned char c = (unsigned char)*in;
+        if (c == '"' || c == '\\')
+        {
+            snprintf(escaped, sizeof(escaped), "\\%c", c);
+        }
+        else if (c < 0x20)
+        {
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        }
+        else
+        {
+            escaped[0] = c;
+            escaped[1] = '\0';
+        }
+        size_t length = strlen(escaped);
+        if (used + length >= size)
+        {
+            break;
+        }
+        memcpy(out + used, escaped, length);
+        used += length;
+    }
+    out[used] = '\0';
+}
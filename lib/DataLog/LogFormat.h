@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "DataLog.h"
+
+// Column header of the CSV export (kept identical to the old /data.csv)
+#define CSV_HEADER "Station ID,Station Name,DateTime,Water Level (Blok) (cm),Water Level (Parit) (cm),Raw Distance (cm)"
+
+#define STATION_NAME_LENGTH 64
+
+// Station each log channel is exported and uploaded as
+struct StationTable
+{
+    int ids[LOG_CHANNELS];
+    char names[LOG_CHANNELS][STATION_NAME_LENGTH]; // Always terminated
+
+    StationTable();
+    // Copies the name, truncating it if needed; ignores unknown channels
+    void set(uint8_t channel, int id, const char *name);
+};
+
+// "YYYY-MM-DD HH:MM:SS", or "UNKNOWN" for epoch 0. Returns the length written.
+size_t formatDateTime(char *buffer, size_t size, uint32_t epoch);
+uint32_t toEpoch(int year, int month, int day, int hour, int minute, int second);
+
+// Fixed-point level as centimetres with one decimal, e.g. "-12.3"
+size_t formatLevel(char *buffer, size_t size, int16_t value);
+
+// One CSV row including the trailing newline, with the station name
+// shortened if that makes it fit. Returns the length written, or 0 if the
+// buffer cannot hold even the other columns.
+size_t formatCsvRow(char *buffer, size_t size, int stationId, const char *stationName,
+                    const LogRecord &record);
+
+// Parse a row of the legacy /data.csv. Returns false for the header or
+// malformed lines.
+bool parseCsvRow(const char *line, LogRecord &record);
+
+// Copy a string into the body of a JSON string literal, dropping whatever
+// does not fit without splitting an escape sequence
+void escapeJson(char *out, size_t size, const char *in);
@@ -0,0 +1,53 @@
+#include "LogHistory.h"
+
+LogArchive *LogHistory::archive() const
+{
+    // An archive that ends past the log was written before the log was
+    // reformatted, and its sequence numbers mean nothing now
+    if (!_archive || !_archive->isOpen() || _archive->blocks() == 0 ||
+        _archive->endSeq() > _log->lastSeq() + 1)
+    {
+        return nullptr;
+    }
+    return _archive;
+}
+
+uint32_t LogHistory::firstSeq() const
+{
+    LogArchive *archive = this->archive();
+    uint32_t first = _log->firstSeq();
+    if (archive)
+    {
+        uint32_t archived = archive->firstSeq();
+        return archived < first ? archived : first;
+    }
+    return first;
+}
+
+uint32_t LogHistory::liveStart() const
+{
+    LogArchive *archive = this->archive();
+    return archive ? archive->liveStart(*_log) : _log->firstSeq();
+}
+
+uint32_t LogHistory::seqLowerBound(uint32_t epoch) const
+{
+    LogArchive *archive = this->archive();
+    if (archive)
+    {
+        uint32_t seq = archive->seqLowerBound(epoch);
+        if (seq < archive->endSeq())
+        {
+            return seq;
+        }
+    }
+    uint32_t seq = _log->seqLowerBound(epoch);
+    uint32_t live = liveStart();
+    return seq > live ? seq : live;
+}
+
+uint32_t LogHistory::oldestEpoch() const
+{
+    LogArchive *archive = this->archive();
+    return archive ? archive->stats().oldestEpoch : _log->oldestEpoch();
+}
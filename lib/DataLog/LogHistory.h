@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "DataLog.h"
+#include "LogArchive.h"
+
+// The archive and the log seen as one run of sequence numbers: those the
+// archive holds are read from its blocks, the rest from the log. Readers
+// that use it keep working while records move from the log into the
+// archive. Without an open archive it is just the log, so a DataLog
+// converts to a LogHistory wherever one is expected.
+//
+// Cheap to copy; it only refers to the log and the archive.
+class LogHistory
+{
+public:
+    LogHistory(DataLog &log, LogArchive *archive = nullptr) : _log(&log), _archive(archive) {}
+
+    DataLog &log() const { return *_log; }
+    // The archive if it is open, has blocks and belongs to this log; null
+    // otherwise
+    LogArchive *archive() const;
+
+    // Oldest sequence number still held in either
+    uint32_t firstSeq() const;
+    uint32_t lastSeq() const { return _log->lastSeq(); }
+    // First sequence number read from the log rather than the archive
+    uint32_t liveStart() const;
+
+    // Sequence number of the first record with epoch >= the given time
+    // (lastSeq() + 1 if none): a block lookup in the archive, or the log's
+    // binary search for times after it
+    uint32_t seqLowerBound(uint32_t epoch) const;
+
+    // 0 if there are no records
+    uint32_t oldestEpoch() const;
+    uint32_t newestEpoch() const { return _log->newestEpoch(); }
+
+private:
+    DataLog *_log;
+    LogArchive *_archive;
+};
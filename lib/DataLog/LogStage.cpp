@@ -0,0 +1,196 @@
+#include "LogStage.h"
+
+#include <atomic>
+#include <string.h>
+
+#include "Crc32.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+LogStage::LogStage(DataLog &log, StageHeader &header, LogRecord *records, uint32_t capacity)
+    : _log(log), _header(header), _records(records), _capacity(capacity),
+      _commitRecords(capacity), _commitMs(0xFFFFFFFF), _firstStagedMs(0)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void LogStage::configure(uint32_t commitRecords, uint32_t commitMs)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    _commitRecords = (commitRecords == 0 || commitRecords > _capacity) ? _capacity : commitRecords;
+    _commitMs = commitMs;
+}
+
+uint32_t LogStage::recover(uint32_t nowMs)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    uint32_t committed = committedCount();
+    if (committed == 0)
+    {
+        reset();
+        return 0;
+    }
+    _header.count = committed;
+
+    // Commits are all or nothing, so the log either reached baseSeq or has
+    // none of the batch. A log that went backwards was reformatted and has
+    // none of it either.
+    uint32_t lastSeq = _log.lastSeq();
+    if (lastSeq >= _header.baseSeq && lastSeq - _header.baseSeq < 0x80000000)
+    {
+        reset();
+        return 0;
+    }
+
+    uint32_t count = _header.count;
+    if (!commitLocked(nowMs))
+    {
+        return 0;
+    }
+    _stats.recovered += count;
+    return count;
+}
+
+bool LogStage::add(const LogRecord &record, uint32_t nowMs)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if (_header.count >= _capacity && !commitLocked(nowMs))
+    {
+        return false;
+    }
+
+    uint32_t count = _header.count;
+    uint32_t crc = _header.crc;
+    if (count == 0)
+    {
+        _header.baseSeq = _log.lastSeq() + 1;
+        crc = crc32(&_header, offsetof(StageHeader, count));
+        _firstStagedMs = nowMs;
+    }
+    crc = crc32(&record, sizeof(record), crc);
+
+    // The record is written first and the CRC is the commit point: a reset
+    // before it leaves the area as it was, and one between it and count
+    // is caught by committedCount()
+    _records[count] = record;
+    std::atomic_signal_fence(std::memory_order_release);
+    _header.crc = crc;
+    _header.count = count + 1;
+    _stats.staged++;
+
+    if (_header.count >= _commitRecords || nowMs - _firstStagedMs >= _commitMs)
+    {
+        commitLocked(nowMs);
+    }
+    return true;
+}
+
+bool LogStage::service(uint32_t nowMs)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if (_header.count == 0 || nowMs - _firstStagedMs < _commitMs)
+    {
+        return true;
+    }
+    return commitLocked(nowMs);
+}
+
+bool LogStage::commit(uint32_t nowMs)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return commitLocked(nowMs);
+}
+
+void LogStage::clear()
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    reset();
+}
+
+uint32_t LogStage::pending() const
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return _header.count;
+}
+
+StageStats LogStage::stats() const
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    StageStats stats = _stats;
+    stats.pending = _header.count;
+    return stats;
+}
+
+bool LogStage::commitLocked(uint32_t nowMs)
+{
+    if (_header.count == 0)
+    {
+        return true;
+    }
+
+    uint32_t start = micros32();
+    bool ok = _log.append(_records, _header.count);
+    uint32_t elapsed = micros32() - start;
+    if (!ok)
+    {
+        // Keep the records and wait out another interval before retrying
+        _stats.failures++;
+        _firstStagedMs = nowMs;
+        return false;
+    }
+
+    _stats.commits++;
+    _stats.committed += _header.count;
+    _stats.lastCommitUs = elapsed;
+    if (elapsed > _stats.maxCommitUs)
+    {
+        _stats.maxCommitUs = elapsed;
+    }
+    reset();
+    return true;
+}
+
+void LogStage::reset()
+{
+    memset(&_header, 0, sizeof(_header));
+    _header.magic = STAGE_MAGIC;
+}
+
+uint32_t LogStage::committedCount() const
+{
+    if (_header.magic != STAGE_MAGIC || _header.count > _capacity)
+    {
+        return 0;
+    }
+    uint32_t crc = crc32(&_header, offsetof(StageHeader, count));
+    for (uint32_t i = 0; i < _header.count; i++)
+    {
+        crc = crc32(&_records[i], sizeof(LogRecord), crc);
+    }
+    if (crc == _header.crc)
+    {
+        return _header.count;
+    }
+    // Reset after add() stored the CRC but before it stored the count
+    if (_header.count < _capacity &&
+        crc32(&_records[_header.count], sizeof(LogRecord), crc) == _header.crc)
+    {
+        return _header.count + 1;
+    }
+    return 0;
+}
+
+uint32_t LogStage::micros32()
+{
+#ifdef ARDUINO
+    return micros();
+#else
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+}
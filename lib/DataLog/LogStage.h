@@ -0,0 +1,108 @@
+#pragma once
+
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+#include "DataLog.h"
+
+#define STAGE_MAGIC 0x53544731 // "STG1"; change it when the layout changes
+
+// Bookkeeping of the records waiting in a StageArea
+struct StageHeader
+{
+    uint32_t magic;
+    uint32_t baseSeq; // Sequence number the first staged record will get
+    uint32_t count;
+    uint32_t crc; // Chained over magic, baseSeq and each staged record;
+                  // stored before count, so it may cover one record more
+};
+
+// Records staged in RAM before they are committed to the DataLog. Plain
+// data, so it can live in RTC memory declared RTC_NOINIT_ATTR and survive
+// a watchdog or software reset; anything else there fails the CRC and is
+// ignored.
+template <size_t Capacity>
+struct StageArea
+{
+    StageHeader header;
+    LogRecord records[Capacity];
+};
+
+static_assert(std::is_trivially_default_constructible<StageArea<1>>::value,
+              "StageArea must not have a constructor");
+
+struct StageStats
+{
+    uint32_t pending;
+    uint32_t staged;      // Records added since boot
+    uint32_t commits;
+    uint32_t committed;   // Records those commits wrote
+    uint32_t recovered;   // Records replayed after a reset
+    uint32_t failures;    // Commits the log refused
+    uint32_t lastCommitUs;
+    uint32_t maxCommitUs;
+};
+
+// Write-behind buffer in front of the DataLog. Each append to the log
+// writes the record and then the header, and the header write is a sync,
+// so on SPIFFS every record costs a metadata update and a partial page
+// program. Staged records are instead committed together, in one append
+// that writes them as one or two contiguous runs and then a single header,
+// once enough have gathered or the oldest has waited long enough.
+//
+// The log's header is the commit marker: a batch interrupted by a power
+// loss leaves the previous header valid and the batch is simply not there.
+// At most one batch, commitRecords readings or commitMs of them, is lost.
+//
+// Staged records are not visible to log readers until committed. All
+// methods are safe to call from several tasks.
+class LogStage
+{
+public:
+    template <size_t Capacity>
+    LogStage(DataLog &log, StageArea<Capacity> &area)
+        : LogStage(log, area.header, area.records, Capacity)
+    {
+    }
+
+    // Commit after this many records, or once the oldest is this old
+    void configure(uint32_t commitRecords, uint32_t commitMs);
+
+    // Commit whatever a reset left in the area, unless the log already has
+    // it; otherwise start empty. Call once the log is open.
+    uint32_t recover(uint32_t nowMs);
+
+    // Stage a record, committing first if the area is full and afterwards
+    // if a commit is due. False only if the record could not be kept.
+    bool add(const LogRecord &record, uint32_t nowMs);
+    // Commit if the age limit has passed; for callers with nothing to add
+    bool service(uint32_t nowMs);
+    // Write every staged record now, e.g. before a restart or deep sleep
+    bool commit(uint32_t nowMs);
+    // Drop staged records, along with the log they were meant for
+    void clear();
+
+    uint32_t pending() const;
+    StageStats stats() const;
+
+private:
+    LogStage(DataLog &log, StageHeader &header, LogRecord *records, uint32_t capacity);
+
+    void reset();
+    // Records the CRC vouches for; 0 if the area holds nothing valid
+    uint32_t committedCount() const;
+    bool commitLocked(uint32_t nowMs);
+    static uint32_t micros32();
+
+    DataLog &_log;
+    StageHeader &_header;
+    LogRecord *_records;
+    uint32_t _capacity;
+    uint32_t _commitRecords;
+    uint32_t _commitMs;
+    uint32_t _firstStagedMs; // When the oldest pending record was staged
+    StageStats _stats;
+    mutable std::recursive_mutex _mutex;
+};
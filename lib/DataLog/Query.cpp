@@ -0,0 +1,54 @@
+#include "Query.h"
+
+SeqRange resolveDataQuery(const LogHistory &history, const DataQuery &query)
+{
+    // Seek straight to the range instead of scanning the log. The range is
+    // kept in sequence numbers so it stays put while new records arrive or
+    // move into the archive.
+    uint32_t first = history.firstSeq();
+    uint32_t last = history.lastSeq() + 1;
+    if (query.hasFrom)
+    {
+        first = history.seqLowerBound(query.from);
+    }
+    if (query.hasTo)
+    {
+        last = (query.to == UINT32_MAX) ? last : history.seqLowerBound(query.to + 1);
+    }
+    if (last < first)
+    {
+        last = first;
+    }
+    uint32_t total = last - first;
+
+    if (query.offset < 0)
+    {
+        first = ((uint32_t)-query.offset >= total) ? first : last + query.offset;
+    }
+    else if (query.offset > 0)
+    {
+        first = ((uint32_t)query.offset >= total) ? last : first + query.offset;
+    }
+
+    SeqRange range;
+    range.first = first;
+    range.end = (last - first > query.limit) ? first + query.limit : last;
+    range.total = total;
+    return range;
+}
+
+TimeRange resolveSeriesQuery(const LogHistory &history, const SeriesQuery &query)
+{
+    TimeRange range;
+    range.to = query.hasTo ? query.to : history.newestEpoch();
+    range.from = history.oldestEpoch();
+    if (query.hasFrom)
+    {
+        range.from = query.from;
+    }
+    else if (query.hasSpan)
+    {
+        range.from = (query.span < range.to) ? range.to - query.span : 0;
+    }
+    return range;
+}
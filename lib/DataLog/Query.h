@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "LogHistory.h"
+
+// Parsed parameters of GET /data. from/to are inclusive epoch seconds; a
+// negative offset counts back from the end of the range.
+struct DataQuery
+{
+    bool hasFrom;
+    uint32_t from;
+    bool hasTo;
+    uint32_t to;
+    long offset;
+    uint32_t limit;
+};
+
+// Records [first, end) by sequence number, out of total in the time range
+struct SeqRange
+{
+    uint32_t first;
+    uint32_t end;
+    uint32_t total;
+};
+
+// Ranges cover the archive as well as the log
+SeqRange resolveDataQuery(const LogHistory &history, const DataQuery &query);
+
+// Parsed parameters of GET /series. Without from/to the range ends at the
+// newest record; span sets its length, otherwise the whole history is
+// covered.
+struct SeriesQuery
+{
+    bool hasFrom;
+    uint32_t from;
+    bool hasTo;
+    uint32_t to;
+    bool hasSpan;
+    uint32_t span;
+};
+
+struct TimeRange
+{
+    uint32_t from;
+    uint32_t to;
+};
+
+TimeRange resolveSeriesQuery(const LogHistory &history, const SeriesQuery &query);
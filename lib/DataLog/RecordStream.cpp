@@ -0,0 +1,405 @@
+#include "RecordStream.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "LogFormat.h"
+
+size_t RecordStream::fill(uint8_t *buffer, size_t size)
+{
+    size_t written = 0;
+    while (written < size)
+    {
+        if (_piecePos == _pieceLength)
+        {
+            _pieceLength = 0;
+            _piecePos = 0;
+            if (!next())
+            {
+                break;
+            }
+            continue;
+        }
+
+        size_t n = _pieceLength - _piecePos;
+        if (n > size - written)
+        {
+            n = size - written;
+        }
+        memcpy(buffer + written, _piece + _piecePos, n);
+        _piecePos += n;
+        written += n;
+    }
+    return written;
+}
+
+LogCursor::LogCursor(DataLog &log, uint32_t startSeq, uint32_t endSeq, int channel)
+    : _log(log), _nextSeq(startSeq), _endSeq(endSeq), _channel(channel),
+      _batchSeq(0), _batchLength(0), _batchPos(0)
+{
+}
+
+bool LogCursor::next(LogRecord &record, uint32_t &seq)
+{
+    while (nextAny(record, seq))
+    {
+        if (_channel < 0 || logChannel(record.flags) == _channel)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LogCursor::nextAny(LogRecord &record, uint32_t &seq)
+{
+    if (_batchPos == _batchLength)
+    {
+        if (_nextSeq >= _endSeq)
+        {
+            return false;
+        }
+        uint32_t want = _endSeq - _nextSeq;
+        if (want > BATCH)
+        {
+            want = BATCH;
+        }
+        _batchLength = _log.readSeq(_nextSeq, _batch, want, &_batchSeq);
+        _batchPos = 0;
+        if (_batchLength == 0)
+        {
+            _nextSeq = _endSeq;
+            return false;
+        }
+        _nextSeq = _batchSeq + _batchLength;
+    }
+
+    record = _batch[_batchPos];
+    seq = _batchSeq + _batchPos;
+    _batchPos++;
+    return true;
+}
+
+HistoryCursor::HistoryCursor(const LogHistory &history, uint32_t startSeq, uint32_t endSeq, int channel)
+    : _history(history), _nextSeq(startSeq), _endSeq(endSeq), _channel(channel),
+      _fromArchive(false), _batchSeq(0), _batchLength(0), _batchPos(0)
+{
+}
+
+bool HistoryCursor::next(LogRecord &record, uint32_t &seq)
+{
+    while (nextAny(record, seq))
+    {
+        if (_channel < 0 || logChannel(record.flags) == _channel)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+const ArchiveBlockHeader *HistoryCursor::block() const
+{
+    return (_fromArchive && _archiveCursor) ? &_archiveCursor->block() : nullptr;
+}
+
+bool HistoryCursor::nextAny(LogRecord &record, uint32_t &seq)
+{
+    for (;;)
+    {
+        if (_batchPos < _batchLength)
+        {
+            record = _batch[_batchPos];
+            seq = _batchSeq + _batchPos;
+            _batchPos++;
+            _fromArchive = false;
+            return true;
+        }
+        if (_nextSeq >= _endSeq)
+        {
+            return false;
+        }
+        if (nextArchived(record, seq))
+        {
+            _fromArchive = true;
+            return true;
+        }
+        if (_nextSeq >= _endSeq)
+        {
+            return false;
+        }
+
+        uint32_t want = _endSeq - _nextSeq;
+        if (want > BATCH)
+        {
+            want = BATCH;
+        }
+        _batchLength = _history.log().readSeq(_nextSeq, _batch, want, &_batchSeq);
+        _batchPos = 0;
+        if (_batchLength == 0)
+        {
+            _nextSeq = _endSeq;
+            return false;
+        }
+        _nextSeq = _batchSeq + _batchLength;
+    }
+}
+
+bool HistoryCursor::nextArchived(LogRecord &record, uint32_t &seq)
+{
+    LogArchive *archive = _history.archive();
+    uint32_t live = _history.liveStart();
+    if (!archive || _nextSeq >= live)
+    {
+        _archiveCursor.reset();
+        return false;
+    }
+
+    for (;;)
+    {
+        bool fresh = !_archiveCursor;
+        if (fresh)
+        {
+            _archiveCursor.reset(new ArchiveCursor(*archive, archive->blockForSeq(_nextSeq)));
+        }
+        while (_archiveCursor->next(record, seq))
+        {
+            if (seq < _nextSeq)
+            {
+                continue; // Earlier in the block the cursor started at
+            }
+            if (seq >= _endSeq)
+            {
+                _nextSeq = _endSeq;
+                _archiveCursor.reset();
+                return false;
+            }
+            _nextSeq = seq + 1;
+            return true;
+        }
+        _archiveCursor.reset();
+        if (fresh)
+        {
+            // Nothing readable is left below the log; carry on there
+            _nextSeq = live;
+            return false;
+        }
+        // Blocks were added since the cursor started; look again
+    }
+}
+
+CsvRecordStream::CsvRecordStream(const LogHistory &history, uint32_t startSeq, uint32_t endSeq,
+                                 const StationTable &stations, int channel)
+    : _cursor(history, startSeq, endSeq, channel), _stations(stations), _headerSent(false)
+{
+}
+
+bool CsvRecordStream::next()
+{
+    if (!_headerSent)
+    {
+        _pieceLength = snprintf(_piece, sizeof(_piece), "%s\n", CSV_HEADER);
+        _headerSent = true;
+        return true;
+    }
+
+    LogRecord record;
+    uint32_t seq;
+    if (!_cursor.next(record, seq))
+    {
+        return false;
+    }
+    uint8_t channel = logChannel(record.flags);
+    const ArchiveBlockHeader *block = _cursor.block();
+    if (block)
+    {
+        const ArchiveStation &station = block->stations[channel];
+        _pieceLength = formatCsvRow(_piece, sizeof(_piece), station.id, station.name, record);
+    }
+    else
+    {
+        _pieceLength = formatCsvRow(_piece, sizeof(_piece), _stations.ids[channel],
+                                    _stations.names[channel], record);
+    }
+    return true;
+}
+
+static uint32_t sinceEnd(DataLog &log, uint32_t start, uint32_t limit)
+{
+    uint32_t end = log.lastSeq() + 1;
+    return (end - start > limit) ? start + limit : end;
+}
+
+SinceRecordStream::SinceRecordStream(DataLog &log, uint32_t since, uint32_t limit, int channel)
+    : _since(since),
+      _reset(since > log.lastSeq()),
+      _gap(!_reset && since + 1 < log.firstSeq()),
+      _startSeq(_reset ? 0 : (_gap ? log.firstSeq() : since + 1)),
+      _endSeq(_reset ? 0 : sinceEnd(log, _startSeq, limit)),
+      _cursor(log, _startSeq, _endSeq, channel),
+      _state(0), _first(true)
+{
+}
+
+bool SinceRecordStream::next()
+{
+    if (_state == 0)
+    {
+        uint32_t cursor = (_endSeq > _startSeq) ? _endSeq - 1 : _since;
+        _pieceLength = snprintf(_piece, sizeof(_piece),
+                                "{\"seq\":%lu,\"gap\":%s,\"reset\":%s,\"records\":[",
+                                (unsigned long)cursor, _gap ? "true" : "false", _reset ? "true" : "false");
+        _state = 1;
+        return true;
+    }
+    if (_state == 2)
+    {
+        return false;
+    }
+
+    LogRecord record;
+    uint32_t seq;
+    if (!_cursor.next(record, seq))
+    {
+        _pieceLength = snprintf(_piece, sizeof(_piece), "]}");
+        _state = 2;
+        return true;
+    }
+
+    char blok[12], parit[12], raw[12];
+    formatLevel(blok, sizeof(blok), record.levelBlok);
+    formatLevel(parit, sizeof(parit), record.levelParit);
+    formatLevel(raw, sizeof(raw), record.rawDistance);
+    _pieceLength = snprintf(_piece, sizeof(_piece), "%s[%lu,%lu,%s,%s,%s]",
+                            _first ? "" : ",", (unsigned long)seq, (unsigned long)record.epoch,
+                            blok, parit, raw);
+    _first = false;
+    return true;
+}
+
+static const char *fieldName(SeriesField field)
+{
+    switch (field)
+    {
+    case SERIES_PARIT:
+        return "parit";
+    case SERIES_RAW:
+        return "raw";
+    default:
+        return "blok";
+    }
+}
+
+SeriesRecordStream::SeriesRecordStream(const LogHistory &history, uint32_t from, uint32_t to,
+                                       uint32_t points, SeriesField field, int channel)
+    : _history(history),
+      _downsampler(from, to, points, field, onBucket, this),
+      _cursor(history, history.seqLowerBound(from),
+              to == UINT32_MAX ? history.lastSeq() + 1 : history.seqLowerBound(to + 1), channel),
+      _from(from), _to(to), _field(field), _state(0), _first(true)
+{
+}
+
+void SeriesRecordStream::onBucket(const SeriesBucket &bucket, void *context)
+{
+    SeriesRecordStream *self = (SeriesRecordStream *)context;
+    char minText[12], maxText[12], meanText[12];
+    formatLevel(minText, sizeof(minText), bucket.min);
+    formatLevel(maxText, sizeof(maxText), bucket.max);
+    formatLevel(meanText, sizeof(meanText), bucket.mean);
+    self->_pieceLength = snprintf(self->_piece, sizeof(self->_piece), "%s[%lu,%lu,%s,%s,%s]",
+                                  self->_first ? "" : ",", (unsigned long)bucket.start,
+                                  (unsigned long)bucket.count, minText, maxText, meanText);
+    self->_first = false;
+}
+
+bool SeriesRecordStream::next()
+{
+    switch (_state)
+    {
+    case 0:
+        _pieceLength = snprintf(_piece, sizeof(_piece),
+                                "{\"field\":\"%s\",\"from\":%lu,\"to\":%lu,\"bucketSeconds\":%lu,\"seq\":%lu,\"points\":[",
+                                fieldName(_field), (unsigned long)_from, (unsigned long)_to,
+                                (unsigned long)_downsampler.bucketSeconds(), (unsigned long)_history.lastSeq());
+        _state = 1;
+        return true;
+
+    case 1:
+    {
+        // Feed records until the downsampler completes a bucket
+        LogRecord record;
+        uint32_t seq;
+        while (_pieceLength == 0 && _cursor.next(record, seq))
+        {
+            _downsampler.add(record);
+        }
+        if (_pieceLength == 0)
+        {
+            _downsampler.finish();
+            _state = 2;
+        }
+        if (_pieceLength > 0)
+        {
+            return true;
+        }
+    }
+    // fall through
+    case 2:
+        _pieceLength = snprintf(_piece, sizeof(_piece), "]}");
+        _state = 3;
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+BulkRecordStream::BulkRecordStream(const LogHistory &history, uint32_t startSeq, uint32_t endSeq,
+                                   const StationTable &stations)
+    : _cursor(history, startSeq, endSeq), _stations(stations), _state(0), _first(true)
+{
+}
+
+bool BulkRecordStream::next()
+{
+    if (_state == 0)
+    {
+        _pieceLength = snprintf(_piece, sizeof(_piece), "{\"data\":[");
+        _state = 1;
+        return true;
+    }
+    if (_state == 2)
+    {
+        return false;
+    }
+
+    LogRecord record;
+    uint32_t seq;
+    if (!_cursor.next(record, seq))
+    {
+        _pieceLength = snprintf(_piece, sizeof(_piece), "]}");
+        _state = 2;
+        return true;
+    }
+
+    // Archived records go up under the station they were archived with,
+    // as in CsvRecordStream
+    uint8_t channel = logChannel(record.flags);
+    const ArchiveBlockHeader *block = _cursor.block();
+    int stationId = block ? block->stations[channel].id : _stations.ids[channel];
+    char stationName[96];
+    char dateTime[24];
+    char blok[12], parit[12], raw[12];
+    escapeJson(stationName, sizeof(stationName), block ? block->stations[channel].name : _stations.names[channel]);
+    formatDateTime(dateTime, sizeof(dateTime), record.epoch);
+    formatLevel(blok, sizeof(blok), record.levelBlok);
+    formatLevel(parit, sizeof(parit), record.levelParit);
+    formatLevel(raw, sizeof(raw), record.rawDistance);
+    _pieceLength = snprintf(_piece, sizeof(_piece),
+                            "%s{\"station_name\":\"%s\",\"idwl\":%d,\"datetime\":\"%s\","
+                            "\"level_blok\":%s,\"level_parit\":%s,\"sensor_distance\":%s}",
+                            _first ? "" : ",", stationName, stationId, dateTime, blok, parit, raw);
+    _first = false;
+    return true;
+}
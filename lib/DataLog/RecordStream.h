@@ -0,0 +1,175 @@
+#pragma once
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "DataLog.h"
+#include "Downsample.h"
+#include "LogArchive.h"
+#include "LogFormat.h"
+#include "LogHistory.h"
+
+// Pull-based body for chunked HTTP responses. The server calls fill() each
+// time the socket can take more data; it copies as much of the body as fits
+// and returns 0 once the body is complete. Only one formatted piece (a row,
+// a bucket) is held at a time, so memory use is constant.
+class RecordStream
+{
+public:
+    RecordStream() : _pieceLength(0), _piecePos(0) {}
+    virtual ~RecordStream() {}
+
+    size_t fill(uint8_t *buffer, size_t size);
+
+protected:
+    // Format the next piece of the body into _piece; false when finished
+    virtual bool next() = 0;
+
+    char _piece[256];
+    size_t _pieceLength;
+
+private:
+    size_t _piecePos;
+};
+
+// Reads records between two sequence numbers in small batches, either all
+// of them or those of one channel
+class LogCursor
+{
+public:
+    LogCursor(DataLog &log, uint32_t startSeq, uint32_t endSeq, int channel = -1);
+
+    // Next record, or false once endSeq is reached
+    bool next(LogRecord &record, uint32_t &seq);
+
+private:
+    static const uint32_t BATCH = 16;
+
+    bool nextAny(LogRecord &record, uint32_t &seq);
+
+    DataLog &_log;
+    uint32_t _nextSeq;
+    uint32_t _endSeq; // Exclusive
+    int _channel;     // Negative for every channel
+    LogRecord _batch[BATCH];
+    uint32_t _batchSeq;
+    uint32_t _batchLength;
+    uint32_t _batchPos;
+};
+
+// Like LogCursor, over a LogHistory: archived sequence numbers are decoded
+// from their blocks, the rest read from the log. Which side a sequence
+// number comes from is decided as the cursor reaches it, so records that
+// move into the archive meanwhile are still found.
+class HistoryCursor
+{
+public:
+    HistoryCursor(const LogHistory &history, uint32_t startSeq, uint32_t endSeq, int channel = -1);
+
+    bool next(LogRecord &record, uint32_t &seq);
+    // Header of the archive block the last record came from; null if it
+    // came from the log
+    const ArchiveBlockHeader *block() const;
+
+private:
+    static const uint32_t BATCH = 16;
+
+    bool nextAny(LogRecord &record, uint32_t &seq);
+    bool nextArchived(LogRecord &record, uint32_t &seq);
+
+    LogHistory _history;
+    uint32_t _nextSeq;
+    uint32_t _endSeq; // Exclusive
+    int _channel;     // Negative for every channel
+    // Allocated only while archived records are read, so a cursor over
+    // recent records, like every live upload, stays small
+    std::unique_ptr<ArchiveCursor> _archiveCursor;
+    bool _fromArchive;
+    LogRecord _batch[BATCH];
+    uint32_t _batchSeq;
+    uint32_t _batchLength;
+    uint32_t _batchPos;
+};
+
+// CSV export in the /getData column layout; each row names the station of
+// its channel, and channel 0 rows from the archive the station their block
+// was recorded at. A negative channel exports every channel.
+class CsvRecordStream : public RecordStream
+{
+public:
+    CsvRecordStream(const LogHistory &history, uint32_t startSeq, uint32_t endSeq,
+                    const StationTable &stations, int channel = -1);
+
+protected:
+    bool next() override;
+
+private:
+    HistoryCursor _cursor;
+    StationTable _stations;
+    bool _headerSent;
+};
+
+// JSON body of /data/since: {"seq":..,"gap":..,"reset":..,"records":[[seq,epoch,blok,parit,raw],..]}
+// The limit counts sequence numbers, so with a channel set fewer records
+// may come back; "seq" still covers the ones skipped.
+class SinceRecordStream : public RecordStream
+{
+public:
+    SinceRecordStream(DataLog &log, uint32_t since, uint32_t limit, int channel = -1);
+
+protected:
+    bool next() override;
+
+private:
+    uint32_t _since;
+    bool _reset; // since is ahead of the log, which was reformatted
+    bool _gap;   // Records after since were already overwritten
+    uint32_t _startSeq;
+    uint32_t _endSeq;
+    LogCursor _cursor;
+    int _state; // 0 = header, 1 = records, 2 = done
+    bool _first;
+};
+
+// JSON body of /series: {"field":..,"from":..,"to":..,"bucketSeconds":..,"seq":..,"points":[[start,count,min,max,mean],..]}
+class SeriesRecordStream : public RecordStream
+{
+public:
+    SeriesRecordStream(const LogHistory &history, uint32_t from, uint32_t to, uint32_t points,
+                       SeriesField field, int channel = -1);
+
+protected:
+    bool next() override;
+
+private:
+    static void onBucket(const SeriesBucket &bucket, void *context);
+
+    LogHistory _history;
+    Downsampler _downsampler;
+    HistoryCursor _cursor;
+    uint32_t _from;
+    uint32_t _to;
+    SeriesField _field;
+    int _state; // 0 = header, 1 = buckets, 2 = footer, 3 = done
+    bool _first;
+};
+
+// JSON body of a bulk upload to the station API, each record under the
+// station of its channel:
+// {"data":[{"station_name":..,"idwl":..,"datetime":..,"level_blok":..,"level_parit":..,"sensor_distance":..},..]}
+class BulkRecordStream : public RecordStream
+{
+public:
+    BulkRecordStream(const LogHistory &history, uint32_t startSeq, uint32_t endSeq,
+                     const StationTable &stations);
+
+protected:
+    bool next() override;
+
+private:
+    HistoryCursor _cursor;
+    StationTable _stations;
+    int _state; // 0 = header, 1 = records, 2 = done
+    bool _first;
+};
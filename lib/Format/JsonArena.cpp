@@ -0,0 +1,106 @@
+#include "JsonArena.h"
+
+#include <atomic>
+#include <stdlib.h>
+#include <string.h>
+
+static std::atomic<uint32_t> heapFallbacks(0);
+
+JsonArena::JsonArena(void *buffer, size_t size)
+    : _buffer((uint8_t *)buffer), _size(size), _used(0), _lastOffset(size)
+{
+}
+
+uint32_t JsonArena::fallbacks()
+{
+    return heapFallbacks.load(std::memory_order_relaxed);
+}
+
+bool JsonArena::isLast(const Block *block) const
+{
+    return (const uint8_t *)block == _buffer + _lastOffset;
+}
+
+void *JsonArena::allocate(size_t size)
+{
+    size_t total = sizeof(Block) + roundUp(size);
+    if (total <= _size - _used)
+    {
+        Block *block = (Block *)(_buffer + _used);
+        block->size = size;
+        block->heap = 0;
+        _lastOffset = _used;
+        _used += total;
+        return block + 1;
+    }
+
+    Block *block = (Block *)malloc(sizeof(Block) + size);
+    if (!block)
+    {
+        return nullptr;
+    }
+    block->size = size;
+    block->heap = 1;
+    heapFallbacks.fetch_add(1, std::memory_order_relaxed);
+    return block + 1;
+}
+
+void JsonArena::deallocate(void *pointer)
+{
+    if (!pointer)
+    {
+        return;
+    }
+    Block *block = blockOf(pointer);
+    if (block->heap)
+    {
+        free(block);
+    }
+    else if (isLast(block))
+    {
+        // Only the top of the arena can be given back
+        _used = _lastOffset;
+        _lastOffset = _size;
+    }
+}
+
+void *JsonArena::reallocate(void *pointer, size_t newSize)
+{
+    if (!pointer)
+    {
+        return allocate(newSize);
+    }
+
+    Block *block = blockOf(pointer);
+    if (block->heap)
+    {
+        Block *moved = (Block *)realloc(block, sizeof(Block) + newSize);
+        if (!moved)
+        {
+            return nullptr;
+        }
+        moved->size = newSize;
+        return moved + 1;
+    }
+
+    if (isLast(block) && sizeof(Block) + roundUp(newSize) <= _size - _lastOffset)
+    {
+        // Grow or shrink the top block in place
+        block->size = newSize;
+        _used = _lastOffset + sizeof(Block) + roundUp(newSize);
+        return pointer;
+    }
+    if (newSize <= block->size)
+    {
+        block->size = newSize;
+        return pointer;
+    }
+
+    void *copy = allocate(newSize);
+    if (copy)
+    {
+        memcpy(copy, pointer, block->size);
+        deallocate(pointer);
+    }
+    return copy;
+}
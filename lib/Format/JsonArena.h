@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ArduinoJson.h>
+
+// Bump allocator for one JsonDocument, over a buffer owned by the caller
+// (usually on the stack of the handler building the document):
+//
+//     JsonArenaBuffer<1024> arena;
+//     JsonDocument doc(&arena);
+//
+// Memory is handed out from the front of the buffer and only the most
+// recent block can be freed or resized in place; everything is released at
+// once when the arena goes out of scope. A document that outgrows the
+// buffer continues on the heap rather than failing, and fallbacks() counts
+// how often that happened so the buffer sizes can be checked in the field.
+class JsonArena : public ArduinoJson::Allocator
+{
+public:
+    JsonArena(void *buffer, size_t size);
+
+    void *allocate(size_t size) override;
+    void deallocate(void *pointer) override;
+    void *reallocate(void *pointer, size_t newSize) override;
+
+    size_t used() const { return _used; }
+
+    // Allocations of all arenas that went to the heap since boot
+    static uint32_t fallbacks();
+
+private:
+    struct Block
+    {
+        uint32_t size;
+        uint32_t heap; // Nonzero if the block came from malloc()
+    };
+
+    Block *blockOf(void *pointer) const { return (Block *)pointer - 1; }
+    bool isLast(const Block *block) const;
+    static size_t roundUp(size_t size) { return (size + 7) & ~(size_t)7; }
+
+    uint8_t *_buffer;
+    size_t _size;
+    size_t _used;
+    size_t _lastOffset; // Start of the most recent arena block, or _size if none
+};
+
+template <size_t Size>
+class JsonArenaBuffer : public JsonArena
+{
+public:
+    JsonArenaBuffer() : JsonArena(_storage, Size) {}
+
+private:
+    alignas(8) uint8_t _storage[Size];
+};
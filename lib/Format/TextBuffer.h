@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+// Fixed-capacity string built in place, for log lines and small responses
+// that used to be assembled from String temporaries. Lives on the stack or
+// in a static, so building a line never touches the heap. Text that does
+// not fit is cut off; the buffer is always terminated.
+template <size_t Capacity>
+class TextBuffer
+{
+    static_assert(Capacity >= 2, "TextBuffer needs room for text");
+
+public:
+    TextBuffer() : _length(0), _truncated(false) { _text[0] = '\0'; }
+
+    TextBuffer &append(const char *text)
+    {
+        size_t n = strlen(text);
+        if (n > Capacity - 1 - _length)
+        {
+            n = Capacity - 1 - _length;
+            _truncated = true;
+        }
+        memcpy(_text + _length, text, n);
+        _length += n;
+        _text[_length] = '\0';
+        return *this;
+    }
+
+    TextBuffer &append(char c)
+    {
+        char text[2] = {c, '\0'};
+        return append(text);
+    }
+
+    TextBuffer &appendf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(_text + _length, Capacity - _length, format, args);
+        va_end(args);
+        if (n < 0)
+        {
+            _text[_length] = '\0';
+            return *this;
+        }
+        if ((size_t)n >= Capacity - _length)
+        {
+            _length = Capacity - 1;
+            _truncated = true;
+        }
+        else
+        {
+            _length += n;
+        }
+        return *this;
+    }
+
+    void clear()
+    {
+        _length = 0;
+        _truncated = false;
+        _text[0] = '\0';
+    }
+
+    const char *c_str() const { return _text; }
+    size_t length() const { return _length; }
+    bool truncated() const { return _truncated; }
+
+private:
+    char _text[Capacity];
+    size_t _length;
+    bool _truncated;
+};
@@ -0,0 +1,39 @@
+#include "A01nyubParser.h"
+
+#include <string.h>
+
+bool A01nyubParser::feed(uint8_t byte, uint16_t &mm)
+{
+    if (_length == 0 && byte != HEADER)
+    {
+        _skippedBytes++;
+        return false;
+    }
+    _frame[_length++] = byte;
+    if (_length < FRAME_SIZE)
+    {
+        return false;
+    }
+
+    uint8_t sum = (uint8_t)(_frame[0] + _frame[1] + _frame[2]);
+    if (sum == _frame[3])
+    {
+        _length = 0;
+        _frames++;
+        mm = (uint16_t)((_frame[1] << 8) | _frame[2]);
+        return true;
+    }
+
+    // Keep whatever follows the next header candidate; none of it can be a
+    // whole frame yet
+    _checksumErrors++;
+    size_t next = 1;
+    while (next < FRAME_SIZE && _frame[next] != HEADER)
+    {
+        next++;
+    }
+    _skippedBytes += next;
+    _length = (uint8_t)(FRAME_SIZE - next);
+    memmove(_frame, _frame + next, _length);
+    return false;
+}
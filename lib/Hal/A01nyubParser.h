@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Frame sync for the A01NYUB's output: 0xFF, the distance in mm high byte
+// first, then the low byte of the sum of the other three. Bytes are fed
+// one at a time as they arrive, so a frame may be split across any number
+// of reads. Until a header byte comes along everything is skipped; a frame
+// whose checksum does not match is dropped and the search for the next
+// header resumes inside it, since a distance or checksum byte of 0xFF may
+// have been taken for the header.
+class A01nyubParser
+{
+public:
+    static const uint8_t HEADER = 0xFF;
+    static const size_t FRAME_SIZE = 4;
+
+    A01nyubParser() : _length(0), _frames(0), _checksumErrors(0), _skippedBytes(0) {}
+
+    // True once byte completes a valid frame, whose distance is then in mm
+    bool feed(uint8_t byte, uint16_t &mm);
+    // Forget a partial frame, e.g. after the UART was reopened
+    void reset() { _length = 0; }
+
+    uint32_t frames() const { return _frames; }
+    uint32_t checksumErrors() const { return _checksumErrors; }
+    // Bytes that were not part of a valid frame
+    uint32_t skippedBytes() const { return _skippedBytes; }
+
+private:
+    uint8_t _frame[FRAME_SIZE];
+    uint8_t _length;
+    uint32_t _frames;
+    uint32_t _checksumErrors;
+    uint32_t _skippedBytes;
+};
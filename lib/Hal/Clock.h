@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+
+// Wall-clock and monotonic time
+class Clock
+{
+public:
+    virtual ~Clock() {}
+
+    // Unix epoch seconds, or 0 when no valid time is available
+    virtual uint32_t epoch() = 0;
+    // Milliseconds since start; wraps like Arduino millis()
+    virtual uint32_t millis() = 0;
+    // Let ms pass; other tasks run meanwhile
+    virtual void wait(uint32_t ms) = 0;
+};
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <RTClib.h>
+
+// DS3231 over I2C. Callers serialize access when the bus is shared.
+class RtcClock : public Clock
+{
+public:
+    explicit RtcClock(RTC_DS3231 &rtc) : _rtc(rtc) {}
+
+    uint32_t epoch() override
+    {
+        DateTime now = _rtc.now();
+        if (now.year() < 2020 || now.year() > 2030)
+        {
+            return 0;
+        }
+        return now.unixtime();
+    }
+
+    uint32_t millis() override { return ::millis(); }
+    void wait(uint32_t ms) override { ::delay(ms); }
+
+private:
+    RTC_DS3231 &_rtc;
+};
+
+#else
+
+// Simulated time that only moves when told to, so host runs are repeatable
+class SimClock : public Clock
+{
+public:
+    explicit SimClock(uint32_t startEpoch) : _startEpoch(startEpoch), _ms(0) {}
+
+    uint32_t epoch() override { return _startEpoch + (uint32_t)(_ms / 1000); }
+    uint32_t millis() override { return (uint32_t)_ms; }
+    void wait(uint32_t ms) override { _ms += ms; }
+
+    void advance(uint64_t ms) { _ms += ms; }
+
+private:
+    uint32_t _startEpoch;
+    uint64_t _ms;
+};
+
+#endif
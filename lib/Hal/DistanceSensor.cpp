@@ -0,0 +1,294 @@
+#include "DistanceSensor.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+#define ECHO_TIMEOUT_US 30000 // Beyond the HC-SR04's 4 m range
+#define A01_FRAME_TIMEOUT_MS 350   // Longest gap between A01NYUB frames, with margin
+#define A01_FRAME_MAX_AGE_MS 2000  // Older frames no longer count as a sample
+#define A01_RX_BUFFER 256
+
+// Host sensors are simulated and need no real time to pass
+static void pause(uint32_t ms)
+{
+#ifdef ARDUINO
+    if (ms > 0)
+    {
+        delay(ms);
+    }
+#else
+    (void)ms;
+#endif
+}
+
+// Wait up to ms for a triggered sensor, less if it reports its result early
+static void waitForResult(DistanceSensor &sensor, uint32_t ms)
+{
+#ifdef ARDUINO
+    uint32_t poll = sensor.pollMs();
+    if (poll == 0)
+    {
+        pause(ms);
+        return;
+    }
+    uint32_t start = millis();
+    while (millis() - start < ms && !sensor.resultReady())
+    {
+        delay(poll);
+    }
+#else
+    (void)sensor;
+    (void)ms;
+#endif
+}
+
+FilteredReading DistanceSensor::read(SampleFilter &filter)
+{
+    filter.reset();
+    begin();
+    while (!filter.full() && !filter.settled())
+    {
+        waitForResult(*this, trigger());
+        float cm;
+        if (collect(cm))
+        {
+            filter.add(cm);
+        }
+        else
+        {
+            filter.addFailure();
+        }
+        pause(recoveryMs());
+    }
+    end();
+    return filter.result();
+}
+
+#ifdef ARDUINO
+
+// The pins may have been left as inputs while another sensor type was set
+void HcSr04Sensor::begin()
+{
+    pinMode(_triggerPin, OUTPUT);
+    pinMode(_echoPin, INPUT);
+    digitalWrite(_triggerPin, LOW);
+    _edges = 2; // Nothing to time until the first trigger
+    attachInterruptArg(digitalPinToInterrupt(_echoPin), onEcho, this, CHANGE);
+}
+
+void HcSr04Sensor::end()
+{
+    detachInterrupt(digitalPinToInterrupt(_echoPin));
+}
+
+// The echo line idles low, so the first two edges after a trigger are the
+// start and the end of the echo pulse
+void IRAM_ATTR HcSr04Sensor::onEcho(void *arg)
+{
+    HcSr04Sensor *self = (HcSr04Sensor *)arg;
+    uint32_t now = micros();
+    if (self->_edges == 0)
+    {
+        self->_riseUs = now;
+        self->_edges = 1;
+    }
+    else if (self->_edges == 1)
+    {
+        self->_fallUs = now;
+        self->_edges = 2;
+    }
+}
+
+uint32_t HcSr04Sensor::trigger()
+{
+    _edges = 0;
+    digitalWrite(_triggerPin, HIGH);
+    delayMicroseconds(10);
+    digitalWrite(_triggerPin, LOW);
+    return ECHO_TIMEOUT_US / 1000;
+}
+
+bool HcSr04Sensor::collect(float &cm)
+{
+    if (_edges < 2)
+    {
+        // No echo, or it is still going past the timeout; ignore the rest
+        // of it until the next trigger
+        _edges = 2;
+        return false;
+    }
+    uint32_t duration = _fallUs - _riseUs;
+    if (duration == 0 || duration > ECHO_TIMEOUT_US)
+    {
+        return false;
+    }
+    cm = duration * 0.034 / 2;
+    return true;
+}
+
+// The sensor's RX sees the UART's idle-high TX line and streams on its own
+void A01nyubSensor::begin()
+{
+    if (_open)
+    {
+        return;
+    }
+    _serial.setRxBufferSize(A01_RX_BUFFER);
+    _serial.onReceive([this]() { receive(); });
+    _serial.begin(9600, SERIAL_8N1, _rxPin, _txPin);
+    _open = true;
+}
+
+void A01nyubSensor::close()
+{
+    if (!_open)
+    {
+        return;
+    }
+    _serial.onReceive(nullptr);
+    _serial.end();
+    _open = false;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _parser.reset();
+    _read = _written;
+}
+
+// Runs in the UART event task whenever bytes arrive or the line goes idle
+void A01nyubSensor::receive()
+{
+    uint16_t mm;
+    while (_serial.available() > 0)
+    {
+        if (!_parser.feed((uint8_t)_serial.read(), mm))
+        {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        Frame &frame = _window[_written % WINDOW];
+        frame.mm = mm;
+        frame.atMs = millis();
+        _written++;
+        if (_written - _read > WINDOW)
+        {
+            _read = _written - WINDOW; // Overwrote the oldest unread frame
+        }
+    }
+}
+
+void A01nyubSensor::dropStale(uint32_t nowMs)
+{
+    while (_read != _written && nowMs - _window[_read % WINDOW].atMs > A01_FRAME_MAX_AGE_MS)
+    {
+        _read++;
+    }
+}
+
+// Nothing to send; wait for the next frame unless one is already in
+uint32_t A01nyubSensor::trigger()
+{
+    return resultReady() ? 0 : A01_FRAME_TIMEOUT_MS;
+}
+
+bool A01nyubSensor::resultReady()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    dropStale(millis());
+    return _read != _written;
+}
+
+bool A01nyubSensor::collect(float &cm)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    dropStale(millis());
+    if (_read == _written)
+    {
+        return false;
+    }
+    uint16_t distance = _window[_read % WINDOW].mm;
+    _read++;
+
+    if (distance > 0 && distance < 7500)
+    {
+        cm = distance / 10.0;
+        return true;
+    }
+    return false;
+}
+
+#else
+
+#include <math.h>
+
+#define FLOOD_START_S (14 * 3600)
+#define FLOOD_RISE_S (20 * 60)
+#define FLOOD_FALL_S (4 * 3600)
+
+SimSensor::SimSensor(Clock &clock, uint32_t seed, float meanCm, float amplitudeCm, float noiseCm,
+                     float failureRate, float outlierRate, float floodCm)
+    : _clock(clock), _state(seed ? seed : 1), _samples(0), _surfaceCm(meanCm), _meanCm(meanCm),
+      _amplitudeCm(amplitudeCm), _noiseCm(noiseCm), _failureRate(failureRate),
+      _outlierRate(outlierRate), _floodCm(floodCm), _latencyMs(0), _recoveryMs(0)
+{
+}
+
+void SimSensor::setTiming(uint32_t latencyMs, uint32_t recoveryMs)
+{
+    _latencyMs = latencyMs;
+    _recoveryMs = recoveryMs;
+}
+
+// xorshift32, so runs are identical on every host
+float SimSensor::random01()
+{
+    _state ^= _state << 13;
+    _state ^= _state >> 17;
+    _state ^= _state << 5;
+    return (_state >> 8) / 16777216.0f;
+}
+
+float SimSensor::floodAt(uint32_t secondOfDay) const
+{
+    if (secondOfDay < FLOOD_START_S)
+    {
+        return 0;
+    }
+    uint32_t t = secondOfDay - FLOOD_START_S;
+    if (t < FLOOD_RISE_S)
+    {
+        return _floodCm * t / FLOOD_RISE_S;
+    }
+    t -= FLOOD_RISE_S;
+    return t < FLOOD_FALL_S ? _floodCm * (1.0f - (float)t / FLOOD_FALL_S) : 0;
+}
+
+// The surface holds still for the few seconds a measurement takes
+void SimSensor::begin()
+{
+    uint32_t secondOfDay = _clock.epoch() % 86400;
+    float phase = 2.0f * (float)M_PI * (secondOfDay % 43200) / 43200.0f;
+    // Distance to the surface shrinks as the water rises
+    _surfaceCm = _meanCm + _amplitudeCm * sinf(phase) - floodAt(secondOfDay);
+}
+
+bool SimSensor::collect(float &cm)
+{
+    _samples++;
+    if (random01() < _failureRate)
+    {
+        return false;
+    }
+
+    if (random01() < _outlierRate)
+    {
+        // Echo from somewhere between the sensor and the surface
+        cm = _surfaceCm * random01();
+        return true;
+    }
+    float noise = (random01() * 2.0f - 1.0f) * _noiseCm;
+    cm = _surfaceCm + noise;
+    return true;
+}
+
+#endif
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <SampleFilter.h>
+
+// Ultrasonic distance sensor. Drivers split a ping into trigger() and
+// collect(), so an InterleavedSampler can wait on several sensors at once;
+// read() runs a whole measurement of this sensor alone and blocks until it
+// is done.
+class DistanceSensor
+{
+public:
+    virtual ~DistanceSensor() {}
+
+    // Take up to the filter's maxSamples samples, stopping early once they
+    // settle, and combine them
+    FilteredReading read(SampleFilter &filter);
+
+    // Power up or open the sensor before a burst of samples, and release it
+    // afterwards
+    virtual void begin() {}
+    virtual void end() {}
+
+    // Start a ping. Returns the ms to wait before collect() has its result.
+    virtual uint32_t trigger() = 0;
+    // True once collect() has its result, ahead of the time trigger()
+    // asked for. Drivers that cannot tell earlier return false and set no
+    // pollMs().
+    virtual bool resultReady() { return false; }
+    // How often to ask resultReady() while waiting; 0 to just wait
+    virtual uint32_t pollMs() const { return 0; }
+    // Raw distance in cm of the last trigger(); false if there was no
+    // valid echo
+    virtual bool collect(float &cm) = 0;
+    // Ms to leave after collect() before the next trigger()
+    virtual uint32_t recoveryMs() const { return 0; }
+};
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <mutex>
+
+#include "A01nyubParser.h"
+
+// HC-SR04: trigger pulse, echo pulse width. A GPIO interrupt timestamps
+// the echo's edges, so nothing busy-waits for the echo and other interrupts
+// cannot stretch the pulse being timed; what is left is the ISR's entry
+// latency of a few microseconds, under a millimetre.
+class HcSr04Sensor : public DistanceSensor
+{
+public:
+    HcSr04Sensor(int triggerPin, int echoPin)
+        : _triggerPin(triggerPin), _echoPin(echoPin), _riseUs(0), _fallUs(0), _edges(0) {}
+
+    void begin() override;
+    void end() override;
+    uint32_t trigger() override;
+    bool resultReady() override { return _edges >= 2; }
+    uint32_t pollMs() const override { return 1; }
+    bool collect(float &cm) override;
+    // Let the last echo die down before the next trigger
+    uint32_t recoveryMs() const override { return 50; }
+
+private:
+    static void IRAM_ATTR onEcho(void *arg);
+
+    int _triggerPin;
+    int _echoPin;
+    // Written by onEcho()
+    volatile uint32_t _riseUs;
+    volatile uint32_t _fallUs;
+    volatile uint8_t _edges; // Since the last trigger
+};
+
+// DFRobot A01NYUB: UART, 4-byte frames. Each unit needs its own UART.
+//
+// With its RX line idling high the sensor sends a processed reading every
+// 100-300 ms by itself, so the UART stays open from the first begin() and
+// the core's UART event task hands each burst of bytes to a parser. Valid
+// frames go into a small window, and collect() takes them from there: a
+// measurement starts from the frames that came in over the last seconds
+// and only waits for more if it needs them.
+class A01nyubSensor : public DistanceSensor
+{
+public:
+    static const uint8_t WINDOW = 16; // A power of two, so the counters may wrap
+
+    A01nyubSensor(HardwareSerial &serial, int rxPin, int txPin)
+        : _serial(serial), _rxPin(rxPin), _txPin(txPin), _open(false), _written(0), _read(0) {}
+
+    // Opens the UART the first time; end() leaves it open
+    void begin() override;
+    // Stop listening, e.g. when the pins are handed to another sensor
+    void close();
+
+    uint32_t trigger() override;
+    bool resultReady() override;
+    uint32_t pollMs() const override { return 5; }
+    bool collect(float &cm) override;
+
+    uint32_t frames() const { return _parser.frames(); }
+    uint32_t checksumErrors() const { return _parser.checksumErrors(); }
+
+private:
+    struct Frame
+    {
+        uint16_t mm;
+        uint32_t atMs;
+    };
+
+    void receive();
+    // Skip frames too old to stand for the current level; call locked
+    void dropStale(uint32_t nowMs);
+
+    HardwareSerial &_serial;
+    int _rxPin;
+    int _txPin;
+    bool _open;
+    A01nyubParser _parser; // Fed by the UART event task only
+    Frame _window[WINDOW];
+    uint32_t _written; // Frames ever added to the window
+    uint32_t _read;    // Frames ever taken or dropped from it
+    std::mutex _mutex; // Guards the window
+};
+
+#else
+
+#include "Clock.h"
+
+// Tidal water surface (two tides a day) with noise, occasional failed
+// samples and stray echoes (pipe wall, debris) far from the surface. A daily
+// flash flood raises the water by floodCm within 20 minutes from 14:00 and
+// drains over the following four hours. The level follows the clock; the
+// noise sequence depends only on the seed.
+class SimSensor : public DistanceSensor
+{
+public:
+    SimSensor(Clock &clock, uint32_t seed, float meanCm, float amplitudeCm, float noiseCm,
+              float failureRate, float outlierRate = 0.0f, float floodCm = 0.0f);
+
+    // Ping cycle reported to a sampler; both 0 unless set
+    void setTiming(uint32_t latencyMs, uint32_t recoveryMs);
+
+    // Samples taken so far, including failed ones
+    uint32_t samples() const { return _samples; }
+
+    void begin() override;
+    uint32_t trigger() override { return _latencyMs; }
+    bool collect(float &cm) override;
+    uint32_t recoveryMs() const override { return _recoveryMs; }
+
+private:
+    float random01();
+    float floodAt(uint32_t secondOfDay) const;
+
+    Clock &_clock;
+    uint32_t _state;
+    uint32_t _samples;
+    float _surfaceCm;
+    float _meanCm;
+    float _amplitudeCm;
+    float _noiseCm;
+    float _failureRate;
+    float _outlierRate;
+    float _floodCm;
+    uint32_t _latencyMs;
+    uint32_t _recoveryMs;
+};
+
+#endif
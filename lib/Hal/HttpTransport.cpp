@@ -0,0 +1,151 @@
+#include "HttpTransport.h"
+
+#ifndef ARDUINO
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+
+SimHttpTransport::SimHttpTransport()
+    : _connected(false), _offline(false), _status(200), _keepAliveLimit(0), _requestsOnConnection(0),
+      _connects(0), _requests(0), _bytesReceived(0), _replyPos(0), _stage(0), _chunked(false),
+      _remaining(0)
+{
+}
+
+bool SimHttpTransport::connect(const char * /*host*/, uint16_t /*port*/, bool /*secure*/)
+{
+    stop();
+    if (_offline)
+    {
+        return false;
+    }
+    _connected = true;
+    _connects++;
+    return true;
+}
+
+void SimHttpTransport::stop()
+{
+    _connected = false;
+    _requestsOnConnection = 0;
+    _input.clear();
+    _body.clear();
+    _reply.clear();
+    _replyPos = 0;
+    _stage = 0;
+}
+
+size_t SimHttpTransport::write(const uint8_t *data, size_t length)
+{
+    if (!_connected)
+    {
+        return 0;
+    }
+    _bytesReceived += length;
+    _input.append((const char *)data, length);
+    parse();
+    return length;
+}
+
+int SimHttpTransport::read(uint32_t /*timeoutMs*/)
+{
+    if (_replyPos < _reply.size())
+    {
+        return (unsigned char)_reply[_replyPos++];
+    }
+    return -1;
+}
+
+void SimHttpTransport::parse()
+{
+    for (;;)
+    {
+        if (_stage == 4)
+        {
+            size_t n = _input.size() < _remaining ? _input.size() : _remaining;
+            _body.append(_input, 0, n);
+            _input.erase(0, n);
+            _remaining -= n;
+            if (_remaining > 0)
+            {
+                return;
+            }
+            finishRequest();
+            continue;
+        }
+        if (_stage == 2)
+        {
+            // Chunk data followed by CRLF
+            if (_input.size() < _remaining + 2)
+            {
+                return;
+            }
+            _body.append(_input, 0, _remaining);
+            _input.erase(0, _remaining + 2);
+            _stage = 1;
+            continue;
+        }
+
+        size_t end = _input.find("\r\n");
+        if (end == std::string::npos)
+        {
+            return;
+        }
+        std::string line = _input.substr(0, end);
+        _input.erase(0, end + 2);
+
+        if (_stage == 0)
+        {
+            if (!line.empty())
+            {
+                if (strncasecmp(line.c_str(), "Transfer-Encoding:", 18) == 0)
+                {
+                    _chunked = line.find("chunked") != std::string::npos;
+                }
+                else if (strncasecmp(line.c_str(), "Content-Length:", 15) == 0)
+                {
+                    _remaining = strtoul(line.c_str() + 15, nullptr, 10);
+                }
+                continue;
+            }
+            _stage = _chunked ? 1 : 4;
+        }
+        else if (_stage == 1)
+        {
+            _remaining = strtoul(line.c_str(), nullptr, 16);
+            _stage = _remaining > 0 ? 2 : 3;
+        }
+        else if (_stage == 3 && line.empty())
+        {
+            finishRequest();
+        }
+    }
+}
+
+void SimHttpTransport::finishRequest()
+{
+    _requests++;
+    _requestsOnConnection++;
+    _lastBody.swap(_body);
+    _body.clear();
+    _stage = 0;
+    _chunked = false;
+    _remaining = 0;
+
+    bool close = _keepAliveLimit > 0 && _requestsOnConnection >= _keepAliveLimit;
+    char reply[128];
+    snprintf(reply, sizeof(reply), "HTTP/1.1 %d Sim\r\nContent-Length: 2\r\n%s\r\nok",
+             _status, close ? "Connection: close\r\n" : "");
+    _reply.erase(0, _replyPos);
+    _replyPos = 0;
+    _reply += reply;
+    if (close)
+    {
+        // The reply can still be read; further writes fail
+        _connected = false;
+        _requestsOnConnection = 0;
+    }
+}
+
+#endif
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte stream to an HTTP server, optionally over TLS
+class HttpTransport
+{
+public:
+    virtual ~HttpTransport() {}
+
+    virtual bool connect(const char *host, uint16_t port, bool secure) = 0;
+    virtual bool connected() = 0;
+    virtual void stop() = 0;
+
+    virtual size_t write(const uint8_t *data, size_t length) = 0;
+    // Next byte of the reply, or -1 if none arrives within timeoutMs or the
+    // connection is closed
+    virtual int read(uint32_t timeoutMs) = 0;
+};
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
+
+class WiFiTransport : public HttpTransport
+{
+public:
+    WiFiTransport() : _client(nullptr) {}
+
+    bool connect(const char *host, uint16_t port, bool secure) override
+    {
+        stop();
+        WiFiClient *client = secure ? &_secure : &_plain;
+        if (secure)
+        {
+            _secure.setInsecure(); // As HTTPClient does without a CA certificate
+        }
+        if (!client->connect(host, port))
+        {
+            return false;
+        }
+        _client = client;
+        return true;
+    }
+
+    bool connected() override { return _client && _client->connected(); }
+
+    void stop() override
+    {
+        if (_client)
+        {
+            _client->stop();
+            _client = nullptr;
+        }
+    }
+
+    size_t write(const uint8_t *data, size_t length) override
+    {
+        return _client ? _client->write(data, length) : 0;
+    }
+
+    int read(uint32_t timeoutMs) override
+    {
+        if (!_client)
+        {
+            return -1;
+        }
+        unsigned long start = millis();
+        while (!_client->available())
+        {
+            if (!_client->connected() || millis() - start >= timeoutMs)
+            {
+                return -1;
+            }
+            delay(1);
+        }
+        return _client->read();
+    }
+
+private:
+    WiFiClient _plain;
+    WiFiClientSecure _secure;
+    WiFiClient *_client;
+};
+
+#else
+
+#include <string>
+
+// In-memory API server. It parses each request as it is written (headers
+// and a chunked or Content-Length body) and queues a reply, so the real
+// upload code runs unchanged on the host. Failures can be injected.
+class SimHttpTransport : public HttpTransport
+{
+public:
+    SimHttpTransport();
+
+    bool connect(const char *host, uint16_t port, bool secure) override;
+    bool connected() override { return _connected; }
+    void stop() override;
+    size_t write(const uint8_t *data, size_t length) override;
+    int read(uint32_t timeoutMs) override;
+
+    // Status code for the following requests
+    void setStatus(int status) { _status = status; }
+    // Close the connection after this many requests (0 = never)
+    void setKeepAliveLimit(uint32_t requests) { _keepAliveLimit = requests; }
+    // Refuse connections, as when the uplink is down
+    void setOffline(bool offline) { _offline = offline; }
+
+    uint32_t connects() const { return _connects; }
+    uint32_t requests() const { return _requests; }
+    uint64_t bytesReceived() const { return _bytesReceived; }
+    // Body of the last complete request
+    const std::string &lastBody() const { return _lastBody; }
+
+private:
+    void parse();
+    void finishRequest();
+
+    bool _connected;
+    bool _offline;
+    int _status;
+    uint32_t _keepAliveLimit;
+    uint32_t _requestsOnConnection;
+
+    uint32_t _connects;
+    uint32_t _requests;
+    uint64_t _bytesReceived;
+
+    std::string _input;    // Unparsed request bytes
+    std::string _body;     // Body of the request being received
+    std::string _lastBody;
+    std::string _reply;
+    size_t _replyPos;
+    int _stage;            // 0 = headers, 1 = chunk size, 2 = chunk data, 3 = trailers, 4 = fixed-length body
+    bool _chunked;
+    size_t _remaining;
+};
+
+#endif
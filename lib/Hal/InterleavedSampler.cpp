@@ -0,0 +1,96 @@
+#include "InterleavedSampler.h"
+
+uint32_t InterleavedSampler::read(SamplerSlot *slots, size_t count)
+{
+    if (count > MAX_SLOTS)
+    {
+        count = MAX_SLOTS;
+    }
+
+    _startMs = _clock.millis();
+    for (size_t i = 0; i < count; i++)
+    {
+        slots[i].filter->reset();
+        slots[i].sensor->begin();
+        slots[i].durationMs = 0;
+        _state[i].dueMs = _startMs;
+        _state[i].waiting = false;
+        _state[i].done = false;
+    }
+
+    size_t remaining = count;
+    while (remaining > 0)
+    {
+        uint32_t now = _clock.millis();
+        bool due = false;
+        uint32_t nextDue = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            State &state = _state[i];
+            if (state.done)
+            {
+                continue;
+            }
+            DistanceSensor &sensor = *slots[i].sensor;
+            if ((int32_t)(state.dueMs - now) <= 0 || (state.waiting && sensor.resultReady()))
+            {
+                if (step(slots[i], state, now))
+                {
+                    remaining--;
+                    continue;
+                }
+                now = _clock.millis();
+            }
+            // A sensor that can finish early is checked again after pollMs()
+            uint32_t wake = state.dueMs;
+            uint32_t poll = sensor.pollMs();
+            if (state.waiting && poll > 0 && (int32_t)(wake - (now + poll)) > 0)
+            {
+                wake = now + poll;
+            }
+            if (!due || (int32_t)(wake - nextDue) < 0)
+            {
+                nextDue = wake;
+                due = true;
+            }
+        }
+
+        if (due && (int32_t)(nextDue - now) > 0)
+        {
+            _clock.wait(nextDue - now);
+        }
+    }
+    return _clock.millis() - _startMs;
+}
+
+bool InterleavedSampler::step(SamplerSlot &slot, State &state, uint32_t now)
+{
+    if (!state.waiting)
+    {
+        state.dueMs = now + slot.sensor->trigger();
+        state.waiting = true;
+        return false;
+    }
+
+    float cm;
+    if (slot.sensor->collect(cm))
+    {
+        slot.filter->add(cm);
+    }
+    else
+    {
+        slot.filter->addFailure();
+    }
+    state.waiting = false;
+
+    if (slot.filter->full() || slot.filter->settled())
+    {
+        slot.sensor->end();
+        slot.result = slot.filter->result();
+        slot.durationMs = now - _startMs;
+        state.done = true;
+        return true;
+    }
+    state.dueMs = now + slot.sensor->recoveryMs();
+    return false;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SampleFilter.h>
+
+#include "Clock.h"
+#include "DistanceSensor.h"
+
+// One sensor's part in an interleaved measurement
+struct SamplerSlot
+{
+    DistanceSensor *sensor;
+    SampleFilter *filter;
+    FilteredReading result; // Set by read()
+    uint32_t durationMs;    // From the start of read() until this sensor was done
+};
+
+// Measures several sensors in one pass. While one sensor waits for its echo
+// or frame, or rests before the next ping, the others are triggered or
+// collected, so a pass takes about as long as its slowest sensor instead of
+// the sum of all of them. A sensor that reports its result early, like the
+// HC-SR04 once its echo has ended, is collected then rather than at its
+// timeout. Each sensor keeps its own cycle and filter, and stops once its
+// samples settle, as with DistanceSensor::read().
+//
+// Sensors that hear each other's pings must not share a pass.
+class InterleavedSampler
+{
+public:
+    static const size_t MAX_SLOTS = 4;
+
+    explicit InterleavedSampler(Clock &clock) : _clock(clock), _startMs(0) {}
+
+    // Blocks until every slot has a result; returns the ms the pass took.
+    // Slots past MAX_SLOTS are left untouched.
+    uint32_t read(SamplerSlot *slots, size_t count);
+
+private:
+    struct State
+    {
+        uint32_t dueMs;  // When the next step may run
+        bool waiting;    // Triggered; the next step is collect()
+        bool done;
+    };
+
+    // Trigger or collect one slot; true once it is done
+    bool step(SamplerSlot &slot, State &state, uint32_t now);
+
+    Clock &_clock;
+    uint32_t _startMs;
+    State _state[MAX_SLOTS];
+};
@@ -0,0 +1,231 @@
+#include "SampleFilter.h"
+
+#include <math.h>
+#include <string.h>
+
+// Scales a median absolute deviation to a standard deviation for normal noise
+#define MAD_TO_SIGMA 1.4826f
+
+SampleFilter::SampleFilter(const FilterConfig &config) : _count(0), _attempts(0)
+{
+    configure(config);
+}
+
+void SampleFilter::configure(const FilterConfig &config)
+{
+    _config = config;
+    _count = 0;
+    _attempts = 0;
+    if (_config.maxSamples < 1)
+    {
+        _config.maxSamples = 1;
+    }
+    if (_config.maxSamples > MAX_SAMPLES)
+    {
+        _config.maxSamples = MAX_SAMPLES;
+    }
+    if (_config.minSamples < 1)
+    {
+        _config.minSamples = 1;
+    }
+}
+
+void SampleFilter::reset()
+{
+    _count = 0;
+    _attempts = 0;
+}
+
+void SampleFilter::add(float cm)
+{
+    if (full())
+    {
+        return;
+    }
+    _samples[_count++] = cm;
+    _attempts++;
+}
+
+void SampleFilter::addFailure()
+{
+    if (!full())
+    {
+        _attempts++;
+    }
+}
+
+// Insertion sort; n is at most MAX_SAMPLES
+void SampleFilter::sorted(float *out) const
+{
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        float value = _samples[i];
+        int j = i - 1;
+        while (j >= 0 && out[j] > value)
+        {
+            out[j + 1] = out[j];
+            j--;
+        }
+        out[j + 1] = value;
+    }
+}
+
+float SampleFilter::median(const float *sortedSamples) const
+{
+    uint8_t mid = _count / 2;
+    return (_count % 2) ? sortedSamples[mid] : (sortedSamples[mid - 1] + sortedSamples[mid]) / 2.0f;
+}
+
+float SampleFilter::robustSigma(const float *sortedSamples, float center) const
+{
+    float deviations[MAX_SAMPLES];
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        deviations[i] = fabsf(sortedSamples[i] - center);
+    }
+    // Deviations from the median of sorted data are V-shaped; a plain sort
+    // of 32 values is cheap enough
+    for (uint8_t i = 1; i < _count; i++)
+    {
+        float value = deviations[i];
+        int j = i - 1;
+        while (j >= 0 && deviations[j] > value)
+        {
+            deviations[j + 1] = deviations[j];
+            j--;
+        }
+        deviations[j + 1] = value;
+    }
+    uint8_t mid = _count / 2;
+    float mad = (_count % 2) ? deviations[mid] : (deviations[mid - 1] + deviations[mid]) / 2.0f;
+    return MAD_TO_SIGMA * mad;
+}
+
+bool SampleFilter::settled() const
+{
+    if (_count < _config.minSamples)
+    {
+        return false;
+    }
+    float values[MAX_SAMPLES];
+    sorted(values);
+    return robustSigma(values, median(values)) <= _config.settleCm;
+}
+
+float SampleFilter::sampleConfidence(uint8_t i) const
+{
+    if (i >= _count)
+    {
+        return 0;
+    }
+    float values[MAX_SAMPLES];
+    sorted(values);
+    float center = median(values);
+    float sigma = robustSigma(values, center);
+    if (sigma < _config.resolutionCm)
+    {
+        sigma = _config.resolutionCm;
+    }
+    float z = fabsf(_samples[i] - center) / (_config.hampelK * sigma);
+    return z >= 1.0f ? 0.0f : 1.0f - z;
+}
+
+FilteredReading SampleFilter::result() const
+{
+    FilteredReading reading;
+    reading.distance = -1;
+    reading.quality = 0;
+    reading.spreadCm = 0;
+    reading.attempts = _attempts;
+    reading.valid = _count;
+    reading.used = 0;
+    if (_count == 0)
+    {
+        return reading;
+    }
+
+    float values[MAX_SAMPLES];
+    sorted(values);
+    float center = median(values);
+    float sigma = robustSigma(values, center);
+    reading.spreadCm = sigma;
+    if (sigma < _config.resolutionCm)
+    {
+        sigma = _config.resolutionCm;
+    }
+    float limit = _config.hampelK * sigma;
+
+    float sum = 0;
+    uint8_t first = 0;
+    uint8_t end = _count;
+    switch (_config.mode)
+    {
+    case FILTER_MEDIAN:
+        reading.distance = center;
+        reading.used = (_count % 2) ? 1 : 2;
+        break;
+
+    case FILTER_TRIMMED_MEAN:
+    {
+        uint8_t trim = (uint8_t)(_count * _config.trimFraction);
+        if (2 * trim >= _count)
+        {
+            trim = (_count - 1) / 2;
+        }
+        first = trim;
+        end = _count - trim;
+    }
+    // fall through
+    case FILTER_MEAN:
+        for (uint8_t i = first; i < end; i++)
+        {
+            sum += values[i];
+        }
+        reading.used = end - first;
+        reading.distance = sum / reading.used;
+        break;
+
+    case FILTER_HAMPEL:
+    default:
+        for (uint8_t i = 0; i < _count; i++)
+        {
+            if (fabsf(values[i] - center) <= limit)
+            {
+                sum += values[i];
+                reading.used++;
+            }
+        }
+        // The median itself always passes, so used is at least 1
+        reading.distance = sum / reading.used;
+        break;
+    }
+
+    float confidence = 0;
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        float z = fabsf(values[i] - center) / limit;
+        confidence += z >= 1.0f ? 0.0f : 1.0f - z;
+    }
+    reading.quality = (confidence / _count) * ((float)_count / _attempts);
+    return reading;
+}
+
+static const char *const FILTER_NAMES[] = {"mean", "median", "trimmed", "hampel"};
+
+const char *filterModeName(FilterMode mode)
+{
+    return mode <= FILTER_HAMPEL ? FILTER_NAMES[mode] : FILTER_NAMES[FILTER_HAMPEL];
+}
+
+bool parseFilterMode(const char *name, FilterMode &mode)
+{
+    for (uint8_t i = 0; i <= FILTER_HAMPEL; i++)
+    {
+        if (strcmp(name, FILTER_NAMES[i]) == 0)
+        {
+            mode = (FilterMode)i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+
+// How the samples of one measurement are combined
+enum FilterMode : uint8_t
+{
+    FILTER_MEAN,         // Plain average (the old behaviour)
+    FILTER_MEDIAN,       // Middle sample
+    FILTER_TRIMMED_MEAN, // Average after dropping the extremes at both ends
+    FILTER_HAMPEL        // Average of samples within k robust sigmas of the median
+};
+
+struct FilterConfig
+{
+    FilterMode mode;
+    uint8_t maxSamples;  // Samples attempted per measurement, at most SampleFilter::MAX_SAMPLES
+    uint8_t minSamples;  // Valid samples needed before stopping early
+    float trimFraction;  // Share dropped at each end by FILTER_TRIMMED_MEAN
+    float hampelK;       // Rejection threshold in robust sigmas
+    float resolutionCm;  // Sensor resolution; spreads below it count as zero
+    float settleCm;      // Stop sampling once the robust spread is within this
+
+    FilterConfig()
+        : mode(FILTER_HAMPEL), maxSamples(15), minSamples(5), trimFraction(0.2f),
+          hampelK(3.0f), resolutionCm(0.3f), settleCm(1.0f) {}
+};
+
+struct FilteredReading
+{
+    float distance;  // cm, negative if there was no valid sample
+    float quality;   // 0..1, see SampleFilter
+    float spreadCm;  // Robust standard deviation of the samples
+    uint8_t attempts;
+    uint8_t valid;   // Samples the sensor returned
+    uint8_t used;    // Samples that went into distance
+};
+
+// Combines the raw samples of one measurement into a distance.
+//
+// A single echo off a pipe wall or debris skews a plain mean; the median
+// based modes ignore it. Every sample gets a confidence from its distance to
+// the median in robust sigmas (1.4826 * median absolute deviation), and the
+// reading's quality is the mean confidence of the valid samples scaled by
+// the share of attempts that produced one. Once minSamples agree to within
+// settleCm, settled() tells the caller it can stop early, which saves
+// acquisition time and sensor power on calm water.
+//
+// Works on a fixed array; nothing is allocated.
+class SampleFilter
+{
+public:
+    static const uint8_t MAX_SAMPLES = 32;
+
+    explicit SampleFilter(const FilterConfig &config = FilterConfig());
+
+    // Change the settings; drops the samples taken so far
+    void configure(const FilterConfig &config);
+    void reset();
+    void add(float cm);
+    void addFailure(); // An attempt that produced no sample
+
+    bool full() const { return _attempts >= _config.maxSamples; }
+    bool settled() const;
+
+    FilteredReading result() const;
+
+    // Confidence (0..1) of the i-th valid sample, in the order added
+    float sampleConfidence(uint8_t i) const;
+
+private:
+    void sorted(float *out) const;
+    float robustSigma(const float *sortedSamples, float median) const;
+    float median(const float *sortedSamples) const;
+
+    FilterConfig _config;
+    float _samples[MAX_SAMPLES];
+    uint8_t _count;
+    uint8_t _attempts;
+};
+
+// Lower-case names used by the settings form and /getConfig
+const char *filterModeName(FilterMode mode);
+bool parseFilterMode(const char *name, FilterMode &mode);
@@ -0,0 +1,125 @@
+#include "AdaptiveScheduler.h"
+
+#include <math.h>
+
+AdaptiveScheduler::AdaptiveScheduler()
+    : _interval(0), _rate(0), _hasAnchor(false), _anchorMs(0), _anchorBlok(0), _anchorParit(0)
+{
+    ScheduleConfig config;
+    config.minIntervalMs = 12000;
+    config.normalIntervalMs = 12000;
+    config.maxIntervalMs = 12000;
+    config.fastRateCmPerMin = 0.5f;
+    config.stableCm = 1.0f;
+    configure(config);
+}
+
+void AdaptiveScheduler::configure(const ScheduleConfig &config)
+{
+    _config = config;
+    if (_config.normalIntervalMs < _config.minIntervalMs)
+    {
+        _config.normalIntervalMs = _config.minIntervalMs;
+    }
+    if (_config.maxIntervalMs < _config.normalIntervalMs)
+    {
+        _config.maxIntervalMs = _config.normalIntervalMs;
+    }
+
+    if (_interval == 0)
+    {
+        _interval = _config.normalIntervalMs;
+    }
+    else if (_interval < _config.minIntervalMs)
+    {
+        _interval = _config.minIntervalMs;
+    }
+    else if (_interval > _config.maxIntervalMs)
+    {
+        _interval = _config.maxIntervalMs;
+    }
+}
+
+uint32_t AdaptiveScheduler::update(uint32_t nowMs, float levelBlok, float levelParit)
+{
+    if (!_hasAnchor)
+    {
+        _hasAnchor = true;
+        setAnchor(nowMs, levelBlok, levelParit);
+        return _interval;
+    }
+
+    uint32_t elapsedMs = nowMs - _anchorMs;
+    float change = fmaxf(fabsf(levelBlok - _anchorBlok), fabsf(levelParit - _anchorParit));
+    if (elapsedMs == 0)
+    {
+        return _interval;
+    }
+
+    if (change > _config.stableCm)
+    {
+        _rate = change * 60000.0f / elapsedMs;
+        if (_rate >= 4 * _config.fastRateCmPerMin)
+        {
+            _interval = _config.minIntervalMs;
+        }
+        else if (_rate >= _config.fastRateCmPerMin)
+        {
+            _interval = _interval / 2 > _config.minIntervalMs ? _interval / 2 : _config.minIntervalMs;
+        }
+        else if (_interval > _config.normalIntervalMs)
+        {
+            _interval = _interval / 2 > _config.normalIntervalMs ? _interval / 2 : _config.normalIntervalMs;
+        }
+        else if (_interval < _config.normalIntervalMs)
+        {
+            uint32_t stretched = _interval + _interval / 2;
+            _interval = stretched < _config.normalIntervalMs ? stretched : _config.normalIntervalMs;
+        }
+    }
+    else if (change <= _config.stableCm / 2 && elapsedMs >= 2 * _interval)
+    {
+        _rate = 0;
+        uint32_t stretched = _interval + _interval / 2;
+        _interval = stretched < _config.maxIntervalMs ? stretched : _config.maxIntervalMs;
+    }
+    else
+    {
+        // Not enough movement yet to tell; keep the anchor
+        return _interval;
+    }
+
+    setAnchor(nowMs, levelBlok, levelParit);
+    return _interval;
+}
+
+void AdaptiveScheduler::setAnchor(uint32_t nowMs, float levelBlok, float levelParit)
+{
+    _anchorMs = nowMs;
+    _anchorBlok = levelBlok;
+    _anchorParit = levelParit;
+}
+
+ScheduleState AdaptiveScheduler::state() const
+{
+    ScheduleState state;
+    state.intervalMs = _interval;
+    state.rate = _rate;
+    state.anchorMs = _anchorMs;
+    state.anchorBlok = _anchorBlok;
+    state.anchorParit = _anchorParit;
+    state.hasAnchor = _hasAnchor;
+    return state;
+}
+
+void AdaptiveScheduler::restore(const ScheduleState &state)
+{
+    _interval = state.intervalMs;
+    _rate = state.rate;
+    _anchorMs = state.anchorMs;
+    _anchorBlok = state.anchorBlok;
+    _anchorParit = state.anchorParit;
+    _hasAnchor = state.hasAnchor;
+    // Clamp into the configured bounds
+    configure(_config);
+}
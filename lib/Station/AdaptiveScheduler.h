@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+
+struct ScheduleConfig
+{
+    uint32_t minIntervalMs;    // Used while the water moves fast
+    uint32_t normalIntervalMs; // Used at start and while it moves moderately
+    uint32_t maxIntervalMs;    // Approached while it is flat
+    float fastRateCmPerMin;    // Rate that counts as an event
+    float stableCm;            // Change per reading treated as noise
+};
+
+// What update() has learned so far; plain data, so it can be kept in RTC
+// memory across deep sleep
+struct ScheduleState
+{
+    uint32_t intervalMs;
+    float rate;
+    uint32_t anchorMs;
+    float anchorBlok;
+    float anchorParit;
+    bool hasAnchor;
+};
+
+// Picks the measurement interval from how fast the level is changing.
+//
+// Readings are compared with an anchor reading. Once the level has moved
+// more than stableCm from it, the rate over that span decides and the
+// reading becomes the new anchor:
+//   rate >= fastRateCmPerMin       halve the interval (straight to the
+//                                  minimum at four times the threshold)
+//   slower                         move back towards the normal interval
+// If it has stayed within stableCm / 2 for two intervals, the interval is
+// stretched by half, up to the maximum. Anything in between keeps the
+// interval and lets the change build up, so a rise too slow to see between
+// two readings is still caught over several.
+//
+// With min == normal == max the interval is fixed.
+class AdaptiveScheduler
+{
+public:
+    AdaptiveScheduler();
+
+    // Keeps the current interval if it is still within the new bounds
+    void configure(const ScheduleConfig &config);
+
+    // Feed a successful reading taken at nowMs; returns the new interval
+    uint32_t update(uint32_t nowMs, float levelBlok, float levelParit);
+
+    uint32_t interval() const { return _interval; }
+    float rate() const { return _rate; } // cm/min over the last span that moved
+
+    ScheduleState state() const;
+    // Continue from a saved state; call after configure()
+    void restore(const ScheduleState &state);
+
+private:
+    void setAnchor(uint32_t nowMs, float levelBlok, float levelParit);
+
+    ScheduleConfig _config;
+    uint32_t _interval;
+    float _rate;
+    bool _hasAnchor;
+    uint32_t _anchorMs;
+    float _anchorBlok;
+    float _anchorParit;
+};
@@ -0,0 +1,130 @@
+#include "BootTimeline.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+BootTimeline::BootTimeline() : _count(0), _open(false)
+{
+}
+
+void BootTimeline::closeOpen(uint32_t nowMs)
+{
+    if (_open)
+    {
+        _entries[_count - 1].endMs = nowMs;
+        _open = false;
+    }
+}
+
+void BootTimeline::begin(const char *phase, uint32_t nowMs)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    closeOpen(nowMs);
+    if (_count >= MAX_ENTRIES)
+    {
+        return;
+    }
+    _entries[_count++] = {phase, nowMs, nowMs, false};
+    _open = true;
+}
+
+void BootTimeline::end(uint32_t nowMs)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    closeOpen(nowMs);
+}
+
+void BootTimeline::mark(const char *event, uint32_t nowMs)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (find(event, true) || _count >= MAX_ENTRIES)
+    {
+        return;
+    }
+    // Keep a running phase last so closeOpen() finds it
+    if (_open)
+    {
+        _entries[_count] = _entries[_count - 1];
+        _entries[_count - 1] = {event, nowMs, nowMs, true};
+    }
+    else
+    {
+        _entries[_count] = {event, nowMs, nowMs, true};
+    }
+    _count++;
+}
+
+bool BootTimeline::marked(const char *event) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return find(event, true) != nullptr;
+}
+
+const BootTimeline::Entry *BootTimeline::find(const char *name, bool isMark) const
+{
+    for (uint8_t i = 0; i < _count; i++)
+    {
+        if (_entries[i].isMark == isMark && strcmp(_entries[i].name, name) == 0)
+        {
+            return &_entries[i];
+        }
+    }
+    return nullptr;
+}
+
+size_t BootTimeline::format(char *buffer, size_t size) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t length = 0;
+    bool ok = append(buffer, size, length, "{\"phases\":[");
+    const char *separator = "";
+    for (uint8_t i = 0; i < _count && ok; i++)
+    {
+        const Entry &entry = _entries[i];
+        if (entry.isMark)
+        {
+            continue;
+        }
+        if (_open && i == _count - 1)
+        {
+            // Still running
+            ok = append(buffer, size, length, "%s{\"name\":\"%s\",\"startMs\":%lu,\"ms\":null}", separator,
+                        entry.name, (unsigned long)entry.startMs);
+        }
+        else
+        {
+            ok = append(buffer, size, length, "%s{\"name\":\"%s\",\"startMs\":%lu,\"ms\":%lu}", separator,
+                        entry.name, (unsigned long)entry.startMs, (unsigned long)(entry.endMs - entry.startMs));
+        }
+        separator = ",";
+    }
+    ok = ok && append(buffer, size, length, "],\"marks\":{");
+    separator = "";
+    for (uint8_t i = 0; i < _count && ok; i++)
+    {
+        const Entry &entry = _entries[i];
+        if (entry.isMark)
+        {
+            ok = append(buffer, size, length, "%s\"%s\":%lu", separator, entry.name,
+                        (unsigned long)entry.startMs);
+            separator = ",";
+        }
+    }
+    ok = ok && append(buffer, size, length, "}}");
+    return ok ? length : 0;
+}
+
+bool BootTimeline::append(char *buffer, size_t size, size_t &length, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buffer + length, size - length, format, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= size - length)
+    {
+        return false;
+    }
+    length += n;
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+// When each stage of startup ran, for /bootTiming.
+//
+// setup() is a sequence of phases: begin() closes the running phase and
+// opens the next, end() closes the last. Things that finish later, outside
+// setup() (Wi-Fi joined, first request served, first reading), are marks,
+// recorded the first time only. Times are milliseconds since the
+// application started. Safe to use from several tasks.
+class BootTimeline
+{
+public:
+    static const uint8_t MAX_ENTRIES = 16;
+
+    BootTimeline();
+
+    void begin(const char *phase, uint32_t nowMs);
+    void end(uint32_t nowMs);
+    void mark(const char *event, uint32_t nowMs);
+
+    bool marked(const char *event) const;
+
+    // {"phases":[{"name":..,"startMs":..,"ms":..},..],"marks":{"name":ms,..}}
+    // Returns the length, or 0 if it did not fit
+    size_t format(char *buffer, size_t size) const;
+
+private:
+    struct Entry
+    {
+        const char *name; // Must be a string literal
+        uint32_t startMs;
+        uint32_t endMs;
+        bool isMark;
+    };
+
+    void closeOpen(uint32_t nowMs);
+    const Entry *find(const char *name, bool isMark) const;
+    static bool append(char *buffer, size_t size, size_t &length, const char *format, ...)
+        __attribute__((format(printf, 4, 5)));
+
+    Entry _entries[MAX_ENTRIES];
+    uint8_t _count;
+    bool _open; // Last phase still running
+    mutable std::mutex _mutex;
+};
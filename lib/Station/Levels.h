@@ -0,0 +1,25 @@
+#pragma once
+
+// Sensor mounting geometry and offset, in cm
+struct Calibration
+{
+    float sensorToZeroBlokDistance;
+    float sensorToBottomDistance;
+    float calibrationOffset;
+};
+
+struct Levels
+{
+    float blok;  // Relative to the block's zero mark; rises as the water does
+    float parit; // Depth of water in the ditch
+    float raw;   // Distance measured by the sensor
+};
+
+inline Levels computeLevels(float distance, const Calibration &calibration)
+{
+    Levels levels;
+    levels.raw = distance;
+    levels.blok = ((distance - calibration.sensorToZeroBlokDistance) * -1) + calibration.calibrationOffset;
+    levels.parit = (calibration.sensorToBottomDistance - distance) + calibration.calibrationOffset;
+    return levels;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+#include <DataLog.h>
+
+#include "AdaptiveScheduler.h"
+#include "Levels.h"
+
+#define SLEEP_STATE_MAGIC 0x534C5031 // "SLP1"; change it when the layout changes
+
+// What a timer wakeup needs to take a reading, copied from the full config
+// before the first sleep so a wakeup does not have to mount SPIFFS
+struct SleepSettings
+{
+    uint8_t sensorType;
+    uint8_t filterMode;
+    uint8_t samplesPerReading;
+    uint8_t flushEvery; // Wakeups between writes to flash
+    Calibration calibration;
+    ScheduleConfig schedule;
+};
+
+// Timings of the sleep cycle since low-power mode was entered
+struct SleepStats
+{
+    uint32_t cycles;        // Timer wakeups
+    uint32_t readings;      // Wakeups that produced a record
+    uint32_t flushes;
+    uint32_t lastBootMs;    // Reset to the start of the wake path
+    uint32_t lastMeasureMs;
+    uint32_t lastAwakeMs;   // Reset to deep sleep
+    uint32_t maxAwakeMs;
+    uint64_t totalAwakeMs;
+    uint64_t totalMeasureMs;
+    uint64_t totalFlushMs;
+    uint64_t totalSleepMs;
+};
+
+// Everything kept in RTC slow memory between deep sleeps. Plain data only:
+// an RTC_DATA_ATTR variable is zeroed on a cold boot and left alone on a
+// wakeup, and a constructor would run (and wipe it) on both.
+template <size_t Capacity>
+struct SleepState
+{
+    uint32_t magic;
+    SleepSettings settings;
+    ScheduleState schedule;
+    uint32_t clockMs;    // Time across sleeps when this boot started, for the scheduler
+    uint32_t sinceFlush; // Wakeups since the buffer was written to flash
+    uint32_t count;
+    LogRecord records[Capacity];
+    SleepStats stats;
+
+    bool valid() const { return magic == SLEEP_STATE_MAGIC && count <= Capacity; }
+
+    void reset(const SleepSettings &newSettings)
+    {
+        memset(this, 0, sizeof(*this));
+        magic = SLEEP_STATE_MAGIC;
+        settings = newSettings;
+    }
+
+    bool push(const LogRecord &record)
+    {
+        if (count >= Capacity)
+        {
+            return false;
+        }
+        records[count++] = record;
+        return true;
+    }
+
+    bool flushDue() const { return count >= Capacity || sinceFlush >= settings.flushEvery; }
+};
+
+static_assert(std::is_trivially_default_constructible<SleepState<1>>::value,
+              "SleepState must not have a constructor");
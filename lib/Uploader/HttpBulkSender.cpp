@@ -0,0 +1,273 @@
+#include "HttpBulkSender.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <RecordStream.h>
+
+static void copyString(char *out, size_t size, const char *in)
+{
+    snprintf(out, size, "%s", in ? in : "");
+}
+
+HttpBulkSender::HttpBulkSender(const LogHistory &history, HttpTransport &transport)
+    : _history(history), _transport(transport), _timeoutMs(15000), _open(false), _secure(false)
+{
+    _url[0] = '\0';
+    _token[0] = '\0';
+    _host[0] = '\0';
+}
+
+void HttpBulkSender::setEndpoint(const char *url, const char *token)
+{
+    // Assume bulk endpoint
+    snprintf(_url, sizeof(_url), "%s/bulk", url ? url : "");
+    copyString(_token, sizeof(_token), token);
+}
+
+void HttpBulkSender::setStation(int stationId, const char *stationName, uint8_t channel)
+{
+    _stations.set(channel, stationId, stationName ? stationName : "");
+}
+
+int HttpBulkSender::send(uint32_t startSeq, uint32_t endSeq)
+{
+    char path[160];
+    bool reused;
+    if (!connect(path, sizeof(path), reused))
+    {
+        return -1;
+    }
+    int code = request(path, startSeq, endSeq);
+    if (code < 0 && reused)
+    {
+        // The server may have dropped the idle connection; retry on a new one
+        if (!connect(path, sizeof(path), reused))
+        {
+            return -1;
+        }
+        code = request(path, startSeq, endSeq);
+    }
+    return code;
+}
+
+int HttpBulkSender::request(const char *path, uint32_t startSeq, uint32_t endSeq)
+{
+    char head[384];
+    int headLength = snprintf(head, sizeof(head),
+                              "POST %s HTTP/1.1\r\n"
+                              "Host: %s\r\n"
+                              "Content-Type: application/json\r\n"
+                              "Transfer-Encoding: chunked\r\n"
+                              "%s%s%s"
+                              "\r\n",
+                              path, _host,
+                              _token[0] ? "Authorization: Bearer " : "", _token, _token[0] ? "\r\n" : "");
+    bool ok = headLength > 0 && (size_t)headLength < sizeof(head) && writeAll(head, headLength);
+
+    BulkRecordStream body(_history, startSeq, endSeq, _stations);
+    uint8_t chunk[CHUNK_SIZE];
+    size_t length;
+    while (ok && (length = body.fill(chunk, sizeof(chunk))) > 0)
+    {
+        char size[12];
+        int sizeLength = snprintf(size, sizeof(size), "%x\r\n", (unsigned)length);
+        ok = writeAll(size, sizeLength) && writeAll(chunk, length) && writeAll("\r\n", 2);
+    }
+    ok = ok && writeAll("0\r\n\r\n", 5);
+
+    if (!ok)
+    {
+        disconnect();
+        return -1;
+    }
+    return readResponse();
+}
+
+bool HttpBulkSender::connect(char *path, size_t pathSize, bool &reused)
+{
+    reused = false;
+    bool secure;
+    const char *host;
+    if (strncmp(_url, "https://", 8) == 0)
+    {
+        secure = true;
+        host = _url + 8;
+    }
+    else if (strncmp(_url, "http://", 7) == 0)
+    {
+        secure = false;
+        host = _url + 7;
+    }
+    else
+    {
+        return false;
+    }
+
+    const char *slash = strchr(host, '/');
+    size_t hostLength = slash ? (size_t)(slash - host) : strlen(host);
+    if (hostLength == 0 || hostLength >= sizeof(_host))
+    {
+        return false;
+    }
+    copyString(path, pathSize, slash ? slash : "/");
+
+    if (_open && secure == _secure && strncmp(_host, host, hostLength) == 0 &&
+        _host[hostLength] == '\0' && _transport.connected())
+    {
+        reused = true; // Keep-alive connection from the last batch
+        return true;
+    }
+    disconnect();
+
+    memcpy(_host, host, hostLength);
+    _host[hostLength] = '\0';
+
+    char name[sizeof(_host)];
+    copyString(name, sizeof(name), _host);
+    uint16_t port = secure ? 443 : 80;
+    char *colon = strchr(name, ':');
+    if (colon)
+    {
+        *colon = '\0';
+        port = atoi(colon + 1);
+    }
+    if (!_transport.connect(name, port, secure))
+    {
+        return false;
+    }
+    _open = true;
+    _secure = secure;
+    return true;
+}
+
+void HttpBulkSender::disconnect()
+{
+    if (_open)
+    {
+        _transport.stop();
+        _open = false;
+    }
+}
+
+bool HttpBulkSender::writeAll(const void *data, size_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    while (length > 0)
+    {
+        size_t written = _transport.write(bytes, length);
+        if (written == 0)
+        {
+            return false;
+        }
+        bytes += written;
+        length -= written;
+    }
+    return true;
+}
+
+// Status code of the reply. The body is read and dropped so the connection
+// can carry the next request; it is closed if that is not possible.
+int HttpBulkSender::readResponse()
+{
+    char line[128];
+    int code;
+    if (!readLine(line, sizeof(line)) || sscanf(line, "HTTP/%*s %d", &code) != 1)
+    {
+        disconnect();
+        return -1;
+    }
+
+    long contentLength = -1;
+    bool chunked = false;
+    bool close = false;
+    while (readLine(line, sizeof(line)) && line[0] != '\0')
+    {
+        for (char *c = line; *c; c++)
+        {
+            *c = tolower((unsigned char)*c);
+        }
+        if (strncmp(line, "content-length:", 15) == 0)
+        {
+            contentLength = atol(line + 15);
+        }
+        else if (strncmp(line, "transfer-encoding:", 18) == 0 && strstr(line, "chunked"))
+        {
+            chunked = true;
+        }
+        else if (strncmp(line, "connection:", 11) == 0 && strstr(line, "close"))
+        {
+            close = true;
+        }
+    }
+
+    bool drained = false;
+    if (chunked)
+    {
+        long size;
+        while (readLine(line, sizeof(line)) && (size = strtol(line, nullptr, 16)) > 0)
+        {
+            if (!skipBytes(size + 2)) // Chunk data and its CRLF
+            {
+                break;
+            }
+        }
+        // Zero-size chunk, then trailers up to a blank line
+        while (readLine(line, sizeof(line)))
+        {
+            if (line[0] == '\0')
+            {
+                drained = true;
+                break;
+            }
+        }
+    }
+    else if (contentLength >= 0)
+    {
+        drained = skipBytes(contentLength);
+    }
+
+    if (!drained || close)
+    {
+        disconnect();
+    }
+    return code;
+}
+
+// One header line without its CRLF; longer lines are cut to fit
+bool HttpBulkSender::readLine(char *line, size_t size)
+{
+    size_t used = 0;
+    for (;;)
+    {
+        int c = _transport.read(_timeoutMs);
+        if (c < 0)
+        {
+            return false;
+        }
+        if (c == '\n')
+        {
+            break;
+        }
+        if (c != '\r' && used < size - 1)
+        {
+            line[used++] = c;
+        }
+    }
+    line[used] = '\0';
+    return true;
+}
+
+bool HttpBulkSender::skipBytes(uint32_t length)
+{
+    for (; length > 0; length--)
+    {
+        if (_transport.read(_timeoutMs) < 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
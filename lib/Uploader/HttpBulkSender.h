@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <LogHistory.h>
+#include <HttpTransport.h>
+#include <LogFormat.h>
+
+#include "Uploader.h"
+
+// Posts batches to <endpoint>/bulk. The JSON body is produced from the log,
+// or the archive for an old backlog, as it is written, with chunked
+// transfer encoding, so a window of any size needs one CHUNK_SIZE buffer.
+// The connection is kept between batches while the server allows it, so
+// the TLS handshake is not repeated.
+class HttpBulkSender : public BatchSender
+{
+public:
+    static const size_t CHUNK_SIZE = 512;
+
+    HttpBulkSender(const LogHistory &history, HttpTransport &transport);
+
+    // Copied; call again whenever the settings change
+    void setEndpoint(const char *url, const char *token);
+    // Station the records of a channel are uploaded as
+    void setStation(int stationId, const char *stationName, uint8_t channel = 0);
+    void setTimeout(uint32_t ms) { _timeoutMs = ms; }
+
+    int send(uint32_t startSeq, uint32_t endSeq) override;
+
+private:
+    bool connect(char *path, size_t pathSize, bool &reused);
+    int request(const char *path, uint32_t startSeq, uint32_t endSeq);
+    void disconnect();
+    bool writeAll(const void *data, size_t length);
+    int readResponse();
+    bool readLine(char *line, size_t size);
+    bool skipBytes(uint32_t length);
+
+    LogHistory _history;
+    HttpTransport &_transport;
+    uint32_t _timeoutMs;
+
+    char _url[192];
+    char _token[128];
+    StationTable _stations;
+
+    bool _open;
+    char _host[96]; // "host" or "host:port" of the open connection
+    bool _secure;
+};
@@ -0,0 +1,91 @@
+#include "Uploader.h"
+
+Uploader::Uploader(const LogHistory &history, CursorStore &store, BatchSender &sender)
+    : _history(history), _store(store), _sender(sender),
+      _batchSize(10), _window(10), _flushMs(3600000), _backoffInitialMs(5000), _backoffMaxMs(600000),
+      _acked(0), _failures(0), _dropped(0), _lastStatus(0), _lastSendMs(0), _retryAtMs(0)
+{
+}
+
+void Uploader::begin()
+{
+    _acked = _store.load();
+}
+
+void Uploader::setBatchSize(uint32_t records)
+{
+    if (records < 1)
+    {
+        records = 1;
+    }
+    _batchSize = records > MAX_BATCH ? MAX_BATCH : records;
+}
+
+void Uploader::setBackoff(uint32_t initialMs, uint32_t maxMs)
+{
+    _backoffInitialMs = initialMs;
+    _backoffMaxMs = maxMs;
+}
+
+uint32_t Uploader::pending() const
+{
+    uint32_t last = _history.lastSeq();
+    return last > _acked ? last - _acked : 0;
+}
+
+bool Uploader::service(uint32_t nowMs)
+{
+    if (_failures > 0 && (int32_t)(nowMs - _retryAtMs) < 0)
+    {
+        return false;
+    }
+
+    // A cursor ahead of the log means the log was reformatted
+    uint32_t first = _history.firstSeq();
+    if (_acked > _history.lastSeq())
+    {
+        acknowledge(first - 1);
+    }
+    else if (_acked + 1 < first)
+    {
+        _dropped += first - 1 - _acked;
+        acknowledge(first - 1);
+    }
+
+    uint32_t waiting = pending();
+    if (waiting == 0)
+    {
+        return false;
+    }
+    if (waiting < _batchSize && nowMs - _lastSendMs < _flushMs)
+    {
+        return false;
+    }
+
+    uint32_t window = _window > _batchSize ? _window : _batchSize;
+    uint32_t n = waiting < window ? waiting : window;
+    uint32_t start = _acked + 1;
+
+    _lastStatus = _sender.send(start, start + n);
+    _lastSendMs = nowMs;
+    if (_lastStatus >= 200 && _lastStatus < 300)
+    {
+        _failures = 0;
+        acknowledge(start + n - 1);
+    }
+    else
+    {
+        // 5 s, 10 s, 20 s, ... up to the maximum
+        uint32_t shift = _failures < 16 ? _failures : 16;
+        uint64_t delay = (uint64_t)_backoffInitialMs << shift;
+        _retryAtMs = nowMs + (delay > _backoffMaxMs ? _backoffMaxMs : (uint32_t)delay);
+        _failures++;
+    }
+    return true;
+}
+
+void Uploader::acknowledge(uint32_t seq)
+{
+    _acked = seq;
+    _store.save(seq);
+}
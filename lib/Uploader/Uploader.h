@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <LogHistory.h>
+
+// Where the last acknowledged sequence number survives a restart
+class CursorStore
+{
+public:
+    virtual ~CursorStore() {}
+
+    virtual uint32_t load() = 0;
+    virtual bool save(uint32_t seq) = 0;
+};
+
+// Delivers the records with sequence numbers [startSeq, endSeq) to the API
+// as one request, reading them from the log or archive as it goes. Returns the HTTP
+// status code, or a negative value if the request could not be made.
+class BatchSender
+{
+public:
+    virtual ~BatchSender() {}
+
+    virtual int send(uint32_t startSeq, uint32_t endSeq) = 0;
+};
+
+// Uploads the data log in order, in batches, from a persisted cursor.
+//
+// The log itself is the upload queue: every measurement is appended to it,
+// and the uploader only remembers the sequence number of the last record
+// the API acknowledged. The cursor advances only on a 2xx reply, so a
+// failed or interrupted batch is sent again. Failures back off
+// exponentially. Records that moved into the archive are still sent from
+// there; only those gone from both before they were acknowledged are
+// skipped and counted.
+//
+// Live readings go out in batches of setBatchSize(). A backlog (after an
+// outage) is sent in larger windows of up to setWindow() records; the
+// sender streams them, so the window size does not change memory use, and
+// progress is committed after each window.
+class Uploader
+{
+public:
+    static const uint32_t MAX_BATCH = 50;
+
+    Uploader(const LogHistory &history, CursorStore &store, BatchSender &sender);
+
+    void begin();
+
+    void setBatchSize(uint32_t records);
+    void setWindow(uint32_t records) { _window = records; }
+    // Send a partial batch once records have waited this long
+    void setFlushInterval(uint32_t ms) { _flushMs = ms; }
+    void setBackoff(uint32_t initialMs, uint32_t maxMs);
+
+    // Send at most one batch if one is due. Returns true if a request was
+    // made, whatever its outcome.
+    bool service(uint32_t nowMs);
+
+    uint32_t ackedSeq() const { return _acked; }
+    uint32_t pending() const;
+    uint32_t failures() const { return _failures; }
+    uint32_t dropped() const { return _dropped; }
+    int lastStatus() const { return _lastStatus; }
+
+private:
+    void acknowledge(uint32_t seq);
+
+    LogHistory _history;
+    CursorStore &_store;
+    BatchSender &_sender;
+
+    uint32_t _batchSize;
+    uint32_t _window;
+    uint32_t _flushMs;
+    uint32_t _backoffInitialMs;
+    uint32_t _backoffMaxMs;
+
+    uint32_t _acked;
+    uint32_t _failures;
+    uint32_t _dropped;
+    int _lastStatus;
+    uint32_t _lastSendMs;
+    uint32_t _retryAtMs;
+};
+
+#ifdef ARDUINO
+
+#include <Preferences.h>
+
+// Cursor kept in the NVS partition, which does its own wear levelling
+class NvsCursorStore : public CursorStore
+{
+public:
+    NvsCursorStore(const char *ns, const char *key) : _ns(ns), _key(key) {}
+
+    uint32_t load() override
+    {
+        Preferences prefs;
+        if (!prefs.begin(_ns, true))
+        {
+            return 0;
+        }
+        uint32_t seq = prefs.getUInt(_key, 0);
+        prefs.end();
+        return seq;
+    }
+
+    bool save(uint32_t seq) override
+    {
+        Preferences prefs;
+        if (!prefs.begin(_ns, false))
+        {
+            return false;
+        }
+        bool ok = prefs.putUInt(_key, seq) == sizeof(seq);
+        prefs.end();
+        return ok;
+    }
+
+private:
+    const char *_ns;
+    const char *_key;
+};
+
+#endif
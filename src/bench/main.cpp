@@ -0,0 +1,720 @@
+// Benchmarks for the logging, query and upload hot paths, built for the
+// host by [env:bench]:
+//
+//     pio run -e bench && .pio/build/bench/program > results.jsonl
+//     python tools/bench_compare.py baseline.jsonl results.jsonl
+//
+// Every case runs against logs of 1k, 100k and 1M records (--sizes to
+// change) and prints one JSON line with throughput and latency
+// percentiles. The log lives in RAM by default so the numbers reflect the
+// code rather than the host's disk; --file measures through
+// FileLogBackend instead.
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <ArduinoJson.h>
+
+#include <DataLog.h>
+#include <JsonArena.h>
+#include <LogArchive.h>
+#include <LogBackend.h>
+#include <LogFormat.h>
+#include <LogHistory.h>
+#include <Query.h>
+#include <RecordStream.h>
+#include <SampleFilter.h>
+
+#define RECORD_INTERVAL_S 12
+#define BENCH_START_EPOCH 1704067200 // 2024-01-01 00:00:00
+#define BULK_WINDOW 500              // Uploader window, see UPLOAD_WINDOW
+#define SERIES_POINTS 300
+#define MAX_SIZES 8
+#define FILTER_READINGS 20000
+#define COMMIT_BATCH 21              // Staged records per commit, see STAGE_COMMIT_RECORDS
+#define JSON_ARENA_SIZE 2048         // As in src/main.cpp
+#define JSON_RESPONSE_SIZE 768
+
+// Flash stand-in held in memory
+class MemoryLogBackend : public LogBackend
+{
+public:
+    bool read(uint32_t offset, void *buffer, size_t length) override
+    {
+        if ((size_t)offset + length > _data.size())
+        {
+            return false;
+        }
+        memcpy(buffer, _data.data() + offset, length);
+        return true;
+    }
+
+    bool write(uint32_t offset, const void *buffer, size_t length) override
+    {
+        if ((size_t)offset + length > _data.size())
+        {
+            _data.resize((size_t)offset + length);
+        }
+        memcpy(_data.data() + offset, buffer, length);
+        return true;
+    }
+
+    bool sync() override { return true; }
+    size_t size() override { return _data.size(); }
+
+private:
+    std::vector<uint8_t> _data;
+};
+
+struct Options
+{
+    uint32_t sizes[MAX_SIZES];
+    int sizeCount;
+    bool file;
+    const char *path;
+    uint32_t seed;
+};
+
+static uint32_t rngState = 1;
+
+static uint32_t nextRandom()
+{
+    // xorshift32
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+static uint64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Per-run timings of one case
+class Samples
+{
+public:
+    void add(uint64_t ns) { _ns.push_back(ns); }
+
+    // One JSON line. items is the number of records (or documents) the runs
+    // processed in total and bytes the output they produced.
+    void report(const char *bench, uint32_t records, uint64_t items, uint64_t bytes)
+    {
+        if (_ns.empty())
+        {
+            return;
+        }
+        std::sort(_ns.begin(), _ns.end());
+        uint64_t total = 0;
+        for (size_t i = 0; i < _ns.size(); i++)
+        {
+            total += _ns[i];
+        }
+        double seconds = total / 1e9;
+        printf("{\"bench\":\"%s\",\"records\":%lu,\"runs\":%lu,\"items\":%llu,\"bytes\":%llu,"
+               "\"total_ns\":%llu,\"mean_ns\":%.1f,\"p50_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu,"
+               "\"items_per_s\":%.0f,\"mb_per_s\":%.2f}\n",
+               bench, (unsigned long)records, (unsigned long)_ns.size(),
+               (unsigned long long)items, (unsigned long long)bytes, (unsigned long long)total,
+               (double)total / _ns.size(), (unsigned long long)percentile(50),
+               (unsigned long long)percentile(99), (unsigned long long)_ns.back(),
+               seconds > 0 ? items / seconds : 0.0, seconds > 0 ? bytes / seconds / 1e6 : 0.0);
+        fflush(stdout);
+        _ns.clear();
+    }
+
+private:
+    uint64_t percentile(int p) const
+    {
+        size_t index = (_ns.size() - 1) * p / 100;
+        return _ns[index];
+    }
+
+    std::vector<uint64_t> _ns;
+};
+
+// Run count, scaled so the big logs do not take minutes per case
+static uint32_t runsFor(uint32_t records, uint64_t budgetRecords, uint32_t minimum, uint32_t maximum)
+{
+    uint64_t runs = budgetRecords / (records ? records : 1);
+    return (uint32_t)std::max<uint64_t>(minimum, std::min<uint64_t>(maximum, runs));
+}
+
+static LogRecord makeRecord(uint32_t i)
+{
+    // Levels wander through a daily cycle so the formatted widths vary
+    int32_t phase = (int32_t)(i % 7200) - 3600;
+    LogRecord record;
+    record.epoch = BENCH_START_EPOCH + i * RECORD_INTERVAL_S;
+    record.levelBlok = (int16_t)(phase / 8);
+    record.levelParit = (int16_t)(phase / 8 + 500);
+    record.rawDistance = (int16_t)(800 - phase / 8);
+    record.flags = 0;
+    return record;
+}
+
+// Every record is channel 0 of station 100
+static StationTable benchStations(const char *name)
+{
+    StationTable stations;
+    stations.set(0, 100, name);
+    return stations;
+}
+
+// Body size of a response, pulled the way the web server does
+static uint64_t drain(RecordStream &stream)
+{
+    uint8_t buffer[1436]; // One TCP segment
+    uint64_t total = 0;
+    size_t n;
+    while ((n = stream.fill(buffer, sizeof(buffer))) > 0)
+    {
+        total += n;
+    }
+    return total;
+}
+
+// Fill an empty log of capacity records
+static void benchAppend(DataLog &log, uint32_t records)
+{
+    Samples samples;
+    for (uint32_t i = 0; i < records; i++)
+    {
+        LogRecord record = makeRecord(i);
+        uint64_t start = nowNs();
+        log.append(record);
+        samples.add(nowNs() - start);
+    }
+    samples.report("append", records, records, (uint64_t)records * sizeof(LogRecord));
+}
+
+// Appends to a full log, each overwriting the oldest record
+static void benchAppendWrap(DataLog &log, uint32_t records)
+{
+    Samples samples;
+    uint32_t n = std::max<uint32_t>(1, records / 10);
+    uint32_t next = log.appended();
+    for (uint32_t i = 0; i < n; i++)
+    {
+        LogRecord record = makeRecord(next + i);
+        uint64_t start = nowNs();
+        log.append(record);
+        samples.add(nowNs() - start);
+    }
+    samples.report("append_wrap", records, n, (uint64_t)n * sizeof(LogRecord));
+}
+
+// The same, committed a staging batch at a time with one header write each
+static void benchAppendBatch(DataLog &log, uint32_t records)
+{
+    Samples samples;
+    uint32_t batches = std::max<uint32_t>(1, records / 10 / COMMIT_BATCH);
+    uint32_t next = log.appended();
+    LogRecord batch[COMMIT_BATCH];
+    for (uint32_t i = 0; i < batches; i++)
+    {
+        for (uint32_t j = 0; j < COMMIT_BATCH; j++)
+        {
+            batch[j] = makeRecord(next++);
+        }
+        uint64_t start = nowNs();
+        log.append(batch, COMMIT_BATCH);
+        samples.add(nowNs() - start);
+    }
+    samples.report("append_batch", records, batches * COMMIT_BATCH,
+                   (uint64_t)batches * COMMIT_BATCH * sizeof(LogRecord));
+}
+
+static void benchCount(DataLog &log, uint32_t records)
+{
+    Samples samples;
+    volatile uint32_t sink = 0;
+    for (uint32_t i = 0; i < 10000; i++)
+    {
+        uint64_t start = nowNs();
+        sink = log.count() + log.bytesUsed();
+        samples.add(nowNs() - start);
+    }
+    samples.report("count", records, 10000, 0);
+
+    // Everything /storageInfo reports about the log
+    for (uint32_t i = 0; i < 10000; i++)
+    {
+        uint64_t start = nowNs();
+        LogStats stats = log.stats();
+        samples.add(nowNs() - start);
+        sink = stats.oldestEpoch + stats.newestEpoch;
+    }
+    (void)sink;
+    samples.report("storage_stats", records, 10000, 0);
+
+    // Walking every record, as a count by scanning would
+    uint32_t runs = runsFor(records, 20000000, 3, 100);
+    for (uint32_t run = 0; run < runs; run++)
+    {
+        LogCursor cursor(log, log.firstSeq(), log.lastSeq() + 1);
+        LogRecord record;
+        uint32_t seq;
+        uint32_t seen = 0;
+        uint64_t start = nowNs();
+        while (cursor.next(record, seq))
+        {
+            seen++;
+        }
+        samples.add(nowNs() - start);
+        sink = seen;
+    }
+    samples.report("count_scan", records, (uint64_t)runs * log.count(), 0);
+}
+
+// Random from/to lookups of GET /data, without the response body
+static void benchRangeLookup(DataLog &log, uint32_t records)
+{
+    Samples samples;
+    uint32_t span = log.count() * RECORD_INTERVAL_S;
+    uint32_t oldest = makeRecord(log.appended() - log.count()).epoch;
+    volatile uint32_t sink = 0;
+    for (uint32_t i = 0; i < 10000; i++)
+    {
+        uint32_t a = oldest + nextRandom() % span;
+        uint32_t b = oldest + nextRandom() % span;
+        DataQuery query = {true, std::min(a, b), true, std::max(a, b), 0, 100};
+        uint64_t start = nowNs();
+        SeqRange range = resolveDataQuery(log, query);
+        samples.add(nowNs() - start);
+        sink = range.total;
+    }
+    (void)sink;
+    samples.report("range_lookup", records, 10000, 0);
+}
+
+// One day of CSV from a random point in the log
+static void benchRangeCsv(DataLog &log, uint32_t records)
+{
+    Samples samples;
+    uint32_t dayRecords = std::min<uint32_t>(log.count(), 86400 / RECORD_INTERVAL_S);
+    uint64_t items = 0;
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < 50; i++)
+    {
+        uint32_t first = log.firstSeq() + nextRandom() % (log.count() - dayRecords + 1);
+        uint64_t start = nowNs();
+        CsvRecordStream stream(log, first, first + dayRecords, benchStations("Bench Station"));
+        bytes += drain(stream);
+        samples.add(nowNs() - start);
+        items += dayRecords;
+    }
+    samples.report("range_csv_day", records, items, bytes);
+}
+
+// The dashboard chart over the whole log
+static void benchSeries(DataLog &log, uint32_t records)
+{
+    Samples samples;
+    SeriesQuery query = {false, 0, false, 0, false, 0};
+    uint32_t runs = runsFor(records, 20000000, 3, 200);
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < runs; i++)
+    {
+        uint64_t start = nowNs();
+        TimeRange range = resolveSeriesQuery(log, query);
+        SeriesRecordStream stream(log, range.from, range.to, SERIES_POINTS, SERIES_BLOK);
+        bytes += drain(stream);
+        samples.add(nowNs() - start);
+    }
+    samples.report("series_all", records, (uint64_t)runs * log.count(), bytes);
+}
+
+// Dashboard polling for the newest records
+static void benchSince(DataLog &log, uint32_t records)
+{
+    Samples samples;
+    uint32_t behind = std::min<uint32_t>(log.count(), 100);
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        uint64_t start = nowNs();
+        SinceRecordStream stream(log, log.lastSeq() - behind, 5000);
+        bytes += drain(stream);
+        samples.add(nowNs() - start);
+    }
+    samples.report("since_100", records, 1000ULL * behind, bytes);
+}
+
+// Upload bodies: records to the API's JSON, one uploader window at a time
+static void benchBulkJson(DataLog &log, uint32_t records)
+{
+    Samples samples;
+    uint32_t window = std::min<uint32_t>(log.count(), BULK_WINDOW);
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < 200; i++)
+    {
+        uint32_t first = log.firstSeq() + nextRandom() % (log.count() - window + 1);
+        uint64_t start = nowNs();
+        BulkRecordStream stream(log, first, first + window, benchStations("Bench \"Station\""));
+        bytes += drain(stream);
+        samples.add(nowNs() - start);
+    }
+    samples.report("bulk_json_window", records, 200ULL * window, bytes);
+}
+
+// Compressing the whole log into archive blocks, then the /getData export
+// decoding them again. The log itself is left as it was.
+static void benchArchive(DataLog &log, uint32_t records)
+{
+    MemoryLogBackend backend;
+    LogArchive archive(backend);
+    archive.format(log.count() / 64 + 1); // Blocks hold well over 64 records
+
+    Samples samples;
+    uint32_t blocks = 0;
+    for (;;)
+    {
+        uint64_t start = nowNs();
+        if (archive.archive(log, log.lastSeq() + 1, 1, benchStations("Bench Station")) == 0)
+        {
+            break;
+        }
+        samples.add(nowNs() - start);
+        blocks++;
+    }
+    samples.report("archive_block", records, blocks, (uint64_t)blocks * ARCHIVE_BLOCK_SIZE);
+
+    Samples csv;
+    uint64_t start = nowNs();
+    LogHistory history(log, &archive);
+    CsvRecordStream stream(history, history.firstSeq(), log.lastSeq() + 1, benchStations("Bench Station"));
+    uint64_t bytes = drain(stream);
+    csv.add(nowNs() - start);
+    csv.report("archive_csv", records, log.count(), bytes);
+}
+
+// Dropping old records, which replaced rewriting the CSV file
+static void benchDiscard(DataLog &log, uint32_t records)
+{
+    Samples samples;
+    uint32_t runs = 1000;
+    uint32_t step = std::max<uint32_t>(1, log.count() / (2 * runs));
+    uint32_t done = 0;
+    for (; done < runs && log.count() > step; done++)
+    {
+        uint64_t start = nowNs();
+        log.discardOldest(step);
+        samples.add(nowNs() - start);
+    }
+    samples.report("discard_oldest", records, done, 0);
+}
+
+// Migration of the legacy /data.csv into the log
+static void benchCsvParse(uint32_t records)
+{
+    std::vector<char> lines;
+    char row[256];
+    for (uint32_t i = 0; i < records; i++)
+    {
+        size_t n = formatCsvRow(row, sizeof(row), 100, "Bench Station", makeRecord(i));
+        row[n - 1] = '\0'; // Rows are parsed without the newline
+        lines.insert(lines.end(), row, row + n);
+    }
+
+    Samples samples;
+    const char *line = lines.data();
+    const char *end = line + lines.size();
+    LogRecord record;
+    uint32_t parsed = 0;
+    uint64_t start = nowNs();
+    for (; line < end; line += strlen(line) + 1)
+    {
+        parsed += parseCsvRow(line, record) ? 1 : 0;
+    }
+    samples.add(nowNs() - start);
+    if (parsed != records)
+    {
+        fprintf(stderr, "csv_parse: parsed %lu of %lu rows\n", (unsigned long)parsed, (unsigned long)records);
+    }
+    samples.report("csv_parse", records, parsed, lines.size());
+}
+
+// One full measurement through each filter mode: the default 15 samples,
+// one in twenty a stray echo. Times add() and result(), not the sensor.
+static void benchFilter()
+{
+    for (uint8_t mode = FILTER_MEAN; mode <= FILTER_HAMPEL; mode++)
+    {
+        FilterConfig config;
+        config.mode = (FilterMode)mode;
+        SampleFilter filter(config);
+        Samples samples;
+        for (uint32_t i = 0; i < FILTER_READINGS; i++)
+        {
+            float values[SampleFilter::MAX_SAMPLES];
+            for (uint8_t n = 0; n < config.maxSamples; n++)
+            {
+                uint32_t r = nextRandom();
+                values[n] = (r % 20 == 0) ? (float)(r % 800) / 10.0f : 80.0f + (float)(r % 31) / 10.0f - 1.5f;
+            }
+
+            uint64_t start = nowNs();
+            filter.reset();
+            for (uint8_t n = 0; n < config.maxSamples; n++)
+            {
+                filter.add(values[n]);
+            }
+            FilteredReading reading = filter.result();
+            samples.add(nowNs() - start);
+            if (reading.distance < 0)
+            {
+                fprintf(stderr, "filter: no distance\n");
+            }
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "filter_%s", filterModeName((FilterMode)mode));
+        samples.report(name, 0, FILTER_READINGS, 0);
+    }
+}
+
+// GET /getConfig's document, with the same fields and value types as
+// handleGetConfig() in src/main.cpp
+static void fillConfig(JsonDocument &doc, uint32_t i)
+{
+    doc["stationId"] = 100;
+    doc["stationName"] = "Bench Station";
+    doc["measurementInterval"] = 12000UL;
+    doc["adaptiveSampling"] = true;
+    doc["maxMeasurementInterval"] = 600000UL;
+    doc["fastRateThreshold"] = 0.5f;
+    doc["calibrationOffset"] = 1.5f;
+    doc["sensorType"] = 0;
+    doc["sensorToBottomDistance"] = 100.0f;
+    doc["sensorToZeroBlokDistance"] = 50.0f;
+    doc["operationMode"] = "ONLINE";
+    doc["wifiSSID"] = "station-wifi";
+    doc["wifiPassword"] = "password";
+    doc["apiEndpoint"] = "https://api.example.com/water_level.php";
+    doc["apiToken"] = "0123456789abcdef0123456789abcdef";
+    doc["dataSyncInterval"] = 1UL;
+    doc["uploadBatchSize"] = 10;
+    doc["filterMode"] = "hampel";
+    doc["samplesPerReading"] = 15;
+    doc["flushEvery"] = 10;
+    JsonObject dateTime = doc["dateTime"].to<JsonObject>();
+    dateTime["year"] = 2024;
+    dateTime["month"] = 1;
+    dateTime["day"] = 1;
+    dateTime["hour"] = (int)(i % 24);
+    dateTime["minute"] = (int)(i % 60);
+    dateTime["second"] = (int)(i % 60);
+}
+
+// As sendJson(): a stack buffer, or the heap for a document that outgrows it
+static size_t sendJson(JsonDocument &doc, std::string &heapBody)
+{
+    char body[JSON_RESPONSE_SIZE];
+    if (measureJson(doc) < sizeof(body))
+    {
+        return serializeJson(doc, body, sizeof(body));
+    }
+    heapBody.clear();
+    serializeJson(doc, heapBody);
+    return heapBody.size();
+}
+
+// GET /getConfig and GET /currentLevel as the handlers build them now (a
+// JsonDocument in a stack arena; snprintf), and as they did before, with a
+// heap JsonDocument serialized into a growing string. The _heap runs are
+// the baseline the others are compared against.
+static void benchJson()
+{
+    Samples config;
+    Samples configHeap;
+    Samples level;
+    Samples levelHeap;
+    uint64_t configBytes = 0;
+    uint64_t levelBytes = 0;
+    std::string out;
+    uint32_t fallbacks = JsonArena::fallbacks();
+    for (uint32_t i = 0; i < 20000; i++)
+    {
+        uint64_t start = nowNs();
+        {
+            JsonArenaBuffer<JSON_ARENA_SIZE> arena;
+            JsonDocument doc(&arena);
+            fillConfig(doc, i);
+            configBytes += sendJson(doc, out);
+        }
+        config.add(nowNs() - start);
+
+        start = nowNs();
+        {
+            JsonDocument doc;
+            fillConfig(doc, i);
+            out.clear();
+            serializeJson(doc, out);
+        }
+        configHeap.add(nowNs() - start);
+
+        float blok = 12.5f + (i % 100) * 0.1f;
+        start = nowNs();
+        {
+            char body[192];
+            levelBytes += snprintf(body, sizeof(body),
+                                   "{\"waterLevelBlok\":%.2f,\"waterLevelParit\":%.2f,\"rawDistance\":%.2f,"
+                                   "\"quality\":%.2f,\"operationMode\":\"%s\",\"internetConnection\":%s}",
+                                   blok, 62.5f, 37.5f, 0.92f, "ONLINE", "true");
+        }
+        level.add(nowNs() - start);
+
+        start = nowNs();
+        {
+            JsonDocument doc;
+            doc["waterLevelBlok"] = blok;
+            doc["waterLevelParit"] = 62.5f;
+            doc["rawDistance"] = 37.5f;
+            doc["quality"] = 0.92f;
+            doc["operationMode"] = "ONLINE";
+            doc["internetConnection"] = true;
+            out.clear();
+            serializeJson(doc, out);
+        }
+        levelHeap.add(nowNs() - start);
+    }
+    if (JsonArena::fallbacks() != fallbacks)
+    {
+        fprintf(stderr, "json: /getConfig outgrew its %u-byte arena\n", (unsigned)JSON_ARENA_SIZE);
+    }
+    config.report("json_get_config", 0, 20000, configBytes);
+    configHeap.report("json_get_config_heap", 0, 20000, configBytes);
+    level.report("json_current_level", 0, 20000, levelBytes);
+    levelHeap.report("json_current_level_heap", 0, 20000, levelBytes);
+}
+
+static bool parseSizes(const char *text, Options &options)
+{
+    options.sizeCount = 0;
+    while (*text && options.sizeCount < MAX_SIZES)
+    {
+        char *end;
+        unsigned long size = strtoul(text, &end, 10);
+        if (end == text || size == 0)
+        {
+            return false;
+        }
+        options.sizes[options.sizeCount++] = (uint32_t)size;
+        text = (*end == ',') ? end + 1 : end;
+    }
+    return options.sizeCount > 0;
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+    options.sizes[0] = 1000;
+    options.sizes[1] = 100000;
+    options.sizes[2] = 1000000;
+    options.sizeCount = 3;
+    options.file = false;
+    options.path = "bench_data.bin";
+    options.seed = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--sizes") == 0)
+        {
+            if (!parseSizes(argv[++i], options))
+            {
+                return false;
+            }
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--seed") == 0)
+        {
+            options.seed = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--file") == 0)
+        {
+            options.file = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                options.path = argv[++i];
+            }
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--sizes 1000,100000,1000000] [--file [PATH]] [--seed N]\n", argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool runSize(const Options &options, uint32_t records)
+{
+    MemoryLogBackend memory;
+    FileLogBackend file(options.path);
+    LogBackend *backend = &memory;
+    if (options.file)
+    {
+        remove(options.path);
+        if (!file.open())
+        {
+            fprintf(stderr, "cannot create %s\n", options.path);
+            return false;
+        }
+        backend = &file;
+    }
+
+    DataLog log(*backend);
+    if (!log.format(records))
+    {
+        fprintf(stderr, "cannot format a log of %lu records\n", (unsigned long)records);
+        return false;
+    }
+
+    benchAppend(log, records);
+    benchAppendWrap(log, records);
+    benchAppendBatch(log, records);
+    benchCount(log, records);
+    benchRangeLookup(log, records);
+    benchRangeCsv(log, records);
+    benchSeries(log, records);
+    benchSince(log, records);
+    benchBulkJson(log, records);
+    benchArchive(log, records);
+    benchDiscard(log, records);
+    benchCsvParse(records);
+
+    if (options.file)
+    {
+        file.close();
+        remove(options.path);
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        return 2;
+    }
+    rngState = options.seed ? options.seed : 1;
+
+    printf("{\"bench\":\"meta\",\"backend\":\"%s\",\"record_size\":%u,\"compiler\":\"%s\"}\n",
+           options.file ? "file" : "memory", (unsigned)sizeof(LogRecord), __VERSION__);
+    for (int i = 0; i < options.sizeCount; i++)
+    {
+        if (!runSize(options, options.sizes[i]))
+        {
+            return 1;
+        }
+    }
+    benchFilter();
+    benchJson();
+    return 0;
+}
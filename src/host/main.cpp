@@ -0,0 +1,472 @@
+// Host build of the station: runs the real data log, uploader and web
+// response code against simulated hardware (sensor, clock, flash file,
+// API server), so these paths can be profiled and sanitized on Linux.
+//
+//     pio run -e native && .pio/build/native/program --days 7
+//
+// The simulation is deterministic for a given seed; timings are printed as
+// JSON lines.
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <AdaptiveScheduler.h>
+#include <Clock.h>
+#include <DataLog.h>
+#include <DistanceSensor.h>
+#include <HttpBulkSender.h>
+#include <HttpTransport.h>
+#include <InterleavedSampler.h>
+#include <Levels.h>
+#include <LogArchive.h>
+#include <LogBackend.h>
+#include <LogFormat.h>
+#include <LogHistory.h>
+#include <LogStage.h>
+#include <Query.h>
+#include <RecordStream.h>
+#include <SampleFilter.h>
+#include <Uploader.h>
+
+#define MEASUREMENT_INTERVAL_MS 12000 // Also the loop tick: the shortest interval
+#define MAX_INTERVAL_MS 600000
+#define SIM_START_EPOCH 1704067200 // 2024-01-01 00:00:00
+#define STAGE_CAPACITY 32
+#define STAGE_COMMIT_RECORDS 21
+#define STAGE_COMMIT_MS 300000
+#define MAX_CHANNELS 3
+#define SENSOR_LATENCY_MS 100 // A01NYUB request to frame
+#define SENSOR_RECOVERY_MS 50
+
+struct Options
+{
+    uint32_t days;
+    uint32_t seed;
+    uint32_t capacity;
+    uint32_t archiveBlocks;
+    uint32_t channels;
+    const char *path;
+    const char *archivePath;
+    bool fixed;
+    bool unstaged;
+};
+
+// Cursor kept in memory; the host run starts from scratch every time
+class MemoryCursorStore : public CursorStore
+{
+public:
+    MemoryCursorStore() : _seq(0), _saves(0) {}
+
+    uint32_t load() override { return _seq; }
+    bool save(uint32_t seq) override
+    {
+        _seq = seq;
+        _saves++;
+        return true;
+    }
+
+    uint32_t saves() const { return _saves; }
+
+private:
+    uint32_t _seq;
+    uint32_t _saves;
+};
+
+static uint64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static void report(const char *name, uint64_t ops, uint64_t ns, uint64_t bytes)
+{
+    printf("{\"name\":\"%s\",\"ops\":%llu,\"ns\":%llu,\"ns_per_op\":%.1f,\"bytes\":%llu}\n",
+           name, (unsigned long long)ops, (unsigned long long)ns,
+           ops ? (double)ns / ops : 0.0, (unsigned long long)bytes);
+}
+
+// Drain a response body the way the web server would, in socket-sized pieces
+static uint64_t drain(RecordStream &stream)
+{
+    uint8_t buffer[1436]; // One TCP segment
+    uint64_t total = 0;
+    size_t n;
+    while ((n = stream.fill(buffer, sizeof(buffer))) > 0)
+    {
+        total += n;
+    }
+    return total;
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+    options.days = 7;
+    options.seed = 1;
+    options.capacity = 16384;
+    options.archiveBlocks = 2048;
+    options.channels = 1;
+    options.path = "sim_data.bin";
+    options.archivePath = "sim_archive.bin";
+    options.fixed = false;
+    options.unstaged = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--days") == 0)
+        {
+            options.days = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--seed") == 0)
+        {
+            options.seed = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--capacity") == 0)
+        {
+            options.capacity = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--archive-blocks") == 0)
+        {
+            options.archiveBlocks = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--channels") == 0)
+        {
+            options.channels = strtoul(argv[++i], nullptr, 10);
+            if (options.channels < 1 || options.channels > MAX_CHANNELS)
+            {
+                fprintf(stderr, "--channels must be 1 to %d\n", MAX_CHANNELS);
+                return false;
+            }
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--log") == 0)
+        {
+            options.path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--fixed") == 0)
+        {
+            options.fixed = true;
+        }
+        else if (strcmp(argv[i], "--unstaged") == 0)
+        {
+            options.unstaged = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--days N] [--seed N] [--capacity RECORDS] [--archive-blocks N] "
+                            "[--channels N] [--log PATH] [--fixed] [--unstaged]\n",
+                    argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        return 2;
+    }
+
+    remove(options.path);
+    FileLogBackend backend(options.path);
+    DataLog log(backend);
+    if (!backend.open() || !log.begin(options.capacity))
+    {
+        fprintf(stderr, "cannot create %s\n", options.path);
+        return 1;
+    }
+    remove(options.archivePath);
+    FileLogBackend archiveBackend(options.archivePath);
+    LogArchive archive(archiveBackend);
+    if (!archiveBackend.open() || !archive.begin(options.archiveBlocks))
+    {
+        fprintf(stderr, "cannot create %s\n", options.archivePath);
+        return 1;
+    }
+
+    // --unstaged appends every reading straight to the log, as before staging
+    static StageArea<STAGE_CAPACITY> stageArea;
+    LogStage stage(log, stageArea);
+    stage.configure(options.unstaged ? 1 : STAGE_COMMIT_RECORDS, STAGE_COMMIT_MS);
+    stage.recover(0);
+
+    SimClock clock(SIM_START_EPOCH);
+    // One sample in twenty is a stray echo for the filter to reject
+    // a daily 40 cm flash flood for the scheduler to catch. --channels adds
+    // sensors downstream, each with its own noise sequence, all timed like
+    // the A01NYUB and measured in one interleaved pass.
+    SimSensor sensor(clock, options.seed, 80.0f, 25.0f, 1.5f, 0.01f, 0.05f, 40.0f);
+    SimSensor downstream(clock, options.seed + 1, 110.0f, 20.0f, 1.5f, 0.01f, 0.05f, 30.0f);
+    SimSensor outlet(clock, options.seed + 2, 140.0f, 15.0f, 2.0f, 0.02f, 0.05f, 20.0f);
+    SimSensor *sensors[MAX_CHANNELS] = {&sensor, &downstream, &outlet};
+    SampleFilter filters[MAX_CHANNELS];
+    SamplerSlot slots[MAX_CHANNELS];
+    for (uint32_t i = 0; i < options.channels; i++)
+    {
+        sensors[i]->setTiming(SENSOR_LATENCY_MS, SENSOR_RECOVERY_MS);
+        slots[i].sensor = sensors[i];
+        slots[i].filter = &filters[i];
+    }
+    // Time spent sampling is kept apart, so the sensors see the same water
+    // whatever the number of channels
+    SimClock samplerClock(0);
+    InterleavedSampler sampler(samplerClock);
+
+    // --fixed measures every tick, as before adaptive sampling
+    ScheduleConfig schedule;
+    schedule.minIntervalMs = MEASUREMENT_INTERVAL_MS;
+    schedule.normalIntervalMs = MEASUREMENT_INTERVAL_MS;
+    schedule.maxIntervalMs = options.fixed ? MEASUREMENT_INTERVAL_MS : MAX_INTERVAL_MS;
+    schedule.fastRateCmPerMin = 0.5f;
+    schedule.stableCm = 1.0f;
+    AdaptiveScheduler scheduler;
+    scheduler.configure(schedule);
+    SimHttpTransport server;
+    server.setKeepAliveLimit(100);
+    MemoryCursorStore cursor;
+    LogHistory logHistory(log, &archive); // The uploader reads the archive ahead of the ring
+    HttpBulkSender sender(logHistory, server);
+    sender.setEndpoint("https://api.example.com/water_level.php", "token");
+    sender.setStation(100, "Simulated Station");
+    sender.setStation(101, "Simulated Downstream", 1);
+    sender.setStation(102, "Simulated Outlet", 2);
+    StationTable stations;
+    stations.set(0, 100, "Simulated Station");
+    stations.set(1, 101, "Simulated Downstream");
+    stations.set(2, 102, "Simulated Outlet");
+    Uploader uploader(logHistory, cursor, sender);
+    uploader.setBatchSize(10);
+    uploader.setWindow(500);
+    uploader.begin();
+
+    Calibration calibrations[MAX_CHANNELS];
+    for (uint32_t i = 0; i < MAX_CHANNELS; i++)
+    {
+        calibrations[i].sensorToZeroBlokDistance = 50.0f + 30.0f * i;
+        calibrations[i].sensorToBottomDistance = 100.0f + 40.0f * i;
+        calibrations[i].calibrationOffset = 0.0f;
+    }
+
+    // One loop() pass per step; a measurement is taken when the scheduler's
+    // interval has passed. The uplink is down for two hours a day, and the
+    // API rejects every 50th request, so the backlog and retry paths are
+    // exercised as well as live batches.
+    uint64_t steps = (uint64_t)options.days * 86400000ULL / MEASUREMENT_INTERVAL_MS;
+    uint32_t lastMeasurement = 0;
+    uint64_t floodReadings = 0; // Taken while the flood rises, 14:00-14:20
+    uint64_t appendNs = 0;
+    uint64_t uploadNs = 0;
+    uint64_t appended = 0;
+    uint64_t uploads = 0;
+    uint64_t filterNs = 0;
+    uint64_t archiveNs = 0;
+    uint64_t archived = 0;
+    std::vector<LogRecord> history; // Everything appended, to check the archive against
+    uint64_t readings = 0;
+    uint64_t passes = 0;
+    uint64_t passMs = 0;       // Interleaved
+    uint64_t sequentialMs = 0; // Sum of each channel's own time, as one after another would take
+    uint64_t channelRecords[MAX_CHANNELS] = {0};
+    double qualitySum = 0;
+    for (uint64_t step = 0; step < steps; step++)
+    {
+        clock.advance(MEASUREMENT_INTERVAL_MS);
+        uint32_t secondOfDay = clock.epoch() % 86400;
+        server.setOffline(secondOfDay >= 3600 && secondOfDay < 3 * 3600);
+        server.setStatus(server.requests() % 50 == 49 ? 503 : 200);
+
+        stage.service(clock.millis());
+        if (clock.millis() - lastMeasurement < scheduler.interval())
+        {
+            uint64_t start = nowNs();
+            if (uploader.service(clock.millis()))
+            {
+                uploads++;
+            }
+            uploadNs += nowNs() - start;
+            continue;
+        }
+        lastMeasurement = clock.millis();
+
+        uint64_t start = nowNs();
+        passMs += sampler.read(slots, options.channels);
+        filterNs += nowNs() - start;
+        passes++;
+        for (uint32_t channel = 0; channel < options.channels; channel++)
+        {
+            const FilteredReading &reading = slots[channel].result;
+            sequentialMs += reading.attempts * (SENSOR_LATENCY_MS + SENSOR_RECOVERY_MS);
+            readings++;
+            float distance = reading.distance;
+            if (distance < 0)
+            {
+                continue;
+            }
+            qualitySum += reading.quality;
+            Levels levels = computeLevels(distance, calibrations[channel]);
+            // As on the device, channel 0 sets the pace
+            if (channel == 0)
+            {
+                scheduler.update(clock.millis(), levels.blok, levels.parit);
+                if (secondOfDay >= 14 * 3600 && secondOfDay < 14 * 3600 + 20 * 60)
+                {
+                    floodReadings++;
+                }
+            }
+            LogRecord record;
+            record.epoch = clock.epoch();
+            record.levelBlok = toFixedLevel(levels.blok);
+            record.levelParit = toFixedLevel(levels.parit);
+            record.rawDistance = toFixedLevel(levels.raw);
+            record.flags = toQualityFlags(reading.quality) | toChannelFlags(channel);
+            channelRecords[channel]++;
+
+            start = nowNs();
+            stage.add(record, clock.millis());
+            appendNs += nowNs() - start;
+            appended++;
+            history.push_back(record);
+
+            // As archiveOldRecords() on the device
+            if (log.count() >= log.capacity() / 4 * 3)
+            {
+                start = nowNs();
+                archived += archive.archive(log, log.lastSeq() + 1 - log.capacity() / 2, 2, stations);
+                log.discardOldest(archive.liveStart(log) - log.firstSeq());
+                archiveNs += nowNs() - start;
+            }
+        }
+
+        start = nowNs();
+        if (uploader.service(clock.millis()))
+        {
+            uploads++;
+        }
+        uploadNs += nowNs() - start;
+    }
+
+    // Let the uploader catch up with whatever the last outage left behind
+    stage.commit(clock.millis());
+    server.setOffline(false);
+    server.setStatus(200);
+    while (uploader.pending() > 0)
+    {
+        clock.advance(MEASUREMENT_INTERVAL_MS);
+        uint64_t start = nowNs();
+        uploader.service(clock.millis());
+        uploadNs += nowNs() - start;
+        uploads++;
+    }
+
+    uint64_t samples = 0;
+    for (uint32_t i = 0; i < options.channels; i++)
+    {
+        samples += sensors[i]->samples();
+    }
+    report("acquire", readings, filterNs, 0);
+    printf("{\"name\":\"filter\",\"samples_per_reading\":%.2f,\"mean_quality\":%.3f}\n",
+           readings ? (double)samples / readings : 0.0, appended ? qualitySum / appended : 0.0);
+    printf("{\"name\":\"channels\",\"channels\":%u,\"records\":[%llu,%llu,%llu],\"pass_ms\":%.0f,"
+           "\"sequential_ms\":%.0f}\n",
+           options.channels, (unsigned long long)channelRecords[0], (unsigned long long)channelRecords[1],
+           (unsigned long long)channelRecords[2], passes ? (double)passMs / passes : 0.0,
+           passes ? (double)sequentialMs / passes : 0.0);
+    printf("{\"name\":\"schedule\",\"readings\":%llu,\"per_day\":%.0f,\"flood_readings_per_day\":%.1f}\n",
+           (unsigned long long)readings, (double)readings / options.days,
+           (double)floodReadings / options.days);
+    report("append", appended, appendNs, appended * sizeof(LogRecord));
+    LogStats logStats = log.stats();
+    StageStats stageStats = stage.stats();
+    printf("{\"name\":\"flash_writes\",\"commits\":%u,\"records_per_commit\":%.1f,\"syncs_per_record\":%.3f,"
+           "\"bytes_per_record\":%.1f,\"max_commit_us\":%u}\n",
+           stageStats.commits, stageStats.commits ? (double)stageStats.committed / stageStats.commits : 0.0,
+           appended ? (double)logStats.syncs / appended : 0.0,
+           appended ? (double)logStats.bytesWritten / appended : 0.0, stageStats.maxCommitUs);
+    report("archive", archived, archiveNs, (uint64_t)archive.blocks() * ARCHIVE_BLOCK_SIZE);
+
+    // Every record must come back, from the archive or the log, unchanged
+    uint32_t mismatches = 0;
+    uint32_t decoded = 0;
+    uint64_t start = nowNs();
+    ArchiveCursor archiveCursor(archive, archive.firstBlock());
+    LogRecord record;
+    uint32_t seq;
+    while (archiveCursor.next(record, seq))
+    {
+        decoded++;
+        mismatches += (seq == 0 || seq > history.size() ||
+                       memcmp(&record, &history[seq - 1], sizeof(record)) != 0) ? 1 : 0;
+    }
+    uint64_t decodeNs = nowNs() - start;
+    LogCursor logCursor(log, archive.liveStart(log), log.lastSeq() + 1);
+    while (logCursor.next(record, seq))
+    {
+        decoded++;
+        mismatches += (seq == 0 || seq > history.size() ||
+                       memcmp(&record, &history[seq - 1], sizeof(record)) != 0) ? 1 : 0;
+    }
+    ArchiveStats archiveStats = archive.stats();
+    printf("{\"name\":\"archive_size\",\"records\":%u,\"blocks\":%u,\"bytes_per_record\":%.2f,"
+           "\"decoded\":%u,\"of\":%llu,\"mismatches\":%u,\"decode_ns_per_record\":%.1f}\n",
+           archiveStats.records, archiveStats.blocks,
+           archiveStats.records ? (double)archiveStats.bytesUsed / archiveStats.records : 0.0,
+           decoded, (unsigned long long)appended, mismatches,
+           archiveStats.records ? (double)decodeNs / archiveStats.records : 0.0);
+    report("upload", uploads, uploadNs, server.bytesReceived());
+    printf("{\"name\":\"uploader\",\"acked\":%u,\"last_seq\":%u,\"dropped\":%u,\"requests\":%u,"
+           "\"connects\":%u,\"cursor_saves\":%u}\n",
+           uploader.ackedSeq(), log.lastSeq(), uploader.dropped(), server.requests(),
+           server.connects(), cursor.saves());
+
+    // Responses the dashboard asks for
+    SeriesQuery seriesQuery = {false, 0, false, 0, true, 86400};
+    TimeRange day = resolveSeriesQuery(log, seriesQuery);
+    start = nowNs();
+    SeriesRecordStream series(log, day.from, day.to, 300, SERIES_BLOK, 0);
+    uint64_t bytes = drain(series);
+    report("series_day", 1, nowNs() - start, bytes);
+
+    start = nowNs();
+    SinceRecordStream since(log, log.lastSeq() - 100, 5000, 0);
+    bytes = drain(since);
+    report("since_100", 1, nowNs() - start, bytes);
+
+    DataQuery dataQuery = {false, 0, false, 0, -144, 144};
+    SeqRange latest = resolveDataQuery(log, dataQuery);
+    start = nowNs();
+    CsvRecordStream csvLatest(log, latest.first, latest.end, stations);
+    bytes = drain(csvLatest);
+    report("csv_latest_144", 1, nowNs() - start, bytes);
+
+    start = nowNs();
+    CsvRecordStream csvAll(log, log.firstSeq(), log.lastSeq() + 1, stations);
+    bytes = drain(csvAll);
+    report("csv_all", log.count(), nowNs() - start, bytes);
+
+    start = nowNs();
+    CsvRecordStream csvHistory(logHistory, logHistory.firstSeq(), log.lastSeq() + 1, stations);
+    bytes = drain(csvHistory);
+    report("csv_history", decoded, nowNs() - start, bytes);
+
+    bool ok = uploader.ackedSeq() == log.lastSeq();
+    if (!ok)
+    {
+        fprintf(stderr, "uploader stopped at %u of %u\n", uploader.ackedSeq(), log.lastSeq());
+    }
+    if (decoded != appended || mismatches > 0)
+    {
+        fprintf(stderr, "history: %u of %llu records back, %u differ\n", decoded,
+                (unsigned long long)appended, mismatches);
+        ok = false;
+    }
+    backend.close();
+    remove(options.path);
+    archiveBackend.close();
+    remove(options.archivePath);
+    return ok ? 0 : 1;
+}
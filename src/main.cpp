@@ -1,13 +1,41 @@
 #include <Arduino.h>
 #include <WiFi.h>
-#include <WebServer.h>
+#include <AsyncTCP.h>
+#include <ESPAsyncWebServer.h>
 #include <SPIFFS.h>
 #include <RTClib.h>
 #include <ArduinoJson.h>
 #include <esp_task_wdt.h>
 #include <Wire.h>
 #include <esp_wifi.h>
+#include <esp_sleep.h>
 #include <HTTPClient.h>
+#include <Preferences.h>
+#include <DataLog.h>
+#include <LogArchive.h>
+#include <LogHistory.h>
+#include <LogStage.h>
+#include <LogFormat.h>
+#include <Downsample.h>
+#include <SpscQueue.h>
+#include <EventLog.h>
+#include <RecordStream.h>
+#include <Uploader.h>
+#include <HttpBulkSender.h>
+#include <Query.h>
+#include <Clock.h>
+#include <DistanceSensor.h>
+#include <InterleavedSampler.h>
+#include <SampleFilter.h>
+#include <HttpTransport.h>
+#include <Levels.h>
+#include <AdaptiveScheduler.h>
+#include <SleepState.h>
+#include <BootTimeline.h>
+#include <TextBuffer.h>
+#include <JsonArena.h>
+#include <memory>
+#include <mutex>
 
 // Pin Definitions for ESP32-DOIT-DevKit-V1
 #define TRIGGER_PIN 2 // GPIO26
@@ -18,16 +46,65 @@
 // Add new pin definitions for A01NYUB
 #define A01_RX 16 // GPIO16
 #define A01_TX 17 // GPIO17
+// Second A01NYUB, on UART1 routed to free pins
+#define A01_AUX_RX 32 // GPIO32
+#define A01_AUX_TX 33 // GPIO33
 
 // Constants
 #define WDT_TIMEOUT 180 // 3 minutes watchdog timeout
-#define CONFIG_FILE "/config.json"
-#define DATA_FILE "/data.csv"
+#define ACQUISITION_CORE 0 // loop() and the web server run on core 1
+#define ACQUISITION_STACK_SIZE 4096
+#define CONFIG_NAMESPACE "config"
+#define CONFIG_VERSION 1 // Bump when a key changes meaning, and migrate in loadConfig()
+#define LEGACY_CONFIG_FILE "/config.json" // Imported into NVS once, then removed
+#define DATA_FILE "/data.bin"
+#define LEGACY_DATA_FILE "/data.csv"
+#define ARCHIVE_FILE "/archive.bin"
+#define STORAGE_RESERVE_PERCENT 25 // Share of SPIFFS free space left unallocated
+#define LOG_RING_RECORDS 16384     // Uncompressed recent history (192 KB); the archive gets the rest
+#define ARCHIVE_BLOCKS_PER_PASS 2  // Bounds the time one append spends archiving
+#define STAGE_CAPACITY 32          // Readings held in RAM between flash commits
+#define STAGE_COMMIT_RECORDS 21    // 252 bytes, just under one 256-byte SPIFFS page
+#define STAGE_COMMIT_MS 300000     // Longest a reading waits for its commit
 #define MAX_CLIENTS 10
-
-#define SERIAL_BUFFER_SIZE 20
-String serialBuff[SERIAL_BUFFER_SIZE];
-int serialBufferIndex = 0;
+#define MAX_EVENT_CLIENTS 4     // Open /events streams; lwIP only has a handful of sockets
+#define RESTART_DELAY_MS 1000   // Lets the /restart reply reach the browser
+#define INDEX_ETAG_FILE "/index.html.etag" // Written with index.html.gz by tools/build_web.py
+#define INDEX_MAX_AGE 86400     // Seconds browsers reuse the page before revalidating
+#define EVENT_HEARTBEAT_MS 15000
+#define MAX_QUERY_RECORDS 5000 // Upper bound on rows returned by one /data query
+#define MAX_SERIES_POINTS 1000 // Upper bound on buckets returned by /series
+#define UPLOAD_BACKOFF_MS 5000       // First retry delay after a failed upload
+#define UPLOAD_BACKOFF_MAX_MS 600000 // Retry at least every 10 minutes
+#define UPLOAD_WINDOW 500            // Most records per request when catching up
+#define UPLOAD_TIMEOUT_MS 15000
+
+#define JSON_ARENA_SIZE 2048    // One ArduinoJson slot pool plus the copied strings
+#define JSON_RESPONSE_SIZE 768  // Larger documents are sent from the heap
+#define STATS_LOG_INTERVAL 300000
+#define DEFAULT_SAMPLES_PER_READING 15 // Most pings per measurement; fewer once they agree
+#define DEFAULT_MAX_INTERVAL 600000   // Slowest adaptive interval on flat water
+#define DEFAULT_FAST_RATE 0.5         // cm/min at which the interval starts shrinking
+#define STABLE_CHANGE_CM 1.0          // Change between readings treated as noise
+#define SLEEP_BUFFER_SIZE 64          // Readings held in RTC memory between flushes
+#define DEFAULT_FLUSH_EVERY 10        // Low-power wakeups per write to flash
+#define LOW_POWER_AWAKE_MS 300000     // Stay up for configuration after a cold boot
+#define LOW_POWER_UPLOAD_MS 60000     // Longest a flush spends uploading
+#define MIN_SLEEP_MS 1000
+#define SLEEP_STATS_FILE "/sleep_stats.json"
+// Rough supply currents for the charge estimate in /sleepStats
+#define AWAKE_CURRENT_MA 45.0f
+#define SLEEP_CURRENT_MA 0.15f
+
+#define EVENT_LOG_SIZE 32     // Recent log lines kept for /serial; a power of two
+#define SERIAL_LINE_LENGTH 160
+#define SERIAL_TX_BUFFER 2048 // UART driver buffer the log drains into
+#define WIFI_JOIN_TIMEOUT_MS 10000 // Per network, custom then default
+#define WIFI_POLL_MS 50
+#define RTC_PROBE_ATTEMPTS 3
+#define RTC_I2C_TIMEOUT_MS 50
+#define BOOT_TIMING_SIZE 768
+#define MAX_CHANNELS 3 // One per sensor port; at most LOG_CHANNELS
 
 // Add this at the top with other global variables
 bool rtcAvailable = false;
@@ -35,18 +112,61 @@ bool systemInitialized = false;
 
 
 // Global Variables
-WebServer server(80);
+AsyncWebServer server(80);
+AsyncEventSource events("/events");
 RTC_DS3231 rtc;
-String serialBuffer = "";
+RtcClock rtcClock(rtc);
+HcSr04Sensor hcsr04(TRIGGER_PIN, ECHO_PIN);
+A01nyubSensor a01nyub(Serial2, A01_RX, A01_TX);
+A01nyubSensor a01nyubAux(Serial1, A01_AUX_RX, A01_AUX_TX);
+// Used by the acquisition task only
+InterleavedSampler sampler(rtcClock);
+FsLogBackend logBackend(SPIFFS, DATA_FILE);
+DataLog dataLog(logBackend);
+FsLogBackend archiveBackend(SPIFFS, ARCHIVE_FILE);
+LogArchive logArchive(archiveBackend);
+// The archive and the ring as one run of records, for queries and uploads
+LogHistory history(dataLog, &logArchive);
+// Readings waiting for their flash commit. RTC memory that is not
+// initialized at boot, so a watchdog or software reset does not lose them.
+RTC_NOINIT_ATTR StageArea<STAGE_CAPACITY> stageArea;
+LogStage logStage(dataLog, stageArea);
 unsigned long lastMeasurementTime = 0;
-unsigned long lastDataSyncTime = 0;
 float currentWaterLevelBlok = 0.0;
 float currentWaterLevelParit = 0.0;
 float currentRawDistance = 0.0;
-String connectedClients[MAX_CLIENTS];
+float currentQuality = 0.0; // 0..1, see SampleFilter
 int numClients = 0;
 bool isOnlineMode = false;
 bool hasInternetConnection = false;
+unsigned long restartRequestedAt = 0; // 0 = no restart pending
+String indexEtag; // Empty if the image has no ETag for index.html
+
+// Web handlers run in the AsyncTCP task, concurrently with loop(). This lock
+// guards config, the RTC and the serial buffer; hold it only briefly and
+// never across network I/O.
+std::recursive_mutex stateMutex;
+
+// What a log line is about, so readers can filter without parsing the text
+enum EventCode : uint16_t
+{
+    EVT_GENERAL,
+    EVT_MEASUREMENT,
+    EVT_SENSOR,
+    EVT_STORAGE,
+    EVT_UPLOAD,
+    EVT_NETWORK,
+    EVT_SYSTEM
+};
+
+// Log lines go into a lock-free ring; loop() drains it to the UART and the
+// event stream at their own pace, so logging never waits on either
+EventLog<EVENT_LOG_SIZE> eventLog;
+uint32_t serialCursor = 0; // Last event written to the UART
+uint32_t streamCursor = 0; // Last event sent to /events
+// RTC epoch minus uptime seconds, so events get wall-clock time without an
+// I2C read; 0 until the RTC was read
+std::atomic<uint32_t> epochBase(0);
 
 // Add sensor type enum
 enum SensorType
@@ -55,18 +175,104 @@ enum SensorType
     A01NYUB_SENSOR
 };
 
+// Sensor connectors on the board. Channel 0 uses the HC-SR04 port or the
+// first UART as sensorType says; the other channels name their port.
+enum SensorPort
+{
+    PORT_HCSR04, // TRIGGER_PIN/ECHO_PIN
+    PORT_UART2,  // A01NYUB on A01_RX/A01_TX
+    PORT_UART1,  // A01NYUB on A01_AUX_RX/A01_AUX_TX
+    SENSOR_PORTS
+};
+
+// Progress of joining a network in online mode
+enum WiFiJoinState
+{
+    WIFI_JOIN_IDLE,
+    WIFI_JOIN_CUSTOM,
+    WIFI_JOIN_DEFAULT,
+    WIFI_JOIN_CONNECTED,
+    WIFI_JOIN_FAILED
+};
+
+WiFiJoinState wifiJoinState = WIFI_JOIN_IDLE;
+unsigned long wifiJoinStartedAt = 0;
+
+// Stages of setup() and the first request, Wi-Fi join and reading
+BootTimeline bootTimeline;
+std::atomic<bool> firstRequestSeen(false);
+
 // Add operation mode enum
 enum OperationMode
 {
     OFFLINE_MODE,
-    ONLINE_MODE
+    ONLINE_MODE,
+    LOW_POWER_MODE // Deep sleep between measurements, see runSleepCycle()
+};
+
+// Result of one sensor acquisition, handed from the acquisition task to loop()
+struct SensorReading
+{
+    FilteredReading filtered;
+    uint8_t channel;
+    SensorType sensorType;
+    uint32_t durationMs;   // Time the acquisition took
+    uint32_t passMs;       // Time the pass over all channels took
+};
+
+SpscQueue<SensorReading, 8> readingQueue;
+TaskHandle_t acquisitionTaskHandle = NULL;
+// Set when the sensor type changes; the acquisition task reconfigures the
+// pins and the UART between passes, never under a read
+std::atomic<bool> sensorChanged(false);
+
+// A sensor beyond the primary one. Its readings are logged with its channel
+// number and exported and uploaded under its own station.
+struct ChannelConfig {
+    bool enabled;
+    SensorPort port;
+    int stationId;
+    String stationName;
+    float calibrationOffset;
+    float sensorToBottomDistance;
+    float sensorToZeroBlokDistance;
+
+    ChannelConfig() : enabled(false),
+                      port(PORT_UART1),
+                      stationId(0),
+                      stationName(""),
+                      calibrationOffset(0.0),
+                      sensorToBottomDistance(100.0),
+                      sensorToZeroBlokDistance(50.0) {}
+};
+
+// Per-channel counters and the latest levels; guarded by stateMutex
+struct ChannelStats {
+    uint32_t readings;
+    uint32_t failures;   // Measurements without a valid result
+    uint32_t lastEpoch;
+    float blok;
+    float parit;
+    float raw;
+    float quality;
+    uint32_t lastDurationMs;
+    uint32_t maxDurationMs;
 };
 
+static_assert(MAX_CHANNELS <= LOG_CHANNELS && MAX_CHANNELS <= InterleavedSampler::MAX_SLOTS,
+              "every channel needs a log channel number and a sampler slot");
+
+ChannelStats channelStats[MAX_CHANNELS];
+uint32_t lastPassMs = 0; // Last pass over all channels
+
 // Configuration structure
 struct Config {
     int stationId;
     String stationName;
-    unsigned long measurementInterval;
+    unsigned long measurementInterval;    // Normal interval; the fixed one if adaptiveSampling is off
+    bool adaptiveSampling;
+    unsigned long maxMeasurementInterval; // Longest interval on flat water
+    float fastRateThreshold;              // cm/min; faster changes shorten the interval
     float calibrationOffset;
     SensorType sensorType;
     float sensorToBottomDistance;
@@ -76,23 +282,19 @@ struct Config {
     String wifiPassword;
     String apiEndpoint;
     String apiToken;
-    unsigned long dataSyncInterval; // in milliseconds
-    
-    struct DateTime {
-        int year;
-        int month;
-        int day;
-        int hour;
-        int minute;
-        int second;
-
-        DateTime() : year(2024), month(1), day(1),
-                     hour(0), minute(0), second(0) {}
-    } dateTime;
+    unsigned long dataSyncInterval; // in milliseconds; longest a reading waits for its batch
+    int uploadBatchSize;            // Readings per API request
+    FilterMode filterMode;
+    int samplesPerReading;
+    int flushEvery;                 // Low-power wakeups per write to flash
+    ChannelConfig channels[MAX_CHANNELS - 1]; // Channels 1 and up; channel 0 is the sensor above
 
     Config() : stationId(1),
                stationName("Default Station"),
                measurementInterval(12000),
+               adaptiveSampling(true),
+               maxMeasurementInterval(DEFAULT_MAX_INTERVAL),
+               fastRateThreshold(DEFAULT_FAST_RATE),
                calibrationOffset(0.0),
                sensorType(HCSR04_SENSOR),
                sensorToBottomDistance(100.0),
@@ -102,49 +304,125 @@ struct Config {
                wifiPassword(""),
                apiEndpoint(""),
                apiToken(""),
-               dataSyncInterval(3600000) {} // 1 hour default
+               dataSyncInterval(3600000), // 1 hour default
+               uploadBatchSize(10),
+               filterMode(FILTER_HAMPEL),
+               samplesPerReading(DEFAULT_SAMPLES_PER_READING),
+               flushEvery(DEFAULT_FLUSH_EVERY) {}
 } config;
 
+// What NVS holds, to write only the settings that changed; guarded by
+// stateMutex like config
+Config savedConfig;
+bool configStored = false;  // NVS has a config of the current version
+uint32_t configWrites = 0;  // NVS keys written or removed since boot
+
+WiFiTransport uploadTransport;
+HttpBulkSender batchSender(history, uploadTransport);
+NvsCursorStore uploadCursor("uploader", "acked");
+Uploader uploader(history, uploadCursor, batchSender);
+
 unsigned long startTime = 0;
 const unsigned long MINIMUM_INTERVAL = 12000; // 12 seconds in milliseconds
 
+// Measurement interval; shared by loop() and the settings handler, guarded
+// by stateMutex
+AdaptiveScheduler scheduler;
+
+// Low-power mode: readings, scheduler state and timings kept across deep
+// sleep. Zeroed by a cold boot.
+RTC_DATA_ATTR SleepState<SLEEP_BUFFER_SIZE> sleepState;
+// Phases of the current wakeup, added to sleepState.stats at sleep
+uint32_t cycleMeasureMs = 0;
+uint32_t cycleFlushMs = 0;
+bool cycleReading = false;
+
 // Function declarations
 bool setupSPIFFS();
 bool setupRTC();
 void setupWiFi();
 void setupWebServer();
-void handleRoot();
-void handleGetData();
-void handleDeleteData();
-void handleSettings();
-void handleCalibration();
-void handleSetTime();
-void handleSerial();
-void handleClients();
-void handleGetConfig();
-void handleCurrentLevel();
+void loadIndexEtag();
+void handleRoot(AsyncWebServerRequest *request);
+void handleGetData(AsyncWebServerRequest *request);
+void handleQueryData(AsyncWebServerRequest *request);
+AsyncWebServerResponse *beginStreamResponse(AsyncWebServerRequest *request, const char *contentType,
+                                            RecordStream *stream);
+void handleSeries(AsyncWebServerRequest *request);
+void handleDataSince(AsyncWebServerRequest *request);
+void handleDeleteData(AsyncWebServerRequest *request);
+void handleSettings(AsyncWebServerRequest *request);
+void handleCalibration(AsyncWebServerRequest *request);
+void handleSetTime(AsyncWebServerRequest *request);
+void handleSerial(AsyncWebServerRequest *request);
+void handleClients(AsyncWebServerRequest *request);
+void handleGetConfig(AsyncWebServerRequest *request);
+void handleCurrentLevel(AsyncWebServerRequest *request);
 void measureWaterLevel();
-String getFormattedDateTime();
+void startAcquisitionTask();
+void acquisitionTask(void *parameter);
+void reconfigureSensor();
+void processSensorReadings();
+void processReading(const SensorReading &reading);
+uint32_t getEpochTime();
 bool loadConfig();
+bool loadLegacyConfig();
+void readSettings(Preferences &prefs, Config &target);
 bool saveConfig();
 void initWatchdog();
 void resetWatchdog();
-void addToSerialBuffer(const String &message);
-void handleRestart();
-void handleUptime();
+void logEvent(EventLevel level, uint16_t code, const char *format, ...) __attribute__((format(printf, 3, 4)));
+size_t formatEventLine(char *buffer, size_t size, const Event &event);
+void drainSerialLog();
+void publishLogEvents();
+void handleRestart(AsyncWebServerRequest *request);
+void handleUptime(AsyncWebServerRequest *request);
 void validateMeasurementInterval();
-float readA01NYUB();
-float readHCSR04();
+void applySchedule();
+ScheduleConfig scheduleFromConfig();
+FilterConfig filterConfigFor(SensorType sensorType, FilterMode mode, int samples);
+SensorPort channelPort(int channel);
+bool channelActive(int channel);
+Calibration channelCalibration(int channel);
+SensorType portSensorType(SensorPort port);
+DistanceSensor &sensorOn(SensorPort port);
+StationTable stationTable();
+void applyStations();
+int channelArg(AsyncWebServerRequest *request, int fallback);
+void handleChannels(AsyncWebServerRequest *request);
+void handleChannelSettings(AsyncWebServerRequest *request);
+const char *operationModeName(OperationMode mode);
+const char *portName(SensorPort port);
+bool parsePort(const String &name, SensorPort &port);
+String limitStationName(const String &name);
+OperationMode parseOperationMode(const String &name);
+void enterLowPower();
+void runSleepCycle();
+void flushSleepBuffer();
+void saveSleepStats();
+void sleepUntilNextMeasurement(bool completedCycle);
+void handleSleepStats(AsyncWebServerRequest *request);
 bool connectToWiFi();
+void beginWiFiJoin();
+WiFiJoinState serviceWiFiJoin();
+void handleBootTiming(AsyncWebServerRequest *request);
 bool checkInternetConnection();
-bool sendDataToAPI(float levelBlok, float levelParit, float rawDistance);
-void syncStoredData();
-String formatDataAsJSON();
+void serviceUploader();
 void getStorageInfo();
 void getDataFileInfo();
-void logDataWithManagement(float levelBlok, float levelParit);
-void cleanOldData();
-void handleStorageInfo();
+void getHeapInfo();
+void handleHeapInfo(AsyncWebServerRequest *request);
+void sendJson(AsyncWebServerRequest *request, JsonDocument &doc);
+void logDataWithManagement(const Levels &levels, float quality, uint8_t channel);
+bool setupDataLog();
+bool setupArchive(size_t freeBytes);
+void archiveOldRecords();
+void importLegacyData();
+void handleStorageInfo(AsyncWebServerRequest *request);
+void publishEvent(const char *event, const char *data);
+void publishLevel();
+void publishStatus();
+void updateEventClients();
 
 // Function to get SPIFFS usage information
 void getStorageInfo() {
@@ -152,185 +430,306 @@ void getStorageInfo() {
     size_t usedBytes = SPIFFS.usedBytes();
     size_t freeBytes = totalBytes - usedBytes;
     
-    addToSerialBuffer("Storage - Total: " + String(totalBytes/1024) + "KB, " +
-                     "Used: " + String(usedBytes/1024) + "KB, " +
-                     "Free: " + String(freeBytes/1024) + "KB");
+    logEvent(EVENT_INFO, EVT_STORAGE, "Storage - Total: %uKB, Used: %uKB, Free: %uKB",
+             (unsigned)(totalBytes / 1024), (unsigned)(usedBytes / 1024),
+             (unsigned)(freeBytes / 1024));
 }
 
 // Function to get data file size and record count
 void getDataFileInfo() {
-    if (SPIFFS.exists(DATA_FILE)) {
-        File file = SPIFFS.open(DATA_FILE, "r");
-        if (file) {
-            size_t fileSize = file.size();
-            int recordCount = 0;
-            
-            // Count lines (records)
-            while (file.available()) {
-                String line = file.readStringUntil('\n');
-                if (line.length() > 0 && !line.startsWith("Station")) {
-                    recordCount++;
-                }
-            }
-            file.close();
-            
-            addToSerialBuffer("Data file - Size: " + String(fileSize/1024) + "KB, " +
-                             "Records: " + String(recordCount));
-        }
+    if (dataLog.isOpen()) {
+        LogStats stats = dataLog.stats();
+        char oldest[24];
+        formatDateTime(oldest, sizeof(oldest), stats.oldestEpoch);
+        logEvent(EVENT_INFO, EVT_STORAGE, "Data log - Used: %uKB, Records: %lu/%lu, Oldest: %s",
+                 (unsigned)(stats.bytesUsed / 1024), (unsigned long)stats.count,
+                 (unsigned long)stats.capacity, stats.count > 0 ? oldest : "-");
+    }
+    StageStats staging = logStage.stats();
+    logEvent(EVENT_INFO, EVT_STORAGE, "Staging - Pending: %lu, Commits: %lu, Records/commit: %lu, Max commit: %luus",
+             (unsigned long)staging.pending, (unsigned long)staging.commits,
+             (unsigned long)(staging.commits ? staging.committed / staging.commits : 0),
+             (unsigned long)staging.maxCommitUs);
+    if (logArchive.isOpen()) {
+        ArchiveStats stats = logArchive.stats();
+        char oldest[24];
+        formatDateTime(oldest, sizeof(oldest), stats.oldestEpoch);
+        logEvent(EVENT_INFO, EVT_STORAGE, "Archive - Used: %uKB, Blocks: %lu/%lu, Records: %lu, Oldest: %s",
+                 (unsigned)(stats.bytesUsed / 1024), (unsigned long)stats.blocks,
+                 (unsigned long)stats.capacity, (unsigned long)stats.records,
+                 stats.blocks > 0 ? oldest : "-");
     }
 }
 
-// Enhanced data logging with file size management
-void logDataWithManagement(float levelBlok, float levelParit) {
-    // Check available space before writing
+// Fragmentation is the share of free heap that is not in the largest block
+static unsigned heapFragmentation(uint32_t freeHeap, uint32_t largestBlock)
+{
+    return freeHeap ? 100 - (unsigned)((uint64_t)largestBlock * 100 / freeHeap) : 0;
+}
+
+void getHeapInfo() {
+    uint32_t freeHeap = ESP.getFreeHeap();
+    uint32_t largestBlock = ESP.getMaxAllocHeap();
+    logEvent(EVENT_INFO, EVT_SYSTEM, "Heap - Free: %luKB, Min free: %luKB, Largest block: %luKB, Fragmentation: %u%%",
+             (unsigned long)(freeHeap / 1024), (unsigned long)(ESP.getMinFreeHeap() / 1024),
+             (unsigned long)(largestBlock / 1024), heapFragmentation(freeHeap, largestBlock));
+}
+
+// Open the ring-buffer data log, creating it on first boot
+bool setupDataLog() {
+    if (!logBackend.open()) {
+        Serial.println("Failed to open data log");
+        return false;
+    }
+
+    // Size a new log from the free space, counting the legacy CSV it replaces
     size_t freeBytes = SPIFFS.totalBytes() - SPIFFS.usedBytes();
-    
-    // If less than 50KB free, clean old data
-    if (freeBytes < 50000) {
-        cleanOldData();
+    if (SPIFFS.exists(LEGACY_DATA_FILE)) {
+        File legacy = SPIFFS.open(LEGACY_DATA_FILE, "r");
+        if (legacy) {
+            freeBytes += legacy.size();
+            legacy.close();
+        }
     }
-    
-    // Create the data file with headers if it doesn't exist
-    if (!SPIFFS.exists(DATA_FILE)) {
-        File file = SPIFFS.open(DATA_FILE, "w");
-        if (file) {
-            file.println("Station ID,Station Name,DateTime,Water Level (Blok) (cm),Water Level (Parit) (cm),Raw Distance (cm)");
-            file.close();
+    uint32_t capacity = freeBytes * (100 - STORAGE_RESERVE_PERCENT) / 100 / sizeof(LogRecord);
+    if (capacity > LOG_RING_RECORDS) {
+        capacity = LOG_RING_RECORDS;
+    }
+
+    // A log sized by older firmware spans the whole partition; once it has
+    // been cleared, recreate it at the ring size to make room for the archive
+    if (dataLog.begin(capacity) && dataLog.count() == 0 && dataLog.capacity() > LOG_RING_RECORDS) {
+        logBackend.close();
+        SPIFFS.remove(DATA_FILE);
+        freeBytes = SPIFFS.totalBytes() - SPIFFS.usedBytes();
+        if (!logBackend.open() || !dataLog.format(capacity)) {
+            Serial.println("Failed to resize data log");
+            return false;
         }
     }
-    
-    File file = SPIFFS.open(DATA_FILE, "a");
-    if (!file) {
-        addToSerialBuffer("Failed to open data file for logging");
-        return;
+    if (!dataLog.isOpen()) {
+        Serial.println("Failed to initialize data log");
+        return false;
     }
+    Serial.printf("Data log: %u/%u records\n", dataLog.count(), dataLog.capacity());
 
-    String dataString = String(config.stationId) + "," +
-                        config.stationName + "," +
-                        getFormattedDateTime() + "," +
-                        String(levelBlok, 2) + "," +
-                        String(levelParit, 2) + "," +
-                        String(currentRawDistance, 2) + "\n";
+    setupArchive(freeBytes);
+    importLegacyData();
+    return true;
+}
 
-    if (file.print(dataString)) {
-        addToSerialBuffer("Data logged successfully");
-    } else {
-        addToSerialBuffer("Failed to write data");
+// Open the compressed archive, sized from what the ring will not grow into
+bool setupArchive(size_t freeBytes) {
+    if (!archiveBackend.open()) {
+        Serial.println("Failed to open archive");
+        return false;
     }
 
-    file.close();
-    
-    // Log storage info periodically
-    static unsigned long lastStorageInfo = 0;
-    if (millis() - lastStorageInfo > 300000) { // Every 5 minutes
-        getStorageInfo();
-        getDataFileInfo();
-        lastStorageInfo = millis();
+    size_t ringBytes = (size_t)dataLog.capacity() * sizeof(LogRecord);
+    size_t ringGrowth = ringBytes > logBackend.size() ? ringBytes - logBackend.size() : 0;
+    size_t available = freeBytes > ringGrowth ? freeBytes - ringGrowth : 0;
+    uint32_t capacity = available * (100 - STORAGE_RESERVE_PERCENT) / 100 / ARCHIVE_BLOCK_SIZE;
+
+    if (!logArchive.begin(capacity)) {
+        // Only the ring is kept, as before
+        Serial.println("Archive unavailable - no free space");
+        return false;
     }
+    Serial.printf("Archive: %u/%u blocks, %u records\n", logArchive.blocks(), logArchive.capacity(),
+                  logArchive.records());
+    return true;
 }
 
-// Function to clean old data when storage gets full
-void cleanOldData() {
-    addToSerialBuffer("Storage getting full, cleaning old data...");
-    
-    if (!SPIFFS.exists(DATA_FILE)) {
+// Once the ring is three-quarters full, compress its older half into the
+// archive a few blocks at a time. Nothing is lost to the uploader or the
+// queries: both read the archive ahead of the ring through `history`
+void archiveOldRecords() {
+    if (!logArchive.isOpen() || dataLog.count() < dataLog.capacity() / 4 * 3) {
         return;
     }
-    
-    File originalFile = SPIFFS.open(DATA_FILE, "r");
-    if (!originalFile) {
-        return;
+
+    StationTable stations;
+    {
+        std::lock_guard<std::recursive_mutex> lock(stateMutex);
+        stations = stationTable();
     }
-    
-    // Create temporary file
-    File tempFile = SPIFFS.open("/temp.csv", "w");
-    if (!tempFile) {
-        originalFile.close();
+
+    uint32_t keepFrom = dataLog.lastSeq() + 1 - dataLog.capacity() / 2;
+    uint32_t archived = logArchive.archive(dataLog, keepFrom, ARCHIVE_BLOCKS_PER_PASS, stations);
+    if (archived > 0) {
+        dataLog.discardOldest(logArchive.liveStart(dataLog) - dataLog.firstSeq());
+        logEvent(EVENT_INFO, EVT_STORAGE, "Archived %lu records", (unsigned long)archived);
+    }
+}
+
+// Move rows from the old append-only CSV into the data log, then remove it
+void importLegacyData() {
+    if (!SPIFFS.exists(LEGACY_DATA_FILE)) {
         return;
     }
-    
-    // Copy header
-    String header = originalFile.readStringUntil('\n');
-    tempFile.println(header);
-    
-    // Count total lines first
-    int totalLines = 0;
-    while (originalFile.available()) {
-        originalFile.readStringUntil('\n');
-        totalLines++;
+
+    File file = SPIFFS.open(LEGACY_DATA_FILE, "r");
+    if (!file) {
+        return;
     }
-    
-    // Reset to beginning and skip header
-    originalFile.seek(0);
-    originalFile.readStringUntil('\n');
-    
-    // Keep only the latest 50% of records
-    int linesToSkip = totalLines / 2;
-    int currentLine = 0;
-    
-    while (originalFile.available()) {
-        String line = originalFile.readStringUntil('\n');
-        if (currentLine >= linesToSkip) {
-            tempFile.println(line);
+
+    char line[128];
+    uint32_t lines = 0;
+    uint32_t imported = 0;
+    while (file.available()) {
+        size_t length = file.readBytesUntil('\n', line, sizeof(line) - 1);
+        line[length] = '\0';
+
+        LogRecord record;
+        if (parseCsvRow(line, record) && dataLog.append(record)) {
+            imported++;
+        }
+        if (++lines % 256 == 0) {
+            archiveOldRecords();
+            resetWatchdog();
         }
-        currentLine++;
     }
+    file.close();
+
+    SPIFFS.remove(LEGACY_DATA_FILE);
+    Serial.printf("Imported %u records from %s\n", imported, LEGACY_DATA_FILE);
+}
+
+// Enhanced data logging with file size management
+void logDataWithManagement(const Levels &levels, float quality, uint8_t channel) {
+    LogRecord record;
+    record.epoch = getEpochTime();
+    record.levelBlok = toFixedLevel(levels.blok);
+    record.levelParit = toFixedLevel(levels.parit);
+    record.rawDistance = toFixedLevel(levels.raw);
+    record.flags = toQualityFlags(quality) | toChannelFlags(channel);
+
+    // Staged in RAM and committed to the log in batches; the log is
+    // circular, so a full log overwrites its oldest records in place
+    if (logStage.add(record, millis())) {
+        logEvent(EVENT_INFO, EVT_STORAGE, "Data logged successfully (%lu awaiting commit)",
+                 (unsigned long)logStage.pending());
+    } else {
+        logEvent(EVENT_ERROR, EVT_STORAGE, "Failed to write data");
+    }
+    archiveOldRecords();
     
-    originalFile.close();
-    tempFile.close();
-    
-    // Replace original file with cleaned file
-    SPIFFS.remove(DATA_FILE);
-    SPIFFS.rename("/temp.csv", DATA_FILE);
-    
-    addToSerialBuffer("Old data cleaned, kept latest " + String(totalLines - linesToSkip) + " records");
+    // Log storage info periodically
+    static unsigned long lastStorageInfo = 0;
+    if (millis() - lastStorageInfo > STATS_LOG_INTERVAL) { // Every 5 minutes
+        getStorageInfo();
+        getDataFileInfo();
+        getHeapInfo();
+        lastStorageInfo = millis();
+    }
 }
 
 // Add storage info endpoint
-void handleStorageInfo() {
+void handleStorageInfo(AsyncWebServerRequest *request) {
     size_t totalBytes = SPIFFS.totalBytes();
     size_t usedBytes = SPIFFS.usedBytes();
     size_t freeBytes = totalBytes - usedBytes;
     
-    int recordCount = 0;
-    size_t dataFileSize = 0;
-    
-    if (SPIFFS.exists(DATA_FILE)) {
-        File file = SPIFFS.open(DATA_FILE, "r");
-        if (file) {
-            dataFileSize = file.size();
-            while (file.available()) {
-                String line = file.readStringUntil('\n');
-                if (line.length() > 0 && !line.startsWith("Station")) {
-                    recordCount++;
-                }
-            }
-            file.close();
-        }
-    }
-    
-    JsonDocument doc;
+    // Everything about the log comes from its in-memory header, so this
+    // costs the same whatever the log size
+    LogStats stats = dataLog.stats();
+    char oldest[24], newest[24];
+    formatDateTime(oldest, sizeof(oldest), stats.oldestEpoch);
+    formatDateTime(newest, sizeof(newest), stats.newestEpoch);
+
+    JsonArenaBuffer<JSON_ARENA_SIZE> arena;
+    JsonDocument doc(&arena);
     doc["totalBytes"] = totalBytes;
     doc["usedBytes"] = usedBytes;
     doc["freeBytes"] = freeBytes;
-    doc["dataFileSize"] = dataFileSize;
-    doc["recordCount"] = recordCount;
-    doc["percentUsed"] = (usedBytes * 100) / totalBytes;
-    
-    String jsonString;
-    serializeJson(doc, jsonString);
-    server.send(200, "application/json", jsonString);
+    doc["dataFileSize"] = stats.bytesUsed;
+    doc["recordCount"] = stats.count;
+    doc["recordCapacity"] = stats.capacity;
+    doc["firstSeq"] = stats.firstSeq;
+    doc["lastSeq"] = stats.lastSeq;
+    doc["oldestEpoch"] = stats.oldestEpoch;
+    doc["newestEpoch"] = stats.newestEpoch;
+    doc["oldestRecord"] = stats.count > 0 ? oldest : "";
+    doc["newestRecord"] = stats.count > 0 ? newest : "";
+    doc["percentUsed"] = totalBytes ? (usedBytes * 100) / totalBytes : 0;
+    if (logArchive.isOpen()) {
+        // One block header read at each end
+        ArchiveStats archived = logArchive.stats();
+        formatDateTime(oldest, sizeof(oldest), archived.oldestEpoch);
+        doc["archiveBytes"] = archived.bytesUsed;
+        doc["archiveBlocks"] = archived.blocks;
+        doc["archiveCapacity"] = archived.capacity;
+        doc["archiveRecords"] = archived.records;
+        doc["archiveOldestRecord"] = archived.blocks > 0 ? oldest : "";
+    }
+    // Flash traffic of the log since boot, against what the staging saved
+    StageStats staging = logStage.stats();
+    doc["logSyncs"] = stats.syncs;
+    doc["logBytesWritten"] = stats.bytesWritten;
+    doc["stagePending"] = staging.pending;
+    doc["stageCommits"] = staging.commits;
+    doc["stageCommitted"] = staging.committed;
+    doc["stageRecovered"] = staging.recovered;
+    doc["stageFailures"] = staging.failures;
+    doc["lastCommitUs"] = staging.lastCommitUs;
+    doc["maxCommitUs"] = staging.maxCommitUs;
+    {
+        std::lock_guard<std::recursive_mutex> lock(stateMutex);
+        doc["configWrites"] = configWrites; // NVS keys, not whole files
+    }
+    doc["uploadAcked"] = uploader.ackedSeq();
+    doc["uploadPending"] = uploader.pending();
+    doc["uploadFailures"] = uploader.failures();
+    doc["uploadDropped"] = uploader.dropped();
+    sendJson(request, doc);
+}
+
+// Heap health, to see the allocator churn of long uptimes
+void handleHeapInfo(AsyncWebServerRequest *request) {
+    uint32_t freeHeap = ESP.getFreeHeap();
+    uint32_t largestBlock = ESP.getMaxAllocHeap();
+
+    char body[224];
+    snprintf(body, sizeof(body),
+             "{\"heapSize\":%lu,\"freeHeap\":%lu,\"minFreeHeap\":%lu,\"largestFreeBlock\":%lu,"
+             "\"fragmentation\":%u,\"jsonArenaFallbacks\":%lu,\"uptime\":%lu}",
+             (unsigned long)ESP.getHeapSize(), (unsigned long)freeHeap,
+             (unsigned long)ESP.getMinFreeHeap(), (unsigned long)largestBlock,
+             heapFragmentation(freeHeap, largestBlock), (unsigned long)JsonArena::fallbacks(),
+             millis() / 1000);
+    request->send(200, "application/json", body);
+}
+
+// Serialize into a stack buffer, which the server copies once into the
+// response; only unusually large documents go through a String
+void sendJson(AsyncWebServerRequest *request, JsonDocument &doc)
+{
+    char body[JSON_RESPONSE_SIZE];
+    if (measureJson(doc) < sizeof(body)) {
+        serializeJson(doc, body, sizeof(body));
+        request->send(200, "application/json", body);
+        return;
+    }
+    String json;
+    serializeJson(doc, json);
+    request->send(200, "application/json", json);
 }
 
 void setup()
 {
-    // Initialize serial first and wait for it to be ready
+    // A low-power wakeup takes its reading and goes straight back to sleep
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER && sleepState.valid()) {
+        runSleepCycle();
+    }
+
+    // Stages run in order of what the first request needs: the web server
+    // comes up as soon as SPIFFS and the config are loaded, Wi-Fi joins in
+    // the background (serviceWiFiJoin()), and nothing waits on a fixed delay.
+    // /bootTiming reports each stage.
+    bootTimeline.begin("serial", millis());
+    Serial.setTxBufferSize(SERIAL_TX_BUFFER); // Must come before begin()
     Serial.begin(115200);
-    delay(2000); // Give more time for serial to stabilize
-    
     Serial.println("\n=== Water Level Logger Starting ===");
-    Serial.println("Phase 1: Basic initialization");
-    Serial.flush();
 
     // Initialize watchdog early but with longer timeout
     esp_task_wdt_init(300, true); // 5 minutes timeout during setup
@@ -341,89 +740,90 @@ void setup()
     pinMode(ECHO_PIN, INPUT);
     digitalWrite(TRIGGER_PIN, LOW);
     
-    Serial.println("Phase 2: SPIFFS initialization");
-    Serial.flush();
-    
+    bootTimeline.begin("spiffs", millis());
     if (!setupSPIFFS()) {
         Serial.println("CRITICAL: SPIFFS failed - restarting in 5 seconds");
         delay(5000);
         ESP.restart();
     }
     
-    Serial.println("Phase 3: Config loading");
-    Serial.flush();
-    
+    bootTimeline.begin("config", millis());
     if (!loadConfig()) {
         Serial.println("Config load failed, using defaults");
         saveConfig();
     }
     
-    Serial.println("Phase 4: WiFi setup");
-    Serial.flush();
-    
+    // Starts the hotspot, or starts joining the network
+    bootTimeline.begin("wifi", millis());
     setupWiFi();
     
-    Serial.println("Phase 5: RTC setup (safe mode)");
-    Serial.flush();
-    
-    // This is where the crash was happening - now with extensive protection
-    bool rtcSuccess = setupRTC();
-    if (rtcSuccess) {
+    // Handlers read the RTC, so it is probed first; without the old fixed
+    // delays this takes milliseconds
+    bootTimeline.begin("rtc", millis());
+    if (setupRTC()) {
         Serial.println("RTC initialized successfully");
     } else {
         Serial.println("RTC initialization failed - continuing without RTC");
-        // Don't restart, just continue
     }
     
-    Serial.println("Phase 6: Web server setup");
-    Serial.flush();
-    
+    bootTimeline.begin("webServer", millis());
     setupWebServer();
     
-    Serial.println("Phase 7: Final initialization");
-    Serial.flush();
+    // Data handlers report an error until the log is open
+    bootTimeline.begin("dataLog", millis());
+    if (!setupDataLog()) {
+        Serial.println("Data log unavailable - measurements will not be stored");
+    }
+    logStage.configure(STAGE_COMMIT_RECORDS, STAGE_COMMIT_MS);
+    if (uint32_t recovered = logStage.recover(millis())) {
+        Serial.printf("Committed %u readings staged before the reset\n", recovered);
+    }
+    uploader.setBackoff(UPLOAD_BACKOFF_MS, UPLOAD_BACKOFF_MAX_MS);
+    uploader.setWindow(UPLOAD_WINDOW);
+    batchSender.setTimeout(UPLOAD_TIMEOUT_MS);
+    uploader.begin();
     
+    bootTimeline.begin("tasks", millis());
     // Reduce watchdog timeout to normal operation
     esp_task_wdt_deinit();
     initWatchdog(); // This will reinitialize with normal timeout
     
     startTime = millis();
     validateMeasurementInterval();
+    startAcquisitionTask();
     systemInitialized = true; // Mark system as fully initialized
+    getEpochTime(); // Timestamps for log lines from here on
+    bootTimeline.end(millis());
     
     Serial.println("=== System Initialization Complete ===");
-    if (config.operationMode == OFFLINE_MODE) {
-        Serial.printf("OFFLINE MODE - Web interface: http://%s\n", WiFi.softAPIP().toString().c_str());
-    } else {
-        Serial.printf("ONLINE MODE - Web interface: http://%s\n", WiFi.localIP().toString().c_str());
-    }
-    
-    // Initialize sensor pins based on type
-    if (config.sensorType == HCSR04_SENSOR) {
-        pinMode(TRIGGER_PIN, OUTPUT);
-        pinMode(ECHO_PIN, INPUT);
-        Serial.println("HC-SR04 sensor configured");
+    if (config.operationMode != ONLINE_MODE) {
+        Serial.printf("%s MODE - Web interface: http://%s\n", operationModeName(config.operationMode),
+                      WiFi.softAPIP().toString().c_str());
     } else {
-        // Configure A01NYUB but don't initialize Serial2 yet
-        Serial.println("A01NYUB sensor configured");
+        Serial.println("ONLINE MODE - Web interface address follows once WiFi is joined");
+    }
+    Serial.println(config.sensorType == HCSR04_SENSOR ? "HC-SR04 sensor configured" : "A01NYUB sensor configured");
+    for (int channel = 1; channel < MAX_CHANNELS; channel++) {
+        if (channelActive(channel)) {
+            SensorPort port = channelPort(channel);
+            Serial.printf("Channel %d: %s on %s, station %d\n", channel,
+                          portSensorType(port) == HCSR04_SENSOR ? "HC-SR04" : "A01NYUB", portName(port),
+                          config.channels[channel - 1].stationId);
+        }
     }
     
-    Serial.println("Taking first measurement...");
-    Serial.flush();
-    
+    // The acquisition task takes it; setup() does not wait
     measureWaterLevel();
-    
-    Serial.println("Setup completed successfully!");
 }
 
-void handleRestart()
+void handleRestart(AsyncWebServerRequest *request)
 {
-    server.send(200, "text/plain", "Restarting...");
-    delay(1000);
-    ESP.restart();
+    // Restarting here would cut the reply off; loop() does it shortly after
+    request->send(200, "text/plain", "Restarting...");
+    restartRequestedAt = millis() | 1;
 }
 
-void handleUptime()
+void handleUptime(AsyncWebServerRequest *request)
 {
     unsigned long currentMillis = millis();
     unsigned long uptimeSeconds = currentMillis / 1000;
@@ -431,12 +831,10 @@ void handleUptime()
     unsigned long uptimeHours = uptimeMinutes / 60;
     unsigned long uptimeDays = uptimeHours / 24;
 
-    String uptimeStr = String(uptimeDays) + " days, " +
-                       String(uptimeHours % 24) + " hours, " +
-                       String(uptimeMinutes % 60) + " minutes, " +
-                       String(uptimeSeconds % 60) + " seconds";
-
-    server.send(200, "text/plain", uptimeStr);
+    char uptime[64];
+    snprintf(uptime, sizeof(uptime), "%lu days, %lu hours, %lu minutes, %lu seconds",
+             uptimeDays, uptimeHours % 24, uptimeMinutes % 60, uptimeSeconds % 60);
+    request->send(200, "text/plain", uptime);
 }
 
 void validateMeasurementInterval()
@@ -446,16 +844,219 @@ void validateMeasurementInterval()
         config.measurementInterval = MINIMUM_INTERVAL;
         saveConfig();
     }
+    applySchedule();
 }
 
-void loop()
+// Push the interval settings into the scheduler; call with stateMutex held
+// once the system is running
+void applySchedule()
+{
+    scheduler.configure(scheduleFromConfig());
+}
+
+ScheduleConfig scheduleFromConfig()
+{
+    ScheduleConfig schedule;
+    schedule.normalIntervalMs = config.measurementInterval;
+    if (config.adaptiveSampling) {
+        schedule.minIntervalMs = MINIMUM_INTERVAL;
+        schedule.maxIntervalMs = max(config.measurementInterval, config.maxMeasurementInterval);
+    } else {
+        schedule.minIntervalMs = config.measurementInterval;
+        schedule.maxIntervalMs = config.measurementInterval;
+    }
+    schedule.fastRateCmPerMin = config.fastRateThreshold;
+    schedule.stableCm = STABLE_CHANGE_CM;
+    return schedule;
+}
+
+FilterConfig filterConfigFor(SensorType sensorType, FilterMode mode, int samples)
+{
+    FilterConfig filterConfig;
+    filterConfig.mode = mode;
+    filterConfig.maxSamples = samples;
+    // A01NYUB reports whole millimetres
+    filterConfig.resolutionCm = (sensorType == HCSR04_SENSOR) ? 0.3f : 0.1f;
+    return filterConfig;
+}
+
+// Channel helpers; callers hold stateMutex
+
+SensorPort channelPort(int channel)
+{
+    if (channel == 0) {
+        return config.sensorType == HCSR04_SENSOR ? PORT_HCSR04 : PORT_UART2;
+    }
+    return config.channels[channel - 1].port;
+}
+
+// Channel 0 always measures. Another channel needs a port no lower channel
+// has taken, since two drivers cannot share one.
+bool channelActive(int channel)
+{
+    if (channel == 0) {
+        return true;
+    }
+    if (channel >= MAX_CHANNELS || !config.channels[channel - 1].enabled) {
+        return false;
+    }
+    SensorPort port = channelPort(channel);
+    for (int other = 0; other < channel; other++) {
+        if (channelActive(other) && channelPort(other) == port) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Calibration channelCalibration(int channel)
+{
+    Calibration calibration;
+    if (channel == 0) {
+        calibration.sensorToZeroBlokDistance = config.sensorToZeroBlokDistance;
+        calibration.sensorToBottomDistance = config.sensorToBottomDistance;
+        calibration.calibrationOffset = config.calibrationOffset;
+    } else {
+        const ChannelConfig &channelConfig = config.channels[channel - 1];
+        calibration.sensorToZeroBlokDistance = channelConfig.sensorToZeroBlokDistance;
+        calibration.sensorToBottomDistance = channelConfig.sensorToBottomDistance;
+        calibration.calibrationOffset = channelConfig.calibrationOffset;
+    }
+    return calibration;
+}
+
+SensorType portSensorType(SensorPort port)
+{
+    return port == PORT_HCSR04 ? HCSR04_SENSOR : A01NYUB_SENSOR;
+}
+
+A01nyubSensor &uartSensorOn(SensorPort port)
+{
+    return port == PORT_UART1 ? a01nyubAux : a01nyub;
+}
+
+DistanceSensor &sensorOn(SensorPort port)
+{
+    if (port == PORT_HCSR04) {
+        return hcsr04;
+    }
+    return uartSensorOn(port);
+}
+
+// Stations the CSV export and the uploader name each channel's records by
+StationTable stationTable()
+{
+    StationTable stations;
+    stations.set(0, config.stationId, config.stationName.c_str());
+    for (int channel = 1; channel < MAX_CHANNELS; channel++) {
+        const ChannelConfig &channelConfig = config.channels[channel - 1];
+        stations.set(channel, channelConfig.stationId, channelConfig.stationName.c_str());
+    }
+    return stations;
+}
+
+void applyStations()
+{
+    batchSender.setStation(config.stationId, config.stationName.c_str());
+    for (int channel = 1; channel < MAX_CHANNELS; channel++) {
+        const ChannelConfig &channelConfig = config.channels[channel - 1];
+        batchSender.setStation(channelConfig.stationId, channelConfig.stationName.c_str(), channel);
+    }
+}
+
+const char *portName(SensorPort port)
+{
+    switch (port) {
+    case PORT_UART2:
+        return "uart2";
+    case PORT_UART1:
+        return "uart1";
+    default:
+        return "hcsr04";
+    }
+}
+
+bool parsePort(const String &name, SensorPort &port)
+{
+    for (int i = 0; i < SENSOR_PORTS; i++) {
+        if (name.equals(portName((SensorPort)i))) {
+            port = (SensorPort)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Exports and uploads carry station names up to STATION_NAME_LENGTH - 1
+// bytes; longer ones are cut when saved, so the config shows the name the
+// records go out under
+String limitStationName(const String &name)
+{
+    unsigned length = STATION_NAME_LENGTH - 1;
+    if (name.length() <= length) {
+        return name;
+    }
+    while (length > 0 && ((unsigned char)name[length] & 0xC0) == 0x80) {
+        length--; // Not inside a UTF-8 sequence
+    }
+    return name.substring(0, length);
+}
+
+const char *operationModeName(OperationMode mode)
+{
+    switch (mode) {
+    case ONLINE_MODE:
+        return "ONLINE";
+    case LOW_POWER_MODE:
+        return "LOW_POWER";
+    default:
+        return "OFFLINE";
+    }
+}
+
+OperationMode parseOperationMode(const String &name)
 {
-    server.handleClient();
+    if (name.equals("ONLINE")) {
+        return ONLINE_MODE;
+    }
+    return name.equals("LOW_POWER") ? LOW_POWER_MODE : OFFLINE_MODE;
+}
 
+void loop()
+{
     unsigned long currentTime = millis();
+
+    if (restartRequestedAt != 0 && currentTime - restartRequestedAt >= RESTART_DELAY_MS)
+    {
+        logStage.commit(currentTime);
+        ESP.restart();
+    }
+
+    // Low-power mode stays up after a cold boot so the station can be
+    // configured over the hotspot, then sleeps once nobody is connected
+    if (config.operationMode == LOW_POWER_MODE && currentTime - startTime >= LOW_POWER_AWAKE_MS &&
+        WiFi.softAPgetStationNum() == 0)
+    {
+        enterLowPower();
+    }
     
-    // Handle measurements
-    if (currentTime - lastMeasurementTime >= config.measurementInterval)
+    // Finish joining the network setup() started on
+    if (wifiJoinState == WIFI_JOIN_CUSTOM || wifiJoinState == WIFI_JOIN_DEFAULT)
+    {
+        if (serviceWiFiJoin() == WIFI_JOIN_CONNECTED)
+        {
+            hasInternetConnection = checkInternetConnection();
+        }
+    }
+
+    unsigned long interval;
+    {
+        std::lock_guard<std::recursive_mutex> lock(stateMutex);
+        interval = scheduler.interval();
+    }
+
+    // Handle measurements; the acquisition itself runs on the other core
+    if (currentTime - lastMeasurementTime >= interval)
     {
         measureWaterLevel();
         lastMeasurementTime = currentTime;
@@ -466,16 +1067,19 @@ void loop()
         }
     }
 
-    // Handle data synchronization in online mode
-    if (config.operationMode == ONLINE_MODE && 
-        currentTime - lastDataSyncTime >= config.dataSyncInterval)
+    processSensorReadings();
+    // Commits the staged readings once the oldest has waited long enough
+    logStage.service(millis());
+
+    // Upload logged readings in batches in online mode
+    if (config.operationMode == ONLINE_MODE && hasInternetConnection)
     {
-        if (hasInternetConnection) {
-            syncStoredData();
-        }
-        lastDataSyncTime = currentTime;
+        serviceUploader();
     }
 
+    updateEventClients();
+    publishLogEvents();
+    drainSerialLog();
     resetWatchdog();
 }
 
@@ -487,64 +1091,31 @@ bool setupSPIFFS()
         return false;
     }
 
-    Serial.println("SPIFFS mounted successfully");
-    
-    File root = SPIFFS.open("/");
-    File file = root.openNextFile();
-    while(file){
-        Serial.print("  FILE: ");
-        Serial.print(file.name());
-        Serial.print("  SIZE: ");
-        Serial.println(file.size());
-        file = root.openNextFile();
-    }
-    
+    Serial.printf("SPIFFS mounted - Used: %uKB of %uKB\n", (unsigned)(SPIFFS.usedBytes() / 1024),
+                  (unsigned)(SPIFFS.totalBytes() / 1024));
     return true;
 }
 
-// Completely rewrite the setupRTC function with extensive error checking
+// Probe the DS3231. A missing RTC costs at most RTC_PROBE_ATTEMPTS bus
+// timeouts rather than seconds of fixed delays.
 bool setupRTC()
 {
-    Serial.println("Starting RTC setup...");
-    Serial.flush();
-    
     // Ensure I2C pins are not conflicting with anything
     pinMode(RTC_SDA, INPUT_PULLUP);
     pinMode(RTC_SCL, INPUT_PULLUP);
-    delay(100);
-    
-    // Initialize I2C with explicit error checking
-    Serial.println("Initializing I2C...");
-    Serial.flush();
-    
-    // End any existing I2C session first
-    Wire.end();
-    delay(50);
     
     // Start I2C with specific pins
-    bool i2cResult = Wire.begin(RTC_SDA, RTC_SCL);
-    if (!i2cResult) {
+    if (!Wire.begin(RTC_SDA, RTC_SCL)) {
         Serial.println("I2C initialization failed!");
         rtcAvailable = false;
         return false;
     }
-    
-    // Set I2C frequency to a safe value
     Wire.setClock(100000); // 100kHz - slower but more reliable
-    delay(100);
+    Wire.setTimeOut(RTC_I2C_TIMEOUT_MS);
     
-    Serial.println("I2C initialized, attempting RTC begin...");
-    Serial.flush();
-    
-    // Try to initialize RTC with timeout protection
-    unsigned long startTime = millis();
     bool rtcBeginResult = false;
-    
-    // Wrap RTC begin in a timeout
-    while (millis() - startTime < 2000) { // 2 second timeout
+    for (int attempt = 0; attempt < RTC_PROBE_ATTEMPTS && !rtcBeginResult; attempt++) {
         rtcBeginResult = rtc.begin();
-        if (rtcBeginResult) break;
-        delay(100);
     }
     
     if (!rtcBeginResult) {
@@ -554,15 +1125,11 @@ bool setupRTC()
         return false;
     }
     
-    Serial.println("RTC begin successful, checking power status...");
-    Serial.flush();
-    
     // Check RTC power status with error handling
     try {
         if (rtc.lostPower()) {
             Serial.println("RTC lost power, setting default time");
             rtc.adjust(DateTime(2024, 1, 1, 12, 0, 0));
-            delay(100);
         }
     } catch (...) {
         Serial.println("Error checking RTC power status");
@@ -583,75 +1150,80 @@ bool setupRTC()
     }
     
     rtcAvailable = true;
-    Serial.println("RTC setup completed successfully");
     return true;
 }
 
 void setupWiFi()
 {
-    if (config.operationMode == OFFLINE_MODE) {
-        // Offline mode: Create hotspot
+    if (config.operationMode != ONLINE_MODE) {
+        // Offline and low-power modes: Create hotspot
         WiFi.mode(WIFI_AP);
         WiFi.softAP("water_level", "sulungresearch");
-        Serial.print("OFFLINE MODE - AP IP address: ");
+        Serial.printf("%s MODE - AP IP address: ", operationModeName(config.operationMode));
         Serial.println(WiFi.softAPIP());
-        addToSerialBuffer("Started in OFFLINE mode - Hotspot created");
+        logEvent(EVENT_INFO, EVT_NETWORK, "Started in %s mode - Hotspot created",
+                 operationModeName(config.operationMode));
     } else {
-        // Online mode: Connect to WiFi
+        // Online mode: loop() finishes joining through serviceWiFiJoin()
         isOnlineMode = true;
-        if (connectToWiFi()) {
-            hasInternetConnection = checkInternetConnection();
-            addToSerialBuffer("Started in ONLINE mode - Connected to WiFi");
-        } else {
-            addToSerialBuffer("ONLINE mode failed - No WiFi connection");
-        }
+        beginWiFiJoin();
+        logEvent(EVENT_INFO, EVT_NETWORK, "Started in ONLINE mode - Joining WiFi");
     }
 }
 
-bool connectToWiFi()
+// Start joining the custom network, or the default one if none is set.
+// Returns at once; serviceWiFiJoin() follows the attempt up.
+void beginWiFiJoin()
 {
     WiFi.mode(WIFI_STA);
-    
-    // Try custom WiFi first
     if (config.wifiSSID.length() > 0) {
         Serial.println("Connecting to custom WiFi: " + config.wifiSSID);
         WiFi.begin(config.wifiSSID.c_str(), config.wifiPassword.c_str());
-        
-        int attempts = 0;
-        while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-            delay(500);
-            Serial.print(".");
-            attempts++;
-        }
-        
-        if (WiFi.status() == WL_CONNECTED) {
-            Serial.println("\nConnected to custom WiFi!");
-            Serial.print("IP address: ");
-            Serial.println(WiFi.localIP());
-            return true;
-        }
+        wifiJoinState = WIFI_JOIN_CUSTOM;
+    } else {
+        WiFi.begin("water_level", "w4t3r_l3v3l");
+        wifiJoinState = WIFI_JOIN_DEFAULT;
     }
-    
-    // Try default WiFi
-    Serial.println("\nTrying default WiFi...");
-    WiFi.begin("water_level", "w4t3r_l3v3l");
-    
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-        delay(500);
-        Serial.print(".");
-        attempts++;
+    wifiJoinStartedAt = millis();
+}
+
+// One non-blocking step: notices the connection, or gives up on the custom
+// network after WIFI_JOIN_TIMEOUT_MS and tries the default one
+WiFiJoinState serviceWiFiJoin()
+{
+    if (wifiJoinState != WIFI_JOIN_CUSTOM && wifiJoinState != WIFI_JOIN_DEFAULT) {
+        return wifiJoinState;
     }
-    
+
     if (WiFi.status() == WL_CONNECTED) {
-        Serial.println("\nConnected to default WiFi!");
-        Serial.print("IP address: ");
-        Serial.println(WiFi.localIP());
-        return true;
+        logEvent(EVENT_INFO, EVT_NETWORK, "Connected to %s WiFi, IP address: %s",
+                 wifiJoinState == WIFI_JOIN_CUSTOM ? "custom" : "default",
+                 WiFi.localIP().toString().c_str());
+        wifiJoinState = WIFI_JOIN_CONNECTED;
+        bootTimeline.mark("wifiJoined", millis());
+    } else if (millis() - wifiJoinStartedAt >= WIFI_JOIN_TIMEOUT_MS) {
+        if (wifiJoinState == WIFI_JOIN_CUSTOM) {
+            logEvent(EVENT_WARN, EVT_NETWORK, "Custom WiFi failed - Trying default WiFi");
+            WiFi.disconnect();
+            WiFi.begin("water_level", "w4t3r_l3v3l");
+            wifiJoinState = WIFI_JOIN_DEFAULT;
+            wifiJoinStartedAt = millis();
+        } else {
+            logEvent(EVENT_ERROR, EVT_NETWORK, "ONLINE mode failed - No WiFi connection");
+            wifiJoinState = WIFI_JOIN_FAILED;
+        }
     }
-    
-    Serial.println("\nFailed to connect to any WiFi network");
-    return false;
+    return wifiJoinState;
+}
+
+// Blocking join, for the low-power flush where nothing else has to run
+bool connectToWiFi()
+{
+    beginWiFiJoin();
+    while (serviceWiFiJoin() != WIFI_JOIN_CONNECTED && wifiJoinState != WIFI_JOIN_FAILED) {
+        delay(WIFI_POLL_MS);
+    }
+    return wifiJoinState == WIFI_JOIN_CONNECTED;
 }
 
 bool checkInternetConnection()
@@ -671,10 +1243,24 @@ bool checkInternetConnection()
 
 void setupWebServer()
 {
-    server.enableCORS(true);
+    loadIndexEtag();
+    DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", "*");
+
+    // Time to first request, for /bootTiming
+    server.addMiddleware([](AsyncWebServerRequest *request, ArMiddlewareNext next) {
+        if (!firstRequestSeen.exchange(true, std::memory_order_relaxed)) {
+            bootTimeline.mark("firstRequest", millis());
+        }
+        next();
+    });
 
+    // Handlers also match sub-paths ("/data" matches "/data/since") and are
+    // tried in order, so longer paths are registered first
     server.on("/", HTTP_GET, handleRoot);
     server.on("/getData", HTTP_GET, handleGetData);
+    server.on("/data/since", HTTP_GET, handleDataSince);
+    server.on("/data", HTTP_GET, handleQueryData);
+    server.on("/series", HTTP_GET, handleSeries);
     server.on("/deleteData", HTTP_POST, handleDeleteData);
     server.on("/settings", HTTP_POST, handleSettings);
     server.on("/calibration", HTTP_POST, handleCalibration);
@@ -686,293 +1272,543 @@ void setupWebServer()
     server.on("/restart", HTTP_POST, handleRestart);
     server.on("/uptime", HTTP_GET, handleUptime);
     server.on("/storageInfo", HTTP_GET, handleStorageInfo);
+    server.on("/heapInfo", HTTP_GET, handleHeapInfo);
+    server.on("/sleepStats", HTTP_GET, handleSleepStats);
+    server.on("/bootTiming", HTTP_GET, handleBootTiming);
+    server.on("/channels", HTTP_GET, handleChannels);
+    server.on("/channels", HTTP_POST, handleChannelSettings);
+
+    // GET /events - Server-Sent Events stream of measurements, serial lines
+    // and a periodic status frame. Extra streams are refused so they cannot
+    // use up the few lwIP sockets; the dashboard then falls back to polling.
+    events.setFilter([](AsyncWebServerRequest *request) {
+        return events.count() < MAX_EVENT_CLIENTS;
+    });
+    events.onConnect([](AsyncEventSourceClient *client) {
+        client->send("hello", NULL, millis(), 5000); // Sets the reconnect delay
+        publishLevel();
+        publishStatus();
+    });
+    server.addHandler(&events);
 
     server.begin();
 }
 
-void handleRoot()
+void loadIndexEtag()
 {
-    if (SPIFFS.exists("/index.html"))
+    File file = SPIFFS.open(INDEX_ETAG_FILE, "r");
+    if (file)
     {
-        File file = SPIFFS.open("/index.html", "r");
-        if (file)
-        {
-            server.streamFile(file, "text/html");
-            file.close();
-        }
-        else
+        indexEtag = file.readString();
+        indexEtag.trim();
+        file.close();
+    }
+}
+
+// The filesystem image holds index.html.gz, which ESPAsyncWebServer sends
+// with Content-Encoding: gzip when asked for /index.html. Browsers keep the
+// page for INDEX_MAX_AGE and then revalidate with If-None-Match, which costs
+// a bodiless 304 until the page changes.
+void handleRoot(AsyncWebServerRequest *request)
+{
+    if (indexEtag.length() > 0 && request->hasHeader("If-None-Match") &&
+        request->header("If-None-Match") == indexEtag)
+    {
+        AsyncWebServerResponse *response = request->beginResponse(304);
+        response->addHeader("ETag", indexEtag);
+        response->addHeader("Cache-Control", "max-age=" + String(INDEX_MAX_AGE));
+        request->send(response);
+        return;
+    }
+
+    // Served in chunks from the AsyncTCP task, so a slow client does not
+    // hold up other requests or the measurement loop
+    if (SPIFFS.exists("/index.html") || SPIFFS.exists("/index.html.gz"))
+    {
+        AsyncWebServerResponse *response = request->beginResponse(SPIFFS, "/index.html", "text/html");
+        if (indexEtag.length() > 0)
         {
-            server.send(500, "text/plain", "Error reading file");
+            response->addHeader("ETag", indexEtag);
+            response->addHeader("Cache-Control", "max-age=" + String(INDEX_MAX_AGE));
         }
+        request->send(response);
     }
     else
     {
-        server.send(404, "text/plain", "File not found - index.html missing from SPIFFS");
+        request->send(404, "text/plain", "File not found - index.html missing from SPIFFS");
     }
 }
 
-void handleGetData()
+// Channel named by the request's channel= argument, or fallback without
+// one; -1 for a channel that does not exist
+int channelArg(AsyncWebServerRequest *request, int fallback)
 {
-    if (SPIFFS.exists(DATA_FILE))
+    if (!request->hasArg("channel"))
     {
-        File file = SPIFFS.open(DATA_FILE, "r");
-        if (file)
-        {
-            server.streamFile(file, "text/csv");
-            file.close();
-        }
-        else
-        {
-            server.send(500, "text/plain", "Error reading data file");
-        }
+        return fallback;
     }
-    else
+    long channel = request->arg("channel").toInt();
+    return (channel >= 0 && channel < MAX_CHANNELS) ? channel : -1;
+}
+
+// GET /getData[?channel=N]
+// Every channel unless one is given; rows name the station of their channel
+void handleGetData(AsyncWebServerRequest *request)
+{
+    if (!dataLog.isOpen())
     {
-        server.send(404, "text/plain", "No data found");
+        request->send(500, "text/plain", "Error reading data file");
+        return;
     }
+    int channel = channelArg(request, -1);
+    if (channel < 0 && request->hasArg("channel"))
+    {
+        request->send(400, "text/plain", "Unknown channel");
+        return;
+    }
+
+    // The archive is decoded on the fly ahead of the records still in the log
+    std::lock_guard<std::recursive_mutex> lock(stateMutex);
+    request->send(beginStreamResponse(
+        request, "text/csv",
+        new CsvRecordStream(history, history.firstSeq(), history.lastSeq() + 1, stationTable(), channel)));
 }
 
-void handleDeleteData()
+// GET /data?from=&to=&limit=&offset=
+// Rows of every channel, each under the station of its channel.
+// from/to are inclusive epoch seconds; a negative offset counts back from
+// the end of the range, so offset=-144&limit=144 returns the latest 144.
+void handleQueryData(AsyncWebServerRequest *request)
 {
-    if (SPIFFS.remove(DATA_FILE))
+    if (!dataLog.isOpen())
     {
-        File file = SPIFFS.open(DATA_FILE, "w");
-        if (file)
-        {
-            file.println("Station ID,Station Name,DateTime,Water Level (Blok) (cm),Water Level (Parit) (cm),Raw Distance (cm)");
-            file.close();
-            server.send(200, "text/plain", "Data deleted successfully");
-        }
-        else
-        {
-            server.send(500, "text/plain", "Error creating new data file");
-        }
+        request->send(500, "text/plain", "Error reading data file");
+        return;
+    }
+
+    DataQuery query;
+    query.hasFrom = request->hasArg("from");
+    query.from = request->arg("from").toInt();
+    query.hasTo = request->hasArg("to");
+    query.to = request->arg("to").toInt();
+    query.offset = request->arg("offset").toInt();
+    query.limit = MAX_QUERY_RECORDS;
+    if (request->hasArg("limit"))
+    {
+        query.limit = constrain(request->arg("limit").toInt(), 0, MAX_QUERY_RECORDS);
+    }
+    SeqRange range = resolveDataQuery(history, query);
+
+    std::lock_guard<std::recursive_mutex> lock(stateMutex);
+    AsyncWebServerResponse *response = beginStreamResponse(
+        request, "text/csv",
+        new CsvRecordStream(history, range.first, range.end, stationTable()));
+    response->addHeader("X-Total-Count", String(range.total));
+    request->send(response);
+}
+
+// Chunked response that pulls its body from a RecordStream as the socket
+// drains. The response owns the stream and frees it when the request ends.
+AsyncWebServerResponse *beginStreamResponse(AsyncWebServerRequest *request, const char *contentType,
+                                            RecordStream *stream)
+{
+    std::shared_ptr<RecordStream> body(stream);
+    return request->beginChunkedResponse(contentType, [body](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        return body->fill(buffer, maxLen);
+    });
+}
+
+// GET /series?from=&to=&points=N&field=blok|parit|raw&channel=N
+// Returns at most N time buckets as [start, count, min, max, mean] of one
+// channel, 0 unless given. Without from/to the range ends at the newest
+// record; span= sets its length in seconds, otherwise the whole log is
+// covered.
+void handleSeries(AsyncWebServerRequest *request)
+{
+    if (!dataLog.isOpen())
+    {
+        request->send(500, "text/plain", "Error reading data file");
+        return;
+    }
+    int channel = channelArg(request, 0);
+    if (channel < 0)
+    {
+        request->send(400, "text/plain", "Unknown channel");
+        return;
+    }
+
+    SeriesQuery query;
+    query.hasFrom = request->hasArg("from");
+    query.from = request->arg("from").toInt();
+    query.hasTo = request->hasArg("to");
+    query.to = request->arg("to").toInt();
+    query.hasSpan = request->hasArg("span");
+    query.span = request->arg("span").toInt();
+    TimeRange range = resolveSeriesQuery(history, query);
+
+    uint32_t points = 300;
+    if (request->hasArg("points"))
+    {
+        points = constrain(request->arg("points").toInt(), 1, MAX_SERIES_POINTS);
+    }
+
+    SeriesField field = SERIES_BLOK;
+    if (request->arg("field") == "parit")
+    {
+        field = SERIES_PARIT;
+    }
+    else if (request->arg("field") == "raw")
+    {
+        field = SERIES_RAW;
+    }
+
+    // One streaming pass over the range; only the current bucket is in memory
+    request->send(beginStreamResponse(request, "application/json",
+                                      new SeriesRecordStream(history, range.from, range.to, points, field,
+                                                             channel)));
+}
+
+// GET /data/since?seq=N&channel=N
+// Records of one channel, 0 unless given, newer than sequence number N as
+// [seq, epoch, blok, parit, raw]. "seq" in the reply is the cursor for the
+// next call. "gap" means records after N were already overwritten; "reset"
+// means N is ahead of the log (it was reformatted) and the client should
+// reload its history.
+void handleDataSince(AsyncWebServerRequest *request)
+{
+    if (!dataLog.isOpen())
+    {
+        request->send(500, "text/plain", "Error reading data file");
+        return;
+    }
+    int channel = channelArg(request, 0);
+    if (channel < 0)
+    {
+        request->send(400, "text/plain", "Unknown channel");
+        return;
+    }
+
+    uint32_t since = request->arg("seq").toInt();
+    request->send(beginStreamResponse(request, "application/json",
+                                      new SinceRecordStream(dataLog, since, MAX_QUERY_RECORDS, channel)));
+}
+
+void handleDeleteData(AsyncWebServerRequest *request)
+{
+    logStage.clear();
+    if (logArchive.isOpen())
+    {
+        logArchive.clear();
+    }
+    if (dataLog.clear())
+    {
+        request->send(200, "text/plain", "Data deleted successfully");
     }
     else
     {
-        server.send(500, "text/plain", "Failed to delete data");
+        request->send(500, "text/plain", "Failed to delete data");
     }
 }
 
-void handleSettings()
+void handleSettings(AsyncWebServerRequest *request)
 {
-    if (server.hasArg("sensorType"))
+    std::lock_guard<std::recursive_mutex> lock(stateMutex);
+    if (request->hasArg("sensorType"))
     {
-        String sensorTypeStr = server.arg("sensorType");
+        String sensorTypeStr = request->arg("sensorType");
         config.sensorType = sensorTypeStr.equals("A01NYUB") ? A01NYUB_SENSOR : HCSR04_SENSOR;
     }
-    if (server.hasArg("stationId"))
+    if (request->hasArg("stationId"))
     {
-        config.stationId = server.arg("stationId").toInt();
+        config.stationId = request->arg("stationId").toInt();
     }
-    if (server.hasArg("stationName"))
+    if (request->hasArg("stationName"))
     {
-        config.stationName = server.arg("stationName");
+        config.stationName = limitStationName(request->arg("stationName"));
     }
-    if (server.hasArg("interval"))
+    if (request->hasArg("interval"))
     {
-        unsigned long seconds = server.arg("interval").toInt();
+        unsigned long seconds = request->arg("interval").toInt();
         config.measurementInterval = max(MINIMUM_INTERVAL, seconds * 1000UL);
     }
-    if (server.hasArg("sensorToBottomDistance"))
+    if (request->hasArg("adaptiveSampling"))
     {
-        config.sensorToBottomDistance = server.arg("sensorToBottomDistance").toFloat();
+        config.adaptiveSampling = request->arg("adaptiveSampling").equals("true");
     }
-    if (server.hasArg("sensorToZeroBlokDistance"))
+    if (request->hasArg("maxInterval"))
     {
-        config.sensorToZeroBlokDistance = server.arg("sensorToZeroBlokDistance").toFloat();
+        unsigned long seconds = request->arg("maxInterval").toInt();
+        config.maxMeasurementInterval = max(MINIMUM_INTERVAL, seconds * 1000UL);
     }
-    if (server.hasArg("operationMode"))
+    if (request->hasArg("fastRateThreshold"))
     {
-        config.operationMode = server.arg("operationMode").equals("ONLINE") ? ONLINE_MODE : OFFLINE_MODE;
+        float rate = request->arg("fastRateThreshold").toFloat();
+        if (rate > 0)
+        {
+            config.fastRateThreshold = rate;
+        }
+    }
+    applySchedule();
+    if (request->hasArg("sensorToBottomDistance"))
+    {
+        config.sensorToBottomDistance = request->arg("sensorToBottomDistance").toFloat();
+    }
+    if (request->hasArg("sensorToZeroBlokDistance"))
+    {
+        config.sensorToZeroBlokDistance = request->arg("sensorToZeroBlokDistance").toFloat();
+    }
+    if (request->hasArg("operationMode"))
+    {
+        config.operationMode = parseOperationMode(request->arg("operationMode"));
     }
-    if (server.hasArg("wifiSSID"))
+    if (request->hasArg("wifiSSID"))
     {
-        config.wifiSSID = server.arg("wifiSSID");
+        config.wifiSSID = request->arg("wifiSSID");
     }
-    if (server.hasArg("wifiPassword"))
+    if (request->hasArg("wifiPassword"))
     {
-        config.wifiPassword = server.arg("wifiPassword");
+        config.wifiPassword = request->arg("wifiPassword");
     }
-    if (server.hasArg("apiEndpoint"))
+    if (request->hasArg("apiEndpoint"))
     {
-        config.apiEndpoint = server.arg("apiEndpoint");
+        config.apiEndpoint = request->arg("apiEndpoint");
     }
-    if (server.hasArg("apiToken"))
+    if (request->hasArg("apiToken"))
     {
-        config.apiToken = server.arg("apiToken");
+        config.apiToken = request->arg("apiToken");
     }
-    if (server.hasArg("dataSyncInterval"))
+    if (request->hasArg("dataSyncInterval"))
     {
-        unsigned long hours = server.arg("dataSyncInterval").toInt();
+        unsigned long hours = request->arg("dataSyncInterval").toInt();
         config.dataSyncInterval = hours * 3600000UL; // Convert hours to milliseconds
     }
+    if (request->hasArg("uploadBatchSize"))
+    {
+        config.uploadBatchSize = constrain(request->arg("uploadBatchSize").toInt(), 1, (long)Uploader::MAX_BATCH);
+    }
+    if (request->hasArg("filterMode"))
+    {
+        parseFilterMode(request->arg("filterMode").c_str(), config.filterMode);
+    }
+    if (request->hasArg("samplesPerReading"))
+    {
+        config.samplesPerReading = constrain(request->arg("samplesPerReading").toInt(), 1, (long)SampleFilter::MAX_SAMPLES);
+    }
+    if (request->hasArg("flushEvery"))
+    {
+        config.flushEvery = constrain(request->arg("flushEvery").toInt(), 1, (long)SLEEP_BUFFER_SIZE);
+    }
 
     if (saveConfig())
     {
-        if (config.sensorType == HCSR04_SENSOR)
-        {
-            pinMode(TRIGGER_PIN, OUTPUT);
-            pinMode(ECHO_PIN, INPUT);
-            Serial2.end();
-        }
-        else
-        {
-            pinMode(TRIGGER_PIN, INPUT);
-            pinMode(ECHO_PIN, INPUT);
-        }
-        
-        server.send(200, "text/plain", "Settings saved successfully. Restart required for mode changes.");
+        sensorChanged.store(true);
+        request->send(200, "text/plain", "Settings saved successfully. Restart required for mode changes.");
     }
     else
     {
-        server.send(500, "text/plain", "Failed to save settings");
+        request->send(500, "text/plain", "Failed to save settings");
     }
 }
 
-void handleCalibration()
+void handleCalibration(AsyncWebServerRequest *request)
 {
-    if (server.hasArg("offset"))
+    std::lock_guard<std::recursive_mutex> lock(stateMutex);
+    if (request->hasArg("offset"))
     {
-        config.calibrationOffset = server.arg("offset").toFloat();
+        config.calibrationOffset = request->arg("offset").toFloat();
 
         if (saveConfig())
         {
-            server.send(200, "text/plain", "Calibration saved successfully");
+            request->send(200, "text/plain", "Calibration saved successfully");
         }
         else
         {
-            server.send(500, "text/plain", "Failed to save calibration");
+            request->send(500, "text/plain", "Failed to save calibration");
         }
     }
     else
     {
-        server.send(400, "text/plain", "Missing offset parameter");
+        request->send(400, "text/plain", "Missing offset parameter");
     }
 }
 
-void handleSetTime()
+void handleSetTime(AsyncWebServerRequest *request)
 {
-    if (server.hasArg("year") && server.hasArg("month") &&
-        server.hasArg("day") && server.hasArg("hour") &&
-        server.hasArg("minute") && server.hasArg("second"))
+    std::lock_guard<std::recursive_mutex> lock(stateMutex);
+    if (request->hasArg("year") && request->hasArg("month") &&
+        request->hasArg("day") && request->hasArg("hour") &&
+        request->hasArg("minute") && request->hasArg("second"))
     {
 
-        config.dateTime.year = server.arg("year").toInt();
-        config.dateTime.month = server.arg("month").toInt();
-        config.dateTime.day = server.arg("day").toInt();
-        config.dateTime.hour = server.arg("hour").toInt();
-        config.dateTime.minute = server.arg("minute").toInt();
-        config.dateTime.second = server.arg("second").toInt();
-
+        // The DS3231 keeps the time on its own battery; nothing else is saved
         rtc.adjust(DateTime(
-            config.dateTime.year,
-            config.dateTime.month,
-            config.dateTime.day,
-            config.dateTime.hour,
-            config.dateTime.minute,
-            config.dateTime.second));
+            request->arg("year").toInt(),
+            request->arg("month").toInt(),
+            request->arg("day").toInt(),
+            request->arg("hour").toInt(),
+            request->arg("minute").toInt(),
+            request->arg("second").toInt()));
+        getEpochTime(); // Re-anchor log timestamps
 
-        if (saveConfig())
-        {
-            server.send(200, "text/plain", "Time set successfully");
-        }
-        else
-        {
-            server.send(500, "text/plain", "Failed to save time settings");
-        }
+        request->send(200, "text/plain", "Time set successfully");
     }
     else
     {
-        server.send(400, "text/plain", "Missing time parameters");
+        request->send(400, "text/plain", "Missing time parameters");
     }
 }
 
-void handleSerial()
+// GET /serial returns the log lines still held, oldest first. With
+// ?since=<seq> it returns only lines after that one; X-Next-Seq carries the
+// cursor for the next call and X-Lost how many lines were skipped.
+void handleSerial(AsyncWebServerRequest *request)
 {
-    String output;
-    for (int i = 0; i < SERIAL_BUFFER_SIZE; i++)
-    {
-        int index = (serialBufferIndex + i) % SERIAL_BUFFER_SIZE;
-        if (serialBuff[index].length() > 0)
-        {
-            output += serialBuff[index] + "\n";
+    uint32_t cursor = eventLog.oldestCursor();
+    if (request->hasArg("since")) {
+        uint32_t since = strtoul(request->arg("since").c_str(), NULL, 10);
+        if (since <= eventLog.lastSeq() && since > cursor) {
+            cursor = since;
         }
     }
-    server.send(200, "text/plain", output);
+
+    AsyncResponseStream *response = request->beginResponseStream("text/plain", EVENT_LOG_SIZE * 96);
+    Event event;
+    uint32_t lost = 0;
+    while (eventLog.read(cursor, event, &lost)) {
+        char line[SERIAL_LINE_LENGTH];
+        formatEventLine(line, sizeof(line), event);
+        response->print(line);
+        response->print('\n');
+    }
+    response->addHeader("X-Next-Seq", String(cursor));
+    response->addHeader("X-Lost", String(lost));
+    request->send(response);
 }
 
-void handleClients()
+void handleClients(AsyncWebServerRequest *request)
 {
-    if (config.operationMode == OFFLINE_MODE) {
+    if (config.operationMode != ONLINE_MODE) {
         wifi_sta_list_t stationList;
         tcpip_adapter_sta_list_t adapterList;
 
         esp_wifi_ap_get_sta_list(&stationList);
         tcpip_adapter_get_sta_list(&stationList, &adapterList);
 
-        String clientsList = "[";
+        // ~45 characters per station, and the AP takes at most MAX_CLIENTS
+        TextBuffer<32 + 48 * MAX_CLIENTS> clientsList;
+        clientsList.append('[');
         for (int i = 0; i < adapterList.num; i++)
         {
             if (i > 0)
-                clientsList += ",";
-            tcpip_adapter_sta_info_t station = adapterList.sta[i];
-            String mac = "";
-            for (int j = 0; j < 6; j++)
-            {
-                if (j > 0)
-                    mac += ":";
-                if (station.mac[j] < 0x10)
-                    mac += "0";
-                mac += String(station.mac[j], HEX);
-            }
-            String ip = String(station.ip.addr & 0xFF) + "." +
-                        String((station.ip.addr >> 8) & 0xFF) + "." +
-                        String((station.ip.addr >> 16) & 0xFF) + "." +
-                        String((station.ip.addr >> 24) & 0xFF);
-            clientsList += "\"" + ip + " (MAC: " + mac + ")\"";
+                clientsList.append(',');
+            const tcpip_adapter_sta_info_t &station = adapterList.sta[i];
+            const uint8_t *mac = station.mac;
+            uint32_t ip = station.ip.addr;
+            clientsList.appendf("\"%lu.%lu.%lu.%lu (MAC: %02x:%02x:%02x:%02x:%02x:%02x)\"",
+                                (unsigned long)(ip & 0xFF), (unsigned long)((ip >> 8) & 0xFF),
+                                (unsigned long)((ip >> 16) & 0xFF), (unsigned long)((ip >> 24) & 0xFF),
+                                mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
         }
-        clientsList += "]";
-        server.send(200, "application/json", clientsList);
+        clientsList.append(']');
+        request->send(200, "application/json", clientsList.c_str());
     } else {
         // Online mode - show WiFi connection status
-        String status = "[\"WiFi: " + WiFi.localIP().toString() + 
-                       " (Internet: " + (hasInternetConnection ? "Yes" : "No") + ")\"]";
-        server.send(200, "application/json", status);
+        IPAddress ip = WiFi.localIP();
+        char status[80];
+        snprintf(status, sizeof(status), "[\"WiFi: %u.%u.%u.%u (Internet: %s)\"]",
+                 ip[0], ip[1], ip[2], ip[3], hasInternetConnection ? "Yes" : "No");
+        request->send(200, "application/json", status);
     }
 }
 
-void handleCurrentLevel()
+void publishEvent(const char *event, const char *data)
 {
-    JsonDocument doc;
-    doc["waterLevelBlok"] = currentWaterLevelBlok;
-    doc["waterLevelParit"] = currentWaterLevelParit;
-    doc["rawDistance"] = currentRawDistance;
-    doc["operationMode"] = (config.operationMode == ONLINE_MODE) ? "ONLINE" : "OFFLINE";
-    doc["internetConnection"] = hasInternetConnection;
-    
-    String jsonString;
-    serializeJson(doc, jsonString);
-    server.send(200, "application/json", jsonString);
+    events.send(data, event, millis());
 }
 
-void handleGetConfig()
+void publishLevel()
 {
-    JsonDocument doc;
+    char frame[256];
+    snprintf(frame, sizeof(frame),
+             "{\"waterLevelBlok\":%.2f,\"waterLevelParit\":%.2f,\"rawDistance\":%.2f,\"quality\":%.2f,"
+             "\"operationMode\":\"%s\",\"internetConnection\":%s,\"seq\":%lu,\"epoch\":%lu}",
+             currentWaterLevelBlok, currentWaterLevelParit, currentRawDistance, currentQuality,
+             operationModeName(config.operationMode),
+             hasInternetConnection ? "true" : "false",
+             (unsigned long)dataLog.lastSeq(), (unsigned long)getEpochTime());
+    publishEvent("level", frame);
+}
+
+void publishStatus()
+{
+    char frame[64];
+    snprintf(frame, sizeof(frame), "{\"uptime\":%lu,\"stations\":%u}",
+             millis() / 1000, (unsigned)WiFi.softAPgetStationNum());
+    publishEvent("status", frame);
+}
+
+// Heartbeat for open event streams, plus a nudge when hotspot clients change
+void updateEventClients()
+{
+    static unsigned long lastHeartbeat = 0;
+    static uint8_t lastStations = 0;
+
+    if (millis() - lastHeartbeat >= EVENT_HEARTBEAT_MS)
+    {
+        publishStatus();
+        lastHeartbeat = millis();
+    }
+
+    uint8_t stations = WiFi.softAPgetStationNum();
+    if (stations != lastStations)
+    {
+        lastStations = stations;
+        publishEvent("clients", "{}");
+    }
+}
+
+void handleCurrentLevel(AsyncWebServerRequest *request)
+{
+    char body[192];
+    {
+        std::lock_guard<std::recursive_mutex> lock(stateMutex);
+        snprintf(body, sizeof(body),
+                 "{\"waterLevelBlok\":%.2f,\"waterLevelParit\":%.2f,\"rawDistance\":%.2f,\"quality\":%.2f,"
+                 "\"operationMode\":\"%s\",\"internetConnection\":%s}",
+                 currentWaterLevelBlok, currentWaterLevelParit, currentRawDistance, currentQuality,
+                 operationModeName(config.operationMode),
+                 hasInternetConnection ? "true" : "false");
+    }
+    request->send(200, "application/json", body);
+}
+
+void handleGetConfig(AsyncWebServerRequest *request)
+{
+    std::lock_guard<std::recursive_mutex> lock(stateMutex);
+
+    JsonArenaBuffer<JSON_ARENA_SIZE> arena;
+    JsonDocument doc(&arena);
 
     doc["stationId"] = config.stationId;
     doc["stationName"] = config.stationName;
     doc["measurementInterval"] = config.measurementInterval;
+    doc["adaptiveSampling"] = config.adaptiveSampling;
+    doc["maxMeasurementInterval"] = config.maxMeasurementInterval;
+    doc["fastRateThreshold"] = config.fastRateThreshold;
     doc["calibrationOffset"] = config.calibrationOffset;
     doc["sensorType"] = (int)config.sensorType;
     doc["sensorToBottomDistance"] = config.sensorToBottomDistance;
     doc["sensorToZeroBlokDistance"] = config.sensorToZeroBlokDistance;
-    doc["operationMode"] = (config.operationMode == ONLINE_MODE) ? "ONLINE" : "OFFLINE";
+    doc["operationMode"] = operationModeName(config.operationMode);
     doc["wifiSSID"] = config.wifiSSID;
     doc["wifiPassword"] = config.wifiPassword;
     doc["apiEndpoint"] = config.apiEndpoint;
     doc["apiToken"] = config.apiToken;
     doc["dataSyncInterval"] = config.dataSyncInterval / 3600000; // Convert to hours
+    doc["uploadBatchSize"] = config.uploadBatchSize;
+    doc["filterMode"] = filterModeName(config.filterMode);
+    doc["samplesPerReading"] = config.samplesPerReading;
+    doc["flushEvery"] = config.flushEvery;
 
     DateTime now = rtc.now();
     JsonObject dateTime = doc["dateTime"].to<JsonObject>();
@@ -983,19 +1819,224 @@ void handleGetConfig()
     dateTime["minute"] = now.minute();
     dateTime["second"] = now.second();
 
-    String jsonString;
-    serializeJson(doc, jsonString);
-    server.send(200, "application/json", jsonString);
+    sendJson(request, doc);
+}
+
+// GET /channels
+// Every channel with its port, station, calibration and stats. "active" is
+// false for a channel that is off or whose port a lower channel has taken.
+// passMs is how long the last interleaved pass over all channels took.
+// A01NYUB channels add the frames their UART has received and how many
+// were dropped for a bad checksum.
+void handleChannels(AsyncWebServerRequest *request)
+{
+    std::lock_guard<std::recursive_mutex> lock(stateMutex);
+
+    JsonArenaBuffer<JSON_ARENA_SIZE> arena;
+    JsonDocument doc(&arena);
+
+    doc["passMs"] = lastPassMs;
+    JsonArray channels = doc["channels"].to<JsonArray>();
+    StationTable stations = stationTable();
+    for (int channel = 0; channel < MAX_CHANNELS; channel++) {
+        JsonObject entry = channels.add<JsonObject>();
+        Calibration calibration = channelCalibration(channel);
+        const ChannelStats &stats = channelStats[channel];
+        entry["channel"] = channel;
+        entry["enabled"] = channel == 0 || config.channels[channel - 1].enabled;
+        entry["active"] = channelActive(channel);
+        entry["port"] = portName(channelPort(channel));
+        entry["stationId"] = stations.ids[channel];
+        entry["stationName"] = (const char *)stations.names[channel];
+        entry["calibrationOffset"] = calibration.calibrationOffset;
+        entry["sensorToBottomDistance"] = calibration.sensorToBottomDistance;
+        entry["sensorToZeroBlokDistance"] = calibration.sensorToZeroBlokDistance;
+        entry["readings"] = stats.readings;
+        entry["failures"] = stats.failures;
+        entry["lastEpoch"] = stats.lastEpoch;
+        entry["blok"] = stats.blok;
+        entry["parit"] = stats.parit;
+        entry["raw"] = stats.raw;
+        entry["quality"] = stats.quality;
+        entry["lastDurationMs"] = stats.lastDurationMs;
+        entry["maxDurationMs"] = stats.maxDurationMs;
+        if (channelPort(channel) != PORT_HCSR04) {
+            A01nyubSensor &uart = uartSensorOn(channelPort(channel));
+            entry["frames"] = uart.frames();
+            entry["checksumErrors"] = uart.checksumErrors();
+        }
+    }
+
+    sendJson(request, doc);
 }
 
+// POST /channels?channel=N&enabled=&port=&stationId=&stationName=&offset=&sensorToBottomDistance=&sensorToZeroBlokDistance=
+// Channel 0 is set up with /settings and /calibration. The new settings
+// apply from the next measurement.
+void handleChannelSettings(AsyncWebServerRequest *request)
+{
+    int channel = channelArg(request, -1);
+    if (channel < 1)
+    {
+        request->send(400, "text/plain", "channel must be 1 to " + String(MAX_CHANNELS - 1));
+        return;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(stateMutex);
+    ChannelConfig updated = config.channels[channel - 1];
+    if (request->hasArg("enabled"))
+    {
+        updated.enabled = request->arg("enabled").equals("true");
+    }
+    if (request->hasArg("port") && !parsePort(request->arg("port"), updated.port))
+    {
+        request->send(400, "text/plain", "port must be hcsr04, uart2 or uart1");
+        return;
+    }
+    if (request->hasArg("stationId"))
+    {
+        updated.stationId = request->arg("stationId").toInt();
+    }
+    if (request->hasArg("stationName"))
+    {
+        updated.stationName = limitStationName(request->arg("stationName"));
+    }
+    if (request->hasArg("offset"))
+    {
+        updated.calibrationOffset = request->arg("offset").toFloat();
+    }
+    if (request->hasArg("sensorToBottomDistance"))
+    {
+        updated.sensorToBottomDistance = request->arg("sensorToBottomDistance").toFloat();
+    }
+    if (request->hasArg("sensorToZeroBlokDistance"))
+    {
+        updated.sensorToZeroBlokDistance = request->arg("sensorToZeroBlokDistance").toFloat();
+    }
+
+    if (updated.enabled)
+    {
+        for (int other = 0; other < MAX_CHANNELS; other++)
+        {
+            bool otherEnabled = other == 0 || config.channels[other - 1].enabled;
+            if (other != channel && otherEnabled && channelPort(other) == updated.port)
+            {
+                request->send(409, "text/plain", "Port is used by channel " + String(other));
+                return;
+            }
+        }
+    }
+
+    config.channels[channel - 1] = updated;
+    if (saveConfig())
+    {
+        request->send(200, "text/plain", "Channel saved successfully");
+    }
+    else
+    {
+        request->send(500, "text/plain", "Failed to save channel");
+    }
+}
+
+// Settings live in NVS, one key per field, written only when they change.
+// NVS commits each key atomically, so a power cut during a save leaves
+// every setting either old or new, never a corrupt file. A key that is
+// missing holds the firmware default. Keys are at most 15 characters.
 bool loadConfig()
 {
-    if (!SPIFFS.exists(CONFIG_FILE))
+    Preferences prefs;
+    uint16_t version = 0;
+    // Opening read-only fails if the namespace was never written
+    if (prefs.begin(CONFIG_NAMESPACE, true))
+    {
+        version = prefs.getUShort("version", 0);
+    }
+    if (version == 0)
+    {
+        prefs.end();
+        // First boot on this firmware: bring over the old JSON file
+        savedConfig = Config();
+        configStored = false;
+        if (!loadLegacyConfig())
+        {
+            return false;
+        }
+        if (saveConfig())
+        {
+            SPIFFS.remove(LEGACY_CONFIG_FILE);
+        }
+        return true;
+    }
+
+    // A version newer than CONFIG_VERSION was written by later firmware;
+    // the keys this one knows are still read
+    readSettings(prefs, config);
+    prefs.end();
+
+    savedConfig = config;
+    configStored = version == CONFIG_VERSION;
+    return true;
+}
+
+// Fill target from the open namespace, with defaults for missing keys
+void readSettings(Preferences &prefs, Config &target)
+{
+    const Config defaults;
+    target.stationId = prefs.getInt("stationId", defaults.stationId);
+    target.stationName = limitStationName(prefs.getString("stationName", defaults.stationName));
+    target.measurementInterval = prefs.getUInt("interval", defaults.measurementInterval);
+    target.adaptiveSampling = prefs.getInt("adaptive", defaults.adaptiveSampling) != 0;
+    target.maxMeasurementInterval = prefs.getUInt("maxInterval", defaults.maxMeasurementInterval);
+    target.fastRateThreshold = prefs.getFloat("fastRate", defaults.fastRateThreshold);
+    target.calibrationOffset = prefs.getFloat("calOffset", defaults.calibrationOffset);
+    target.sensorToBottomDistance = prefs.getFloat("bottomDist", defaults.sensorToBottomDistance);
+    target.sensorToZeroBlokDistance = prefs.getFloat("zeroBlokDist", defaults.sensorToZeroBlokDistance);
+    target.sensorType = (SensorType)prefs.getInt("sensorType", defaults.sensorType);
+    target.operationMode = (OperationMode)prefs.getInt("opMode", defaults.operationMode);
+    target.wifiSSID = prefs.getString("wifiSSID", defaults.wifiSSID);
+    target.wifiPassword = prefs.getString("wifiPass", defaults.wifiPassword);
+    target.apiEndpoint = prefs.getString("apiEndpoint", defaults.apiEndpoint);
+    target.apiToken = prefs.getString("apiToken", defaults.apiToken);
+    target.dataSyncInterval = prefs.getUInt("syncInterval", defaults.dataSyncInterval);
+    target.uploadBatchSize = prefs.getInt("batchSize", defaults.uploadBatchSize);
+    target.filterMode = (FilterMode)prefs.getInt("filterMode", defaults.filterMode);
+    target.samplesPerReading = prefs.getInt("samples", defaults.samplesPerReading);
+    target.flushEvery = prefs.getInt("flushEvery", defaults.flushEvery);
+
+    // Channels 1 and up as ch<N><field>
+    for (int channel = 1; channel < MAX_CHANNELS; channel++) {
+        const ChannelConfig &fallback = defaults.channels[channel - 1];
+        ChannelConfig &channelConfig = target.channels[channel - 1];
+        char key[16];
+        snprintf(key, sizeof(key), "ch%dOn", channel);
+        channelConfig.enabled = prefs.getInt(key, fallback.enabled) != 0;
+        snprintf(key, sizeof(key), "ch%dPort", channel);
+        channelConfig.port = (SensorPort)prefs.getInt(key, fallback.port);
+        snprintf(key, sizeof(key), "ch%dId", channel);
+        channelConfig.stationId = prefs.getInt(key, fallback.stationId);
+        snprintf(key, sizeof(key), "ch%dName", channel);
+        channelConfig.stationName = limitStationName(prefs.getString(key, fallback.stationName));
+        snprintf(key, sizeof(key), "ch%dOffset", channel);
+        channelConfig.calibrationOffset = prefs.getFloat(key, fallback.calibrationOffset);
+        snprintf(key, sizeof(key), "ch%dBottom", channel);
+        channelConfig.sensorToBottomDistance = prefs.getFloat(key, fallback.sensorToBottomDistance);
+        snprintf(key, sizeof(key), "ch%dZero", channel);
+        channelConfig.sensorToZeroBlokDistance = prefs.getFloat(key, fallback.sensorToZeroBlokDistance);
+        if (channelConfig.port >= SENSOR_PORTS) {
+            channelConfig.port = fallback.port;
+        }
+    }
+}
+
+// The /config.json written by earlier firmware
+bool loadLegacyConfig()
+{
+    if (!SPIFFS.exists(LEGACY_CONFIG_FILE))
     {
         return false;
     }
 
-    File file = SPIFFS.open(CONFIG_FILE, "r");
+    File file = SPIFFS.open(LEGACY_CONFIG_FILE, "r");
     if (!file)
     {
         return false;
@@ -1011,401 +2052,693 @@ bool loadConfig()
     }
 
     config.stationId = doc["stationId"] | 1;
-    config.stationName = doc["stationName"].as<String>();
+    config.stationName = limitStationName(doc["stationName"].as<String>());
     config.measurementInterval = doc["measurementInterval"] | 12000;
+    config.adaptiveSampling = doc["adaptiveSampling"] | true;
+    config.maxMeasurementInterval = doc["maxMeasurementInterval"] | DEFAULT_MAX_INTERVAL;
+    config.fastRateThreshold = doc["fastRateThreshold"] | DEFAULT_FAST_RATE;
     config.calibrationOffset = doc["calibrationOffset"] | 0.0;
     config.sensorToBottomDistance = doc["sensorToBottomDistance"] | 100.0;
     config.sensorToZeroBlokDistance = doc["sensorToZeroBlokDistance"] | 50.0;
     config.sensorType = (SensorType)(doc["sensorType"] | HCSR04_SENSOR);
-    config.operationMode = doc["operationMode"].as<String>().equals("ONLINE") ? ONLINE_MODE : OFFLINE_MODE;
+    config.operationMode = parseOperationMode(doc["operationMode"].as<String>());
     config.wifiSSID = doc["wifiSSID"].as<String>();
     config.wifiPassword = doc["wifiPassword"].as<String>();
     config.apiEndpoint = doc["apiEndpoint"].as<String>();
     config.apiToken = doc["apiToken"].as<String>();
     config.dataSyncInterval = doc["dataSyncInterval"] | 3600000;
-
-    JsonObject dateTime = doc["dateTime"];
-    if (dateTime)
+    config.uploadBatchSize = doc["uploadBatchSize"] | 10;
+    if (!parseFilterMode(doc["filterMode"] | "hampel", config.filterMode))
     {
-        config.dateTime.year = dateTime["year"] | 2024;
-        config.dateTime.month = dateTime["month"] | 1;
-        config.dateTime.day = dateTime["day"] | 1;
-        config.dateTime.hour = dateTime["hour"] | 0;
-        config.dateTime.minute = dateTime["minute"] | 0;
-        config.dateTime.second = dateTime["second"] | 0;
+        config.filterMode = FILTER_HAMPEL;
     }
-
+    config.samplesPerReading = constrain(doc["samplesPerReading"] | DEFAULT_SAMPLES_PER_READING, 1,
+                                         (int)SampleFilter::MAX_SAMPLES);
+    config.flushEvery = constrain(doc["flushEvery"] | DEFAULT_FLUSH_EVERY, 1, SLEEP_BUFFER_SIZE);
     return true;
 }
 
-bool saveConfig()
+// Write one setting if it differs from what NVS holds. A value back at its
+// default is removed rather than stored. Returns false if the write failed.
+static bool storeInt(Preferences &prefs, const char *key, int32_t value, int32_t saved, int32_t fallback)
 {
-    File file = SPIFFS.open(CONFIG_FILE, "w");
-    if (!file)
-    {
-        return false;
+    if (value == saved) {
+        return true;
     }
-
-    JsonDocument doc;
-
-    doc["stationId"] = config.stationId;
-    doc["stationName"] = config.stationName;
-    doc["measurementInterval"] = config.measurementInterval;
-    doc["calibrationOffset"] = config.calibrationOffset;
-    doc["sensorType"] = (int)config.sensorType;
-    doc["sensorToBottomDistance"] = config.sensorToBottomDistance;
-    doc["sensorToZeroBlokDistance"] = config.sensorToZeroBlokDistance;
-    doc["operationMode"] = (config.operationMode == ONLINE_MODE) ? "ONLINE" : "OFFLINE";
-    doc["wifiSSID"] = config.wifiSSID;
-    doc["wifiPassword"] = config.wifiPassword;
-    doc["apiEndpoint"] = config.apiEndpoint;
-    doc["apiToken"] = config.apiToken;
-    doc["dataSyncInterval"] = config.dataSyncInterval;
-
-    JsonObject dateTime = doc["dateTime"].to<JsonObject>();
-    dateTime["year"] = config.dateTime.year;
-    dateTime["month"] = config.dateTime.month;
-    dateTime["day"] = config.dateTime.day;
-    dateTime["hour"] = config.dateTime.hour;
-    dateTime["minute"] = config.dateTime.minute;
-    dateTime["second"] = config.dateTime.second;
-    
-    if (serializeJson(doc, file) == 0)
-    {
-        file.close();
-        return false;
+    configWrites++;
+    if (value == fallback) {
+        return prefs.remove(key) || !prefs.isKey(key);
     }
+    return prefs.putInt(key, value) == sizeof(value);
+}
 
-    file.close();
-    return true;
+static bool storeUInt(Preferences &prefs, const char *key, uint32_t value, uint32_t saved, uint32_t fallback)
+{
+    if (value == saved) {
+        return true;
+    }
+    configWrites++;
+    if (value == fallback) {
+        return prefs.remove(key) || !prefs.isKey(key);
+    }
+    return prefs.putUInt(key, value) == sizeof(value);
 }
 
-float readA01NYUB()
+static bool storeFloat(Preferences &prefs, const char *key, float value, float saved, float fallback)
 {
-    const int numMeasurements = 30;
-    float measurements[numMeasurements];
-    int validMeasurements = 0;
+    if (value == saved) {
+        return true;
+    }
+    configWrites++;
+    if (value == fallback) {
+        return prefs.remove(key) || !prefs.isKey(key);
+    }
+    return prefs.putFloat(key, value) == sizeof(value);
+}
 
-    Serial2.begin(9600, SERIAL_8N1, A01_RX, A01_TX);
+static bool storeString(Preferences &prefs, const char *key, const String &value, const String &saved,
+                        const String &fallback)
+{
+    if (value == saved) {
+        return true;
+    }
+    configWrites++;
+    if (value == fallback) {
+        return prefs.remove(key) || !prefs.isKey(key);
+    }
+    // putString() returns the length written, which is 0 for an empty value
+    return prefs.putString(key, value) == value.length();
+}
 
-    for (int i = 0; i < numMeasurements; i++)
+bool saveConfig()
+{
+    Preferences prefs;
+    if (!prefs.begin(CONFIG_NAMESPACE, false))
     {
-        if (Serial2.write(0x01) == 1)
-        {
-            delay(100);
+        return false;
+    }
 
-            if (Serial2.available() >= 4)
-            {
-                byte response[4];
-                Serial2.readBytes(response, 4);
-
-                if (response[0] == 0xFF)
-                {
-                    int distance = (response[1] << 8) | response[2];
-                    if (distance > 0 && distance < 7500)
-                    {
-                        measurements[validMeasurements++] = distance / 10.0;
-                    }
-                }
-            }
-        }
-        delay(50);
+    const Config defaults;
+    const Config &saved = savedConfig;
+    bool ok = true;
+    ok &= storeInt(prefs, "stationId", config.stationId, saved.stationId, defaults.stationId);
+    ok &= storeString(prefs, "stationName", config.stationName, saved.stationName, defaults.stationName);
+    ok &= storeUInt(prefs, "interval", config.measurementInterval, saved.measurementInterval,
+                    defaults.measurementInterval);
+    ok &= storeInt(prefs, "adaptive", config.adaptiveSampling, saved.adaptiveSampling, defaults.adaptiveSampling);
+    ok &= storeUInt(prefs, "maxInterval", config.maxMeasurementInterval, saved.maxMeasurementInterval,
+                    defaults.maxMeasurementInterval);
+    ok &= storeFloat(prefs, "fastRate", config.fastRateThreshold, saved.fastRateThreshold,
+                     defaults.fastRateThreshold);
+    ok &= storeFloat(prefs, "calOffset", config.calibrationOffset, saved.calibrationOffset,
+                     defaults.calibrationOffset);
+    ok &= storeFloat(prefs, "bottomDist", config.sensorToBottomDistance, saved.sensorToBottomDistance,
+                     defaults.sensorToBottomDistance);
+    ok &= storeFloat(prefs, "zeroBlokDist", config.sensorToZeroBlokDistance, saved.sensorToZeroBlokDistance,
+                     defaults.sensorToZeroBlokDistance);
+    ok &= storeInt(prefs, "sensorType", config.sensorType, saved.sensorType, defaults.sensorType);
+    ok &= storeInt(prefs, "opMode", config.operationMode, saved.operationMode, defaults.operationMode);
+    ok &= storeString(prefs, "wifiSSID", config.wifiSSID, saved.wifiSSID, defaults.wifiSSID);
+    ok &= storeString(prefs, "wifiPass", config.wifiPassword, saved.wifiPassword, defaults.wifiPassword);
+    ok &= storeString(prefs, "apiEndpoint", config.apiEndpoint, saved.apiEndpoint, defaults.apiEndpoint);
+    ok &= storeString(prefs, "apiToken", config.apiToken, saved.apiToken, defaults.apiToken);
+    ok &= storeUInt(prefs, "syncInterval", config.dataSyncInterval, saved.dataSyncInterval,
+                    defaults.dataSyncInterval);
+    ok &= storeInt(prefs, "batchSize", config.uploadBatchSize, saved.uploadBatchSize, defaults.uploadBatchSize);
+    ok &= storeInt(prefs, "filterMode", config.filterMode, saved.filterMode, defaults.filterMode);
+    ok &= storeInt(prefs, "samples", config.samplesPerReading, saved.samplesPerReading,
+                   defaults.samplesPerReading);
+    ok &= storeInt(prefs, "flushEvery", config.flushEvery, saved.flushEvery, defaults.flushEvery);
+    for (int channel = 1; channel < MAX_CHANNELS; channel++) {
+        const ChannelConfig &fallback = defaults.channels[channel - 1];
+        const ChannelConfig &was = saved.channels[channel - 1];
+        const ChannelConfig &now = config.channels[channel - 1];
+        char key[16];
+        snprintf(key, sizeof(key), "ch%dOn", channel);
+        ok &= storeInt(prefs, key, now.enabled, was.enabled, fallback.enabled);
+        snprintf(key, sizeof(key), "ch%dPort", channel);
+        ok &= storeInt(prefs, key, now.port, was.port, fallback.port);
+        snprintf(key, sizeof(key), "ch%dId", channel);
+        ok &= storeInt(prefs, key, now.stationId, was.stationId, fallback.stationId);
+        snprintf(key, sizeof(key), "ch%dName", channel);
+        ok &= storeString(prefs, key, now.stationName, was.stationName, fallback.stationName);
+        snprintf(key, sizeof(key), "ch%dOffset", channel);
+        ok &= storeFloat(prefs, key, now.calibrationOffset, was.calibrationOffset, fallback.calibrationOffset);
+        snprintf(key, sizeof(key), "ch%dBottom", channel);
+        ok &= storeFloat(prefs, key, now.sensorToBottomDistance, was.sensorToBottomDistance,
+                         fallback.sensorToBottomDistance);
+        snprintf(key, sizeof(key), "ch%dZero", channel);
+        ok &= storeFloat(prefs, key, now.sensorToZeroBlokDistance, was.sensorToZeroBlokDistance,
+                         fallback.sensorToZeroBlokDistance);
+    }
+
+    // Written last, so a config only counts as stored once its fields are
+    if (ok && !configStored)
+    {
+        configWrites++;
+        ok = prefs.putUShort("version", CONFIG_VERSION) == sizeof(uint16_t);
+        configStored = ok;
     }
 
-    Serial2.end();
+    // After a failed write, compare the next save against what NVS
+    // actually holds
+    if (ok) {
+        savedConfig = config;
+    } else {
+        readSettings(prefs, savedConfig);
+    }
+    prefs.end();
+    return ok;
+}
 
-    if (validMeasurements == 0)
+// Called from loop() while online; sends at most one batch per pass. The
+// sender works on its own copy of the API settings, so an upload taking
+// seconds does not hold stateMutex.
+void serviceUploader()
+{
     {
-        addToSerialBuffer("Warning: No valid A01NYUB measurements");
-        return -1;
+        std::lock_guard<std::recursive_mutex> lock(stateMutex);
+        uploader.setBatchSize(config.uploadBatchSize);
+        uploader.setFlushInterval(config.dataSyncInterval);
+        batchSender.setEndpoint(config.apiEndpoint.c_str(), config.apiToken.c_str());
+        applyStations();
     }
 
-    float sum = 0;
-    for (int i = 0; i < validMeasurements; i++)
-    {
-        sum += measurements[i];
+    uint32_t failuresBefore = uploader.failures();
+    if (!uploader.service(millis())) {
+        return;
+    }
+
+    if (uploader.failures() == 0) {
+        logEvent(EVENT_INFO, EVT_UPLOAD, "Uploaded batch. Response: %d, pending: %lu",
+                 uploader.lastStatus(), (unsigned long)uploader.pending());
+    } else if (failuresBefore == 0 || uploader.failures() % 5 == 0) {
+        // Don't flood the serial view while the link is down
+        logEvent(EVENT_WARN, EVT_UPLOAD, "Upload failed. Response: %d, retry %lu, pending: %lu",
+                 uploader.lastStatus(), (unsigned long)uploader.failures(),
+                 (unsigned long)uploader.pending());
     }
-    return sum / validMeasurements;
 }
 
-float readHCSR04()
+void startAcquisitionTask()
 {
-    const int numMeasurements = 30;
-    float measurements[numMeasurements];
-    int validMeasurements = 0;
+    xTaskCreatePinnedToCore(acquisitionTask, "acquisition", ACQUISITION_STACK_SIZE,
+                            NULL, 1, &acquisitionTaskHandle, ACQUISITION_CORE);
+}
 
-    for (int i = 0; i < numMeasurements; i++)
+// Runs the slow, blocking sensor reads so loop() keeps serving HTTP.
+// Each notification from measureWaterLevel() measures every active channel
+// in one interleaved pass and produces a SensorReading per channel. The RTC
+// is shared over I2C with loop(), so timestamps are taken there.
+void acquisitionTask(void *parameter)
+{
+    SampleFilter filters[MAX_CHANNELS];
+    for (;;)
     {
-        digitalWrite(TRIGGER_PIN, LOW);
-        delayMicroseconds(2);
-        digitalWrite(TRIGGER_PIN, HIGH);
-        delayMicroseconds(10);
-        digitalWrite(TRIGGER_PIN, LOW);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (sensorChanged.exchange(false)) {
+            reconfigureSensor();
+        }
 
-        long duration = pulseIn(ECHO_PIN, HIGH, 30000);
-        if (duration > 0)
+        SensorReading readings[MAX_CHANNELS];
+        SamplerSlot slots[MAX_CHANNELS];
+        size_t count = 0;
         {
-            float distance = duration * 0.034 / 2;
-            measurements[validMeasurements++] = distance;
+            std::lock_guard<std::recursive_mutex> lock(stateMutex);
+            for (int channel = 0; channel < MAX_CHANNELS; channel++) {
+                if (!channelActive(channel)) {
+                    continue;
+                }
+                SensorPort port = channelPort(channel);
+                readings[count].channel = channel;
+                readings[count].sensorType = portSensorType(port);
+                filters[count].configure(filterConfigFor(readings[count].sensorType, config.filterMode,
+                                                         config.samplesPerReading));
+                slots[count].sensor = &sensorOn(port);
+                slots[count].filter = &filters[count];
+                count++;
+            }
         }
-        delay(50);
-    }
 
-    if (validMeasurements == 0)
-    {
-        addToSerialBuffer("Warning: No valid HCSR04 measurements");
-        return -1;
+        uint32_t passMs = sampler.read(slots, count);
+        for (size_t i = 0; i < count; i++) {
+            readings[i].filtered = slots[i].result;
+            readings[i].durationMs = slots[i].durationMs;
+            readings[i].passMs = passMs;
+            // loop() drains the queue every pass, so it only fills if loop() stalls
+            readingQueue.push(readings[i]);
+        }
     }
+}
 
-    float sum = 0;
-    for (int i = 0; i < validMeasurements; i++)
+// Pins and UART for the configured sensor type; runs on the acquisition
+// task, between passes
+void reconfigureSensor()
+{
+    SensorType sensorType;
     {
-        sum += measurements[i];
+        std::lock_guard<std::recursive_mutex> lock(stateMutex);
+        sensorType = config.sensorType;
+    }
+    if (sensorType == HCSR04_SENSOR) {
+        pinMode(TRIGGER_PIN, OUTPUT);
+        pinMode(ECHO_PIN, INPUT);
+        a01nyub.close();
+    } else {
+        pinMode(TRIGGER_PIN, INPUT);
+        pinMode(ECHO_PIN, INPUT);
     }
-    return sum / validMeasurements;
 }
 
-bool sendDataToAPI(float levelBlok, float levelParit, float rawDistance)
+// Ask the acquisition task for a new reading; the result is picked up by
+// processSensorReadings() once it is ready
+void measureWaterLevel()
 {
-    if (!hasInternetConnection || config.apiEndpoint.length() == 0) {
-        return false;
+    if (!systemInitialized || acquisitionTaskHandle == NULL) {
+        Serial.println("System not fully initialized, skipping measurement");
+        return;
     }
 
-    HTTPClient http;
-    http.begin(config.apiEndpoint);
-    http.addHeader("Content-Type", "application/json");
-    
-    if (config.apiToken.length() > 0) {
-        http.addHeader("Authorization", "Bearer " + config.apiToken);
-    }
+    xTaskNotifyGive(acquisitionTaskHandle);
+}
 
-    JsonDocument doc;
-    doc["station_name"] = config.stationName;
-    doc["idwl"] = config.stationId;
-    doc["level_blok"] = levelBlok;
-    doc["level_parit"] = levelParit;
-    doc["sensor_distance"] = rawDistance;
-    doc["datetime"] = getFormattedDateTime();
+void processSensorReadings()
+{
+    SensorReading reading;
+    while (readingQueue.pop(reading)) {
+        processReading(reading);
+    }
+}
 
-    String jsonString;
-    serializeJson(doc, jsonString);
+// Channel 0 drives the dashboard and the measurement interval; every
+// channel is logged and counted
+void processReading(const SensorReading &reading)
+{
+    const FilteredReading &filtered = reading.filtered;
+    float distance = filtered.distance;
+    uint8_t channel = reading.channel;
 
-    int httpResponseCode = http.POST(jsonString);
-    http.end();
+    Levels levels;
+    {
+        std::lock_guard<std::recursive_mutex> lock(stateMutex);
+        ChannelStats &stats = channelStats[channel];
+        stats.lastDurationMs = reading.durationMs;
+        stats.maxDurationMs = max(stats.maxDurationMs, reading.durationMs);
+        lastPassMs = reading.passMs;
+        if (distance < 0) {
+            stats.failures++;
+        } else {
+            levels = computeLevels(distance, channelCalibration(channel));
+            stats.readings++;
+            uint32_t base = epochBase.load(std::memory_order_relaxed);
+            stats.lastEpoch = base ? base + millis() / 1000 : 0;
+            stats.blok = levels.blok;
+            stats.parit = levels.parit;
+            stats.raw = levels.raw;
+            stats.quality = filtered.quality;
+        }
+    }
 
-    if (httpResponseCode > 0 && httpResponseCode < 400) {
-        addToSerialBuffer("Data sent to API successfully. Response: " + String(httpResponseCode));
-        return true;
+    if (distance >= 0 && channel > 0) {
+        logDataWithManagement(levels, filtered.quality, channel);
+        logEvent(EVENT_INFO, EVT_MEASUREMENT, "Channel %u raw: %.2fcm, Blok: %.2fcm, Parit: %.2fcm (q %u%%, %u/%u/%u, %lums)",
+                 (unsigned)channel, levels.raw, levels.blok, levels.parit,
+                 (unsigned)(filtered.quality * 100.0f + 0.5f), filtered.used, filtered.valid,
+                 filtered.attempts, (unsigned long)reading.durationMs);
+    } else if (distance >= 0) {
+        {
+            std::lock_guard<std::recursive_mutex> lock(stateMutex);
+            currentRawDistance = levels.raw;
+            currentWaterLevelBlok = levels.blok;
+            currentWaterLevelParit = levels.parit;
+            currentQuality = filtered.quality;
+            bootTimeline.mark("firstReading", millis());
+
+            uint32_t previous = scheduler.interval();
+            uint32_t next = scheduler.update(millis(), levels.blok, levels.parit);
+            if (next != previous) {
+                logEvent(EVENT_INFO, EVT_MEASUREMENT, "Interval %lus -> %lus (%.2f cm/min)",
+                         (unsigned long)(previous / 1000), (unsigned long)(next / 1000), scheduler.rate());
+            }
+        }
+        
+        // Every reading is logged; in online mode the uploader sends the log on
+        logDataWithManagement(levels, filtered.quality, 0);
+        
+        logEvent(EVENT_INFO, EVT_MEASUREMENT, "Raw: %.2fcm, Blok: %.2fcm, Parit: %.2fcm%s (q %u%%, %u/%u/%u, %lums)",
+                 currentRawDistance, currentWaterLevelBlok, currentWaterLevelParit,
+                 config.operationMode == ONLINE_MODE ? " [QUEUED]" : " [LOCAL]",
+                 (unsigned)(filtered.quality * 100.0f + 0.5f), filtered.used, filtered.valid,
+                 filtered.attempts, (unsigned long)reading.durationMs);
+        publishLevel();
     } else {
-        addToSerialBuffer("Failed to send data to API. Response: " + String(httpResponseCode));
-        return false;
+        logEvent(EVENT_WARN, EVT_SENSOR, "Warning: No valid %s measurements on channel %u",
+                 reading.sensorType == HCSR04_SENSOR ? "HCSR04" : "A01NYUB", (unsigned)channel);
+        logEvent(EVENT_ERROR, EVT_SENSOR, "Measurement failed - sensor error");
     }
 }
 
-void syncStoredData()
+// RTC time as Unix epoch seconds, or 0 when no valid time is available
+uint32_t getEpochTime()
 {
-    if (!hasInternetConnection || config.apiEndpoint.length() == 0) {
-        return;
+    if (!rtcAvailable || !systemInitialized) {
+        return 0;
     }
 
-    if (!SPIFFS.exists(DATA_FILE)) {
-        return;
+    std::lock_guard<std::recursive_mutex> lock(stateMutex);
+    uint32_t epoch = rtcClock.epoch();
+    if (epoch != 0) {
+        epochBase.store(epoch - millis() / 1000, std::memory_order_relaxed);
     }
+    return epoch;
+}
 
-    File file = SPIFFS.open(DATA_FILE, "r");
-    if (!file) {
-        return;
+static const char *levelName(uint8_t level)
+{
+    switch (level)
+    {
+    case EVENT_DEBUG:
+        return "DEBUG";
+    case EVENT_WARN:
+        return "WARN";
+    case EVENT_ERROR:
+        return "ERROR";
+    default:
+        return "INFO";
     }
+}
 
-    String csvContent = file.readString();
-    file.close();
+// Log a line. After boot this only copies it into the event ring, which
+// takes no lock and does no I/O, so any task may call it; during setup()
+// nothing drains the ring yet, so lines go straight to the UART.
+void logEvent(EventLevel level, uint16_t code, const char *format, ...)
+{
+    char text[EVENT_TEXT_LENGTH];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
 
-    if (csvContent.length() <= 100) { // Only headers
+    if (!systemInitialized) {
+        Serial.print("BOOT - ");
+        Serial.println(text);
         return;
     }
 
-    // Convert CSV to JSON array
-    JsonDocument doc;
-    JsonArray dataArray = doc["data"].to<JsonArray>();
-
-    String lines[1000]; // Support up to 1000 lines
-    int lineCount = 0;
-    int startPos = 0;
-    int endPos = csvContent.indexOf('\n');
+    uint32_t uptimeMs = millis();
+    uint32_t base = epochBase.load(std::memory_order_relaxed);
+    eventLog.push(level, code, base ? base + uptimeMs / 1000 : 0, uptimeMs, text);
+}
 
-    // Skip header line
-    if (endPos > 0) {
-        startPos = endPos + 1;
-        endPos = csvContent.indexOf('\n', startPos);
+// "<time> - <text>", with the level for anything but INFO. Returns the length.
+size_t formatEventLine(char *buffer, size_t size, const Event &event)
+{
+    TextBuffer<SERIAL_LINE_LENGTH> line;
+    if (event.epoch != 0) {
+        char timestamp[24];
+        formatDateTime(timestamp, sizeof(timestamp), event.epoch);
+        line.append(timestamp);
+    } else {
+        unsigned long seconds = event.uptimeMs / 1000;
+        line.appendf("UPTIME_%02lu:%02lu:%02lu", (seconds / 3600) % 24, (seconds / 60) % 60, seconds % 60);
+    }
+    line.append(" - ");
+    if (event.level != EVENT_INFO) {
+        line.append(levelName(event.level)).append(": ");
     }
+    line.append(event.text);
+    return snprintf(buffer, size, "%s", line.c_str());
+}
 
-    // Parse CSV lines
-    while (endPos > 0 && lineCount < 1000) {
-        String line = csvContent.substring(startPos, endPos);
-        line.trim();
-        
-        if (line.length() > 0) {
-            // Parse CSV line: Station ID,Station Name,DateTime,Water Level (Blok) (cm),Water Level (Parit) (cm),Raw Distance (cm)
-            int comma1 = line.indexOf(',');
-            int comma2 = line.indexOf(',', comma1 + 1);
-            int comma3 = line.indexOf(',', comma2 + 1);
-            int comma4 = line.indexOf(',', comma3 + 1);
-            int comma5 = line.indexOf(',', comma4 + 1);
-
-            if (comma1 > 0 && comma2 > 0 && comma3 > 0 && comma4 > 0 && comma5 > 0) {
-                JsonObject entry = dataArray.add<JsonObject>();
-                entry["station_name"] = line.substring(comma1 + 1, comma2);
-                entry["idwl"] = line.substring(0, comma1).toInt();
-                entry["datetime"] = line.substring(comma2 + 1, comma3);
-                entry["level_blok"] = line.substring(comma3 + 1, comma4).toFloat();
-                entry["level_parit"] = line.substring(comma4 + 1, comma5).toFloat();
-                entry["sensor_distance"] = line.substring(comma5 + 1).toFloat();
+// Write pending log lines to the UART without blocking: only as much as the
+// driver's TX buffer takes now, continuing on the next pass
+void drainSerialLog()
+{
+    static char pending[SERIAL_LINE_LENGTH + 2];
+    static size_t pendingLength = 0;
+    static size_t pendingPos = 0;
+    static uint32_t reportedLost = 0;
+    static uint32_t lost = 0;
+
+    for (;;) {
+        if (pendingPos == pendingLength) {
+            Event event;
+            if (!eventLog.read(serialCursor, event, &lost)) {
+                return;
+            }
+            if (lost != reportedLost) {
+                Serial.printf("... %lu log lines lost\r\n", (unsigned long)(lost - reportedLost));
+                reportedLost = lost;
             }
+            pendingLength = formatEventLine(pending, sizeof(pending) - 2, event);
+            if (pendingLength > sizeof(pending) - 3) {
+                pendingLength = sizeof(pending) - 3;
+            }
+            pending[pendingLength++] = '\r';
+            pending[pendingLength++] = '\n';
+            pendingPos = 0;
         }
 
-        startPos = endPos + 1;
-        endPos = csvContent.indexOf('\n', startPos);
-        lineCount++;
+        int room = Serial.availableForWrite();
+        if (room <= 0) {
+            return;
+        }
+        size_t n = pendingLength - pendingPos;
+        if (n > (size_t)room) {
+            n = room;
+        }
+        pendingPos += Serial.write((const uint8_t *)pending + pendingPos, n);
     }
+}
 
-    if (dataArray.size() == 0) {
+// Forward new log lines to open /events streams
+void publishLogEvents()
+{
+    Event event;
+    if (events.count() == 0) {
+        // Nobody listening: skip ahead rather than format for no one
+        while (eventLog.read(streamCursor, event)) {
+        }
         return;
     }
 
-    // Send data to API
-    HTTPClient http;
-    http.begin(config.apiEndpoint + "/bulk"); // Assume bulk endpoint
-    http.addHeader("Content-Type", "application/json");
-    
-    if (config.apiToken.length() > 0) {
-        http.addHeader("Authorization", "Bearer " + config.apiToken);
+    while (eventLog.read(streamCursor, event)) {
+        char line[SERIAL_LINE_LENGTH];
+        formatEventLine(line, sizeof(line), event);
+        char escaped[SERIAL_LINE_LENGTH * 2];
+        escapeJson(escaped, sizeof(escaped), line);
+        char frame[sizeof(escaped) + 80];
+        snprintf(frame, sizeof(frame), "{\"seq\":%lu,\"level\":\"%s\",\"code\":%u,\"line\":\"%s\"}",
+                 (unsigned long)event.seq, levelName(event.level), (unsigned)event.code, escaped);
+        publishEvent("serial", frame);
     }
+}
 
-    String jsonString;
-    serializeJson(doc, jsonString);
+void initWatchdog()
+{
+    esp_task_wdt_init(WDT_TIMEOUT, true);
+    esp_task_wdt_add(NULL);
+    Serial.println("Watchdog initialized");
+}
 
-    int httpResponseCode = http.POST(jsonString);
-    http.end();
+void resetWatchdog()
+{
+    esp_task_wdt_reset();
+}
+// First sleep after the configuration window of a cold boot
+void enterLowPower()
+{
+    SleepSettings settings;
+    {
+        std::lock_guard<std::recursive_mutex> lock(stateMutex);
+        settings.sensorType = config.sensorType;
+        settings.filterMode = config.filterMode;
+        settings.samplesPerReading = config.samplesPerReading;
+        settings.flushEvery = constrain(config.flushEvery, 1, SLEEP_BUFFER_SIZE);
+        settings.calibration.sensorToZeroBlokDistance = config.sensorToZeroBlokDistance;
+        settings.calibration.sensorToBottomDistance = config.sensorToBottomDistance;
+        settings.calibration.calibrationOffset = config.calibrationOffset;
+        settings.schedule = scheduleFromConfig();
+        sleepState.reset(settings);
+        sleepState.schedule = scheduler.state();
+    }
+
+    logStage.commit(millis());
+    logEvent(EVENT_INFO, EVT_SYSTEM, "Entering low-power mode, flushing every %u wakeups",
+             (unsigned)settings.flushEvery);
+    drainSerialLog();
+    sleepUntilNextMeasurement(false);
+}
 
-    if (httpResponseCode > 0 && httpResponseCode < 400) {
-        addToSerialBuffer("Bulk data sync successful. Cleared local storage.");
-        // Clear the data file after successful sync
-        SPIFFS.remove(DATA_FILE);
-        File newFile = SPIFFS.open(DATA_FILE, "w");
-        if (newFile) {
-            newFile.println("Station ID,Station Name,DateTime,Water Level (Blok) (cm),Water Level (Parit) (cm),Raw Distance (cm)");
-            newFile.close();
-        }
-    } else {
-        addToSerialBuffer("Bulk data sync failed. Response: " + String(httpResponseCode));
-    }
+// Wake path of low-power mode: one reading into RTC memory, a flush every
+// flushEvery wakeups, then back to sleep. There is no web server or
+// acquisition task, and SPIFFS and Wi-Fi are only started to flush.
+void runSleepCycle()
+{
+    sleepState.stats.lastBootMs = millis();
+    const SleepSettings &settings = sleepState.settings;
+    SensorType sensorType = (SensorType)settings.sensorType;
+
+    Serial.begin(115200);
+    scheduler.configure(settings.schedule);
+    scheduler.restore(sleepState.schedule);
+
+    // The DS3231 keeps time on its own battery; only the bus needs starting
+    rtcAvailable = Wire.begin(RTC_SDA, RTC_SCL) && rtc.begin();
+
+    SampleFilter filter(filterConfigFor(sensorType, (FilterMode)settings.filterMode,
+                                        settings.samplesPerReading));
+    DistanceSensor &sensor = (sensorType == HCSR04_SENSOR) ? (DistanceSensor &)hcsr04 : a01nyub;
+    unsigned long started = millis();
+    FilteredReading reading = sensor.read(filter);
+    cycleMeasureMs = millis() - started;
+
+    if (reading.distance >= 0) {
+        Levels levels = computeLevels(reading.distance, settings.calibration);
+        LogRecord record;
+        record.epoch = rtcAvailable ? rtcClock.epoch() : 0;
+        record.levelBlok = toFixedLevel(levels.blok);
+        record.levelParit = toFixedLevel(levels.parit);
+        record.rawDistance = toFixedLevel(levels.raw);
+        record.flags = toQualityFlags(reading.quality);
+        cycleReading = sleepState.push(record);
+        scheduler.update(sleepState.clockMs + millis(), levels.blok, levels.parit);
+    }
+
+    sleepState.sinceFlush++;
+    if (sleepState.flushDue()) {
+        flushSleepBuffer();
+    }
+    sleepUntilNextMeasurement(true);
 }
 
-void measureWaterLevel()
+// Move the buffered readings into the data log and, if an API is set up,
+// upload whatever the log has not delivered yet
+void flushSleepBuffer()
 {
-    if (!systemInitialized) {
-        Serial.println("System not fully initialized, skipping measurement");
+    unsigned long started = millis();
+    if (!SPIFFS.begin(false)) {
+        // Keep buffering; readings are only lost once RTC memory is full
+        logEvent(EVENT_ERROR, EVT_STORAGE, "SPIFFS mount failed - %lu readings kept in RTC memory",
+                 (unsigned long)sleepState.count);
         return;
     }
-    
-    float distance;
+    loadConfig();
 
-    if (config.sensorType == HCSR04_SENSOR) {
-        distance = readHCSR04();
-    } else {
-        distance = readA01NYUB();
+    uint32_t written = 0;
+    if (setupDataLog()) {
+        // One batch, so one header write for the whole buffer
+        written = dataLog.append(sleepState.records, sleepState.count) ? sleepState.count : 0;
+        archiveOldRecords();
     }
-
-    if (distance >= 0) {
-        currentRawDistance = distance;
-        
-        currentWaterLevelBlok = ((distance - config.sensorToZeroBlokDistance) * -1) + config.calibrationOffset;
-        currentWaterLevelParit = (config.sensorToBottomDistance - distance) + config.calibrationOffset;
-        
-        // In online mode, try to send data directly to API
-        bool sentToAPI = false;
-        if (config.operationMode == ONLINE_MODE && hasInternetConnection) {
-            sentToAPI = sendDataToAPI(currentWaterLevelBlok, currentWaterLevelParit, currentRawDistance);
-        }
-        
-        // If not sent to API or in offline mode, save to local storage
-        if (!sentToAPI) {
-            logDataWithManagement(currentWaterLevelBlok, currentWaterLevelParit);
-        }
-        
-        String statusMsg = "Raw: " + String(currentRawDistance, 2) + "cm, " +
-                          "Blok: " + String(currentWaterLevelBlok, 2) + "cm, " +
-                          "Parit: " + String(currentWaterLevelParit, 2) + "cm" +
-                          (sentToAPI ? " [API]" : " [LOCAL]");
-        
-        addToSerialBuffer(statusMsg);
+    sleepState.sinceFlush = 0;
+    if (written == sleepState.count) {
+        logEvent(EVENT_INFO, EVT_STORAGE, "Flushed %lu buffered readings", (unsigned long)written);
+        sleepState.count = 0;
     } else {
-        addToSerialBuffer("Measurement failed - sensor error");
+        // Kept in RTC memory for the next flush, like a failed mount
+        logEvent(EVENT_ERROR, EVT_STORAGE, "Data log write failed - %lu readings kept in RTC memory",
+                 (unsigned long)sleepState.count);
+    }
+
+    if (dataLog.isOpen() && config.apiEndpoint.length() > 0 && connectToWiFi()) {
+        uploader.setBackoff(UPLOAD_BACKOFF_MS, UPLOAD_BACKOFF_MAX_MS);
+        uploader.setWindow(UPLOAD_WINDOW);
+        uploader.setBatchSize(config.uploadBatchSize);
+        uploader.setFlushInterval(0); // Whatever is pending goes now
+        batchSender.setTimeout(UPLOAD_TIMEOUT_MS);
+        batchSender.setEndpoint(config.apiEndpoint.c_str(), config.apiToken.c_str());
+        applyStations();
+        uploader.begin();
+        while (uploader.pending() > 0 && uploader.failures() == 0 &&
+               millis() - started < LOW_POWER_UPLOAD_MS) {
+            uploader.service(millis());
+        }
+        logEvent(EVENT_INFO, EVT_UPLOAD, "Low-power upload. Response: %d, pending: %lu",
+                 uploader.lastStatus(), (unsigned long)uploader.pending());
+        WiFi.disconnect(true);
+        WiFi.mode(WIFI_OFF);
     }
+
+    cycleFlushMs = millis() - started;
+    sleepState.stats.flushes++;
+    saveSleepStats();
 }
 
-String getFormattedDateTime()
+// Cycle timings as of the last flush, for /sleepStats after the next cold
+// boot. The charge estimate uses rough supply currents; it is for comparing
+// settings, not a measurement.
+void saveSleepStats()
 {
-    if (!rtcAvailable || !systemInitialized) {
-        // Use system uptime as fallback
-        unsigned long uptimeMs = millis();
-        unsigned long seconds = uptimeMs / 1000;
-        unsigned long minutes = seconds / 60;
-        unsigned long hours = minutes / 60;
-        
-        char timeStr[32];
-        sprintf(timeStr, "UPTIME_%02lu:%02lu:%02lu", 
-                hours % 24, minutes % 60, seconds % 60);
-        return String(timeStr);
-    }
-    
-    try {
-        DateTime now = rtc.now();
-        if (now.year() < 2020 || now.year() > 2030) {
-            // Invalid date, use uptime
-            return "INVALID_DATE";
-        }
-        
-        char datetime[20];
-        sprintf(datetime, "%04d-%02d-%02d %02d:%02d:%02d",
-                now.year(), now.month(), now.day(),
-                now.hour(), now.minute(), now.second());
-        return String(datetime);
-    } catch (...) {
-        rtcAvailable = false;
-        return "RTC_ERROR";
+    const SleepStats &stats = sleepState.stats;
+    uint32_t cycles = stats.cycles ? stats.cycles : 1;
+    uint32_t readings = stats.readings ? stats.readings : 1;
+    float chargeMc = (stats.totalAwakeMs * AWAKE_CURRENT_MA + stats.totalSleepMs * SLEEP_CURRENT_MA) / 1000.0f;
+
+    char body[384];
+    snprintf(body, sizeof(body),
+             "{\"cycles\":%lu,\"readings\":%lu,\"flushes\":%lu,\"lastBootMs\":%lu,"
+             "\"lastMeasureMs\":%lu,\"lastAwakeMs\":%lu,\"maxAwakeMs\":%lu,\"avgAwakeMs\":%lu,"
+             "\"avgMeasureMs\":%lu,\"avgFlushMs\":%lu,\"avgSleepMs\":%lu,"
+             "\"chargePerReadingMc\":%.2f,\"epoch\":%lu}",
+             (unsigned long)stats.cycles, (unsigned long)stats.readings, (unsigned long)stats.flushes,
+             (unsigned long)stats.lastBootMs, (unsigned long)stats.lastMeasureMs,
+             (unsigned long)stats.lastAwakeMs, (unsigned long)stats.maxAwakeMs,
+             (unsigned long)(stats.totalAwakeMs / cycles), (unsigned long)(stats.totalMeasureMs / cycles),
+             (unsigned long)(stats.totalFlushMs / (stats.flushes ? stats.flushes : 1)),
+             (unsigned long)(stats.totalSleepMs / cycles), chargeMc / readings,
+             (unsigned long)(rtcAvailable ? rtcClock.epoch() : 0));
+
+    File file = SPIFFS.open(SLEEP_STATS_FILE, "w");
+    if (file) {
+        file.print(body);
+        file.close();
     }
 }
 
-void addToSerialBuffer(const String &message)
+// Sleep until the scheduler's next measurement is due. Awake time counts
+// from the start of the application, so it leaves out the ROM bootloader.
+void sleepUntilNextMeasurement(bool completedCycle)
 {
-    String timestampedMessage;
-    
-    if (systemInitialized) {
-        timestampedMessage = getFormattedDateTime() + " - " + message;
-    } else {
-        timestampedMessage = "BOOT - " + message;
-    }
-    
-    Serial.println(timestampedMessage);
-    Serial.flush(); // Ensure message is sent immediately
-    
-    // Only add to buffer if system is properly initialized
-    if (systemInitialized) {
-        serialBuff[serialBufferIndex] = timestampedMessage;
-        serialBufferIndex = (serialBufferIndex + 1) % SERIAL_BUFFER_SIZE;
-    }
-}
+    SleepStats &stats = sleepState.stats;
+    uint32_t intervalMs = scheduler.interval();
+    sleepState.schedule = scheduler.state();
+
+    uint32_t awakeMs = millis();
+    uint32_t sleepMs = intervalMs > awakeMs + MIN_SLEEP_MS ? intervalMs - awakeMs : MIN_SLEEP_MS;
+    if (completedCycle) {
+        stats.cycles++;
+        stats.readings += cycleReading ? 1 : 0;
+        stats.lastMeasureMs = cycleMeasureMs;
+        stats.totalMeasureMs += cycleMeasureMs;
+        stats.totalFlushMs += cycleFlushMs;
+        stats.lastAwakeMs = awakeMs;
+        stats.maxAwakeMs = max(stats.maxAwakeMs, awakeMs);
+        stats.totalAwakeMs += awakeMs;
+        stats.totalSleepMs += sleepMs;
+    }
+    sleepState.clockMs += awakeMs + sleepMs;
 
+    Serial.flush();
+    esp_sleep_enable_timer_wakeup((uint64_t)sleepMs * 1000ULL);
+    esp_deep_sleep_start();
+}
 
-void initWatchdog()
+void handleBootTiming(AsyncWebServerRequest *request)
 {
-    esp_task_wdt_init(WDT_TIMEOUT, true);
-    esp_task_wdt_add(NULL);
-    Serial.println("Watchdog initialized");
+    char body[BOOT_TIMING_SIZE];
+    if (bootTimeline.format(body, sizeof(body)) == 0) {
+        request->send(500, "text/plain", "Boot timing does not fit");
+        return;
+    }
+    request->send(200, "application/json", body);
 }
 
-void resetWatchdog()
+void handleSleepStats(AsyncWebServerRequest *request)
 {
-    esp_task_wdt_reset();
-}
\ No newline at end of file
+    if (SPIFFS.exists(SLEEP_STATS_FILE)) {
+        request->send(SPIFFS, SLEEP_STATS_FILE, "application/json");
+    } else {
+        request->send(200, "application/json", "{}");
+    }
+}
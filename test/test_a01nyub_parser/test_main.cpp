@@ -0,0 +1,140 @@
+// Frame sync of the A01NYUB parser over byte streams the sensor's UART can
+// deliver: clean, joined mid-frame, with corrupted and dropped bytes, and
+// with 0xFF inside frames where a resync could mistake it for a header.
+//
+//     pio test -e native -f test_a01nyub_parser
+
+#include <stdint.h>
+#include <vector>
+
+#include <unity.h>
+
+#include <A01nyubParser.h>
+
+static std::vector<uint8_t> bytes;
+
+static void appendFrame(uint16_t mm, uint8_t checksumError = 0)
+{
+    uint8_t header = A01nyubParser::HEADER;
+    uint8_t high = mm >> 8;
+    uint8_t low = mm & 0xFF;
+    bytes.push_back(header);
+    bytes.push_back(high);
+    bytes.push_back(low);
+    bytes.push_back((uint8_t)(header + high + low + checksumError));
+}
+
+// Feeds the bytes and compares the distances that come out
+static void expectFrames(const std::vector<uint16_t> &expected, uint32_t checksumErrors)
+{
+    A01nyubParser parser;
+    std::vector<uint16_t> found;
+    for (uint8_t byte : bytes)
+    {
+        uint16_t mm;
+        if (parser.feed(byte, mm))
+        {
+            found.push_back(mm);
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(expected.size(), found.size());
+    TEST_ASSERT_EQUAL_UINT16_ARRAY(expected.data(), found.data(), expected.size());
+    TEST_ASSERT_EQUAL_UINT32(expected.size(), parser.frames());
+    TEST_ASSERT_EQUAL_UINT32(checksumErrors, parser.checksumErrors());
+}
+
+void setUp()
+{
+    bytes.clear();
+}
+
+void tearDown()
+{
+}
+
+static void test_clean()
+{
+    appendFrame(1234);
+    appendFrame(1240);
+    appendFrame(7499);
+    expectFrames({1234, 1240, 7499}, 0);
+}
+
+// Opened halfway through a frame
+static void test_joined_mid_frame()
+{
+    appendFrame(1234);
+    bytes.erase(bytes.begin(), bytes.begin() + 2);
+    appendFrame(1500);
+    expectFrames({1500}, 0);
+}
+
+// Joined at a low byte of 0xFF, which looks like a header
+static void test_joined_at_header_byte()
+{
+    appendFrame(0x04FF);
+    bytes.erase(bytes.begin(), bytes.begin() + 2);
+    appendFrame(0x04FF);
+    appendFrame(0x0501);
+    expectFrames({0x04FF, 0x0501}, 1);
+}
+
+// A bit flipped in the distance, then a good frame
+static void test_corrupted_distance()
+{
+    appendFrame(2000);
+    bytes[2] ^= 0x10;
+    appendFrame(2001);
+    expectFrames({2001}, 1);
+}
+
+static void test_bad_checksum()
+{
+    appendFrame(2000, 1);
+    appendFrame(2002);
+    expectFrames({2002}, 1);
+}
+
+// A byte lost in the middle of a frame pulls the next frame's header into it
+static void test_dropped_byte()
+{
+    appendFrame(3000);
+    bytes.erase(bytes.begin() + 1);
+    appendFrame(3001);
+    appendFrame(3002);
+    expectFrames({3001, 3002}, 1);
+}
+
+// Line noise without headers between frames
+static void test_noise_between_frames()
+{
+    std::vector<uint16_t> expected;
+    uint32_t state = 12345;
+    for (int i = 0; i < 200; i++)
+    {
+        for (int n = i % 7; n > 0; n--)
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            bytes.push_back((uint8_t)(state % 0xFF));
+        }
+        uint16_t mm = 280 + (i * 37) % 7000;
+        appendFrame(mm);
+        expected.push_back(mm);
+    }
+    expectFrames(expected, 0);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_clean);
+    RUN_TEST(test_joined_mid_frame);
+    RUN_TEST(test_joined_at_header_byte);
+    RUN_TEST(test_corrupted_distance);
+    RUN_TEST(test_bad_checksum);
+    RUN_TEST(test_dropped_byte);
+    RUN_TEST(test_noise_between_frames);
+    return UNITY_END();
+}
@@ -0,0 +1,528 @@
+// DataLog against the file-backed flash stand-in:
+//
+//     pio test -e native -f test_datalog
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <unity.h>
+
+#include <Crc32.h>
+#include <DataLog.h>
+#include <LogArchive.h>
+#include <LogBackend.h>
+#include <LogHistory.h>
+#include <LogStage.h>
+#include <RecordStream.h>
+
+#define LOG_PATH "test_datalog.bin"
+#define ARCHIVE_PATH "test_archive.bin"
+#define START_EPOCH 1704067200 // 2024-01-01 00:00:00
+#define CAPACITY 8
+
+static LogRecord makeRecord(uint32_t n)
+{
+    LogRecord record;
+    record.epoch = START_EPOCH + n * 60;
+    record.levelBlok = (int16_t)(1000 + n);
+    record.levelParit = (int16_t)(-500 - n);
+    record.rawDistance = (int16_t)(2000 + n);
+    record.flags = toQualityFlags(0.9f);
+    return record;
+}
+
+// The record appended as sequence number seq by appendRecords()
+static void assertRecord(uint32_t seq, const LogRecord &record)
+{
+    LogRecord expected = makeRecord(seq);
+    TEST_ASSERT_EQUAL_UINT32(expected.epoch, record.epoch);
+    TEST_ASSERT_EQUAL_INT16(expected.levelBlok, record.levelBlok);
+    TEST_ASSERT_EQUAL_INT16(expected.levelParit, record.levelParit);
+    TEST_ASSERT_EQUAL_INT16(expected.rawDistance, record.rawDistance);
+    TEST_ASSERT_EQUAL_UINT16(expected.flags, record.flags);
+}
+
+// Appends sequence numbers from up to to, one record at a time
+static void appendRecords(DataLog &log, uint32_t from, uint32_t to)
+{
+    for (uint32_t seq = from; seq <= to; seq++)
+    {
+        TEST_ASSERT_TRUE(log.append(makeRecord(seq)));
+    }
+}
+
+static void assertContents(DataLog &log, uint32_t firstSeq, uint32_t lastSeq)
+{
+    TEST_ASSERT_EQUAL_UINT32(firstSeq, log.firstSeq());
+    TEST_ASSERT_EQUAL_UINT32(lastSeq, log.lastSeq());
+    TEST_ASSERT_EQUAL_UINT32(lastSeq - firstSeq + 1, log.count());
+    for (uint32_t i = 0; i < log.count(); i++)
+    {
+        LogRecord record;
+        TEST_ASSERT_TRUE(log.read(i, record));
+        assertRecord(firstSeq + i, record);
+    }
+}
+
+// Fails header writes on demand, as a full or failing flash would
+class FailingHeaderBackend : public LogBackend
+{
+public:
+    FailingHeaderBackend(LogBackend &inner) : _inner(inner), _headerArea(0), _failing(false) {}
+
+    // Writes below headerArea are header writes
+    void failHeaders(size_t headerArea, bool failing)
+    {
+        _headerArea = headerArea;
+        _failing = failing;
+    }
+
+    bool read(uint32_t offset, void *buffer, size_t length) override
+    {
+        return _inner.read(offset, buffer, length);
+    }
+    bool write(uint32_t offset, const void *buffer, size_t length) override
+    {
+        return !(_failing && offset < _headerArea) && _inner.write(offset, buffer, length);
+    }
+    bool sync() override { return _inner.sync(); }
+    size_t size() override { return _inner.size(); }
+
+private:
+    LogBackend &_inner;
+    size_t _headerArea;
+    bool _failing;
+};
+
+static std::vector<uint8_t> readBytes(LogBackend &backend, uint32_t offset, size_t length)
+{
+    std::vector<uint8_t> bytes(length);
+    TEST_ASSERT_TRUE(backend.read(offset, bytes.data(), length));
+    return bytes;
+}
+
+void setUp()
+{
+    remove(LOG_PATH);
+    remove(ARCHIVE_PATH);
+}
+
+void tearDown()
+{
+    remove(LOG_PATH);
+    remove(ARCHIVE_PATH);
+}
+
+static void test_append_and_read()
+{
+    FileLogBackend backend(LOG_PATH);
+    DataLog log(backend);
+    TEST_ASSERT_TRUE(backend.open());
+    TEST_ASSERT_TRUE(log.begin(CAPACITY));
+    TEST_ASSERT_EQUAL_UINT32(0, log.count());
+    TEST_ASSERT_EQUAL_UINT32(1, log.firstSeq());
+
+    appendRecords(log, 1, 5);
+    assertContents(log, 1, 5);
+    TEST_ASSERT_EQUAL_UINT32(makeRecord(1).epoch, log.oldestEpoch());
+    TEST_ASSERT_EQUAL_UINT32(makeRecord(5).epoch, log.newestEpoch());
+
+    LogRecord records[CAPACITY];
+    uint32_t firstRead;
+    TEST_ASSERT_EQUAL_UINT32(3, log.readSeq(3, records, CAPACITY, &firstRead));
+    TEST_ASSERT_EQUAL_UINT32(3, firstRead);
+    assertRecord(3, records[0]);
+    assertRecord(5, records[2]);
+}
+
+static void test_wrap_around()
+{
+    FileLogBackend backend(LOG_PATH);
+    DataLog log(backend);
+    TEST_ASSERT_TRUE(backend.open());
+    TEST_ASSERT_TRUE(log.begin(CAPACITY));
+
+    appendRecords(log, 1, 2 * CAPACITY + 3);
+    assertContents(log, CAPACITY + 4, 2 * CAPACITY + 3);
+    TEST_ASSERT_EQUAL_UINT32(makeRecord(CAPACITY + 4).epoch, log.oldestEpoch());
+
+    // A batch that runs off the end of the ring and continues at slot 0
+    LogRecord batch[5];
+    for (uint32_t i = 0; i < 5; i++)
+    {
+        batch[i] = makeRecord(2 * CAPACITY + 4 + i);
+    }
+    TEST_ASSERT_TRUE(log.append(batch, 5));
+    assertContents(log, CAPACITY + 9, 2 * CAPACITY + 8);
+
+    // Overwritten records are skipped, and the time index sees the ring in
+    // order across the wrap
+    LogRecord record;
+    uint32_t firstRead;
+    TEST_ASSERT_EQUAL_UINT32(1, log.readSeq(1, &record, 1, &firstRead));
+    TEST_ASSERT_EQUAL_UINT32(CAPACITY + 9, firstRead);
+    TEST_ASSERT_EQUAL_UINT32(CAPACITY + 12, log.seqLowerBound(makeRecord(CAPACITY + 12).epoch));
+    TEST_ASSERT_EQUAL_UINT32(CAPACITY + 12, log.seqLowerBound(makeRecord(CAPACITY + 12).epoch - 30));
+    TEST_ASSERT_EQUAL_UINT32(CAPACITY + 9, log.seqLowerBound(0));
+    TEST_ASSERT_EQUAL_UINT32(log.lastSeq() + 1, log.seqLowerBound(makeRecord(2 * CAPACITY + 9).epoch));
+
+    TEST_ASSERT_TRUE(log.discardOldest(3));
+    assertContents(log, CAPACITY + 12, 2 * CAPACITY + 8);
+}
+
+static void test_reopen_keeps_records()
+{
+    {
+        FileLogBackend backend(LOG_PATH);
+        DataLog log(backend);
+        TEST_ASSERT_TRUE(backend.open());
+        TEST_ASSERT_TRUE(log.begin(CAPACITY));
+        appendRecords(log, 1, CAPACITY + 2);
+    }
+
+    FileLogBackend backend(LOG_PATH);
+    DataLog log(backend);
+    TEST_ASSERT_TRUE(backend.open());
+    // An existing log keeps its own capacity
+    TEST_ASSERT_TRUE(log.begin(2 * CAPACITY));
+    TEST_ASSERT_EQUAL_UINT32(CAPACITY, log.capacity());
+    assertContents(log, 3, CAPACITY + 2);
+    TEST_ASSERT_EQUAL_UINT32(makeRecord(3).epoch, log.oldestEpoch());
+    TEST_ASSERT_EQUAL_UINT32(makeRecord(CAPACITY + 2).epoch, log.newestEpoch());
+
+    // Sequence numbers carry on where they stopped
+    appendRecords(log, CAPACITY + 3, CAPACITY + 4);
+    assertContents(log, 5, CAPACITY + 4);
+}
+
+// A header write torn by a power loss leaves the other copy in charge: the
+// log reopens as it was before the append that was cut off
+static void test_torn_header_falls_back()
+{
+    size_t headerArea;
+    std::vector<uint8_t> before;
+    std::vector<uint8_t> after;
+    {
+        FileLogBackend backend(LOG_PATH);
+        DataLog log(backend);
+        TEST_ASSERT_TRUE(backend.open());
+        TEST_ASSERT_TRUE(log.begin(CAPACITY));
+        headerArea = backend.size(); // Only the header slots are laid down by format()
+
+        appendRecords(log, 1, 5);
+        before = readBytes(backend, 0, headerArea);
+        appendRecords(log, 6, 6);
+        after = readBytes(backend, 0, headerArea);
+    }
+
+    // Tear the copy the last append wrote
+    size_t changed = 0;
+    while (changed < headerArea && before[changed] == after[changed])
+    {
+        changed++;
+    }
+    TEST_ASSERT_TRUE(changed < headerArea);
+    uint8_t garbage[4] = {0xDE, 0xAD, 0xBE, 0xEF};
+    {
+        FileLogBackend backend(LOG_PATH);
+        TEST_ASSERT_TRUE(backend.open());
+        TEST_ASSERT_TRUE(backend.write(changed, garbage, sizeof(garbage)));
+    }
+
+    FileLogBackend backend(LOG_PATH);
+    DataLog log(backend);
+    TEST_ASSERT_TRUE(backend.open());
+    TEST_ASSERT_TRUE(log.begin(CAPACITY));
+    assertContents(log, 1, 5);
+
+    // The next append overwrites the torn copy and the log carries on
+    appendRecords(log, 6, 7);
+    assertContents(log, 1, 7);
+}
+
+// With neither header copy valid the log cannot be trusted and starts over
+static void test_corrupt_headers_reformat()
+{
+    size_t headerArea;
+    {
+        FileLogBackend backend(LOG_PATH);
+        DataLog log(backend);
+        TEST_ASSERT_TRUE(backend.open());
+        TEST_ASSERT_TRUE(log.begin(CAPACITY));
+        headerArea = backend.size();
+        appendRecords(log, 1, 4);
+
+        std::vector<uint8_t> header = readBytes(backend, 0, headerArea);
+        for (size_t i = 0; i < headerArea; i += headerArea / 2)
+        {
+            header[i + headerArea / 4] ^= 0x5A; // Inside each copy
+        }
+        TEST_ASSERT_TRUE(backend.write(0, header.data(), header.size()));
+    }
+
+    FileLogBackend backend(LOG_PATH);
+    DataLog log(backend);
+    TEST_ASSERT_TRUE(backend.open());
+    TEST_ASSERT_TRUE(log.begin(CAPACITY));
+    TEST_ASSERT_EQUAL_UINT32(0, log.count());
+    appendRecords(log, 1, 2);
+    assertContents(log, 1, 2);
+}
+
+// A clock that is unknown or set back must not break the time index
+static void test_epochs_never_go_back()
+{
+    FileLogBackend backend(LOG_PATH);
+    DataLog log(backend);
+    TEST_ASSERT_TRUE(backend.open());
+    TEST_ASSERT_TRUE(log.begin(CAPACITY));
+
+    LogRecord unknown = makeRecord(0);
+    unknown.epoch = 0;
+    TEST_ASSERT_TRUE(log.append(unknown)); // Nothing to keep in order yet
+    appendRecords(log, 2, 3);
+    TEST_ASSERT_TRUE(log.append(unknown));
+    LogRecord setBack = makeRecord(1);
+    LogRecord batch[3] = {makeRecord(5), setBack, makeRecord(6)};
+    TEST_ASSERT_TRUE(log.append(batch, 3));
+
+    uint32_t expected[] = {0, makeRecord(2).epoch, makeRecord(3).epoch, makeRecord(3).epoch,
+                           makeRecord(5).epoch, makeRecord(5).epoch, makeRecord(6).epoch};
+    bool raised[] = {false, false, false, true, false, true, false};
+    TEST_ASSERT_EQUAL_UINT32(7, log.count());
+    for (uint32_t i = 0; i < log.count(); i++)
+    {
+        LogRecord record;
+        TEST_ASSERT_TRUE(log.read(i, record));
+        TEST_ASSERT_EQUAL_UINT32(expected[i], record.epoch);
+        TEST_ASSERT_EQUAL(raised[i], (record.flags & LOG_FLAG_TIME_RAISED) != 0);
+        TEST_ASSERT_EQUAL(qualityPercent(makeRecord(0).flags), qualityPercent(record.flags));
+    }
+    TEST_ASSERT_EQUAL_UINT32(makeRecord(6).epoch, log.newestEpoch());
+    TEST_ASSERT_EQUAL_UINT32(1, log.lowerBound(1));
+    TEST_ASSERT_EQUAL_UINT32(4, log.lowerBound(makeRecord(4).epoch));
+    TEST_ASSERT_EQUAL_UINT32(6, log.lowerBound(makeRecord(6).epoch));
+}
+
+// A reset between the stage's CRC store and its count store leaves a CRC
+// that covers one record more than the count says; that record is kept
+static void test_stage_recovers_record_past_count()
+{
+    FileLogBackend backend(LOG_PATH);
+    DataLog log(backend);
+    TEST_ASSERT_TRUE(backend.open());
+    TEST_ASSERT_TRUE(log.begin(CAPACITY));
+
+    static StageArea<4> area;
+    {
+        LogStage stage(log, area);
+        stage.configure(4, 0xFFFFFFFF);
+        stage.recover(0);
+        TEST_ASSERT_TRUE(stage.add(makeRecord(1), 0));
+        TEST_ASSERT_TRUE(stage.add(makeRecord(2), 0));
+    }
+    area.records[2] = makeRecord(3);
+    area.header.crc = crc32(&area.records[2], sizeof(LogRecord), area.header.crc);
+
+    LogStage stage(log, area);
+    TEST_ASSERT_EQUAL_UINT32(3, stage.recover(0));
+    assertContents(log, 1, 3);
+
+    // A CRC that matches neither count is not trusted
+    TEST_ASSERT_TRUE(stage.add(makeRecord(4), 0));
+    area.header.crc ^= 1;
+    LogStage broken(log, area);
+    TEST_ASSERT_EQUAL_UINT32(0, broken.recover(0));
+    assertContents(log, 1, 3);
+}
+
+// A commit whose header write fails leaves the log as it was, so the
+// stage's retry adds the batch once
+static void test_failed_header_write_retries_once()
+{
+    FileLogBackend file(LOG_PATH);
+    FailingHeaderBackend backend(file);
+    DataLog log(backend);
+    TEST_ASSERT_TRUE(file.open());
+    TEST_ASSERT_TRUE(log.begin(CAPACITY));
+    size_t headerArea = backend.size();
+    appendRecords(log, 1, 2);
+
+    static StageArea<4> area;
+    LogStage stage(log, area);
+    stage.configure(4, 0xFFFFFFFF);
+    stage.recover(0);
+    for (uint32_t seq = 3; seq <= 5; seq++)
+    {
+        TEST_ASSERT_TRUE(stage.add(makeRecord(seq), 0));
+    }
+
+    backend.failHeaders(headerArea, true);
+    TEST_ASSERT_FALSE(stage.commit(0));
+    assertContents(log, 1, 2);
+    TEST_ASSERT_EQUAL_UINT32(makeRecord(2).epoch, log.newestEpoch());
+    TEST_ASSERT_FALSE(log.discardOldest(1));
+    assertContents(log, 1, 2);
+
+    backend.failHeaders(headerArea, false);
+    TEST_ASSERT_TRUE(stage.commit(0));
+    assertContents(log, 1, 5);
+    TEST_ASSERT_EQUAL_UINT32(makeRecord(5).epoch, log.newestEpoch());
+
+    FileLogBackend reopenedFile(LOG_PATH);
+    DataLog reopened(reopenedFile);
+    TEST_ASSERT_TRUE(reopenedFile.open());
+    TEST_ASSERT_TRUE(reopened.begin(CAPACITY));
+    assertContents(reopened, 1, 5);
+}
+
+// A block whose archive header write fails is not archived, so the caller
+// keeps its records in the log
+static void test_failed_archive_header_keeps_records()
+{
+    FileLogBackend backend(LOG_PATH);
+    DataLog log(backend);
+    TEST_ASSERT_TRUE(backend.open());
+    TEST_ASSERT_TRUE(log.begin(1024));
+    appendRecords(log, 1, 1000);
+
+    FileLogBackend archiveFile(ARCHIVE_PATH);
+    FailingHeaderBackend archiveBackend(archiveFile);
+    LogArchive archive(archiveBackend);
+    TEST_ASSERT_TRUE(archiveFile.open());
+    TEST_ASSERT_TRUE(archive.begin(16));
+    size_t headerArea = archiveBackend.size();
+
+    archiveBackend.failHeaders(headerArea, true);
+    TEST_ASSERT_EQUAL_UINT32(0, archive.archive(log, log.lastSeq() + 1, 1, StationTable()));
+    TEST_ASSERT_EQUAL_UINT32(0, archive.blocks());
+    TEST_ASSERT_EQUAL_UINT32(1, archive.liveStart(log));
+
+    archiveBackend.failHeaders(headerArea, false);
+    uint32_t archived = archive.archive(log, log.lastSeq() + 1, 1, StationTable());
+    TEST_ASSERT_GREATER_THAN(0, archived);
+    TEST_ASSERT_EQUAL_UINT32(1, archive.blocks());
+    TEST_ASSERT_EQUAL_UINT32(1 + archived, archive.liveStart(log));
+}
+
+// Channels interleaved in one log are each coded against their own last
+// record, and every channel keeps the station it was archived under
+static void test_archive_interleaved_channels()
+{
+    FileLogBackend backend(LOG_PATH);
+    DataLog log(backend);
+    TEST_ASSERT_TRUE(backend.open());
+    TEST_ASSERT_TRUE(log.begin(1024));
+    for (uint32_t pass = 0; pass < 300; pass++)
+    {
+        for (uint8_t channel = 0; channel < 3; channel++)
+        {
+            LogRecord record = makeRecord(pass);
+            int16_t recalibrated = (pass >= 50 && channel == 1) ? 25 : 0;
+            record.levelBlok = (int16_t)(1000 * channel + pass % 7 + recalibrated);
+            record.levelParit = (int16_t)(-2000 * channel + pass % 7);
+            record.rawDistance = (int16_t)(3000 * channel - pass % 7);
+            record.flags = toQualityFlags(0.9f) | toChannelFlags(channel);
+            TEST_ASSERT_TRUE(log.append(record));
+        }
+    }
+
+    FileLogBackend archiveBackend(ARCHIVE_PATH);
+    LogArchive archive(archiveBackend);
+    TEST_ASSERT_TRUE(archiveBackend.open());
+    TEST_ASSERT_TRUE(archive.begin(16));
+    StationTable stations;
+    stations.set(0, 100, "Upstream");
+    stations.set(1, 101, "Downstream");
+    stations.set(2, 102, "A name that is much too long for an archive block");
+    uint32_t archived = archive.archive(log, log.lastSeq() + 1, 1, stations);
+    // A byte or two per reading, as with a single channel; coded against
+    // the other channels' readings each would take five or more
+    TEST_ASSERT_GREATER_THAN(400, archived);
+
+    ArchiveCursor cursor(archive, archive.firstBlock());
+    LogRecord record;
+    uint32_t seq;
+    uint32_t decoded = 0;
+    while (cursor.next(record, seq))
+    {
+        LogRecord expected;
+        TEST_ASSERT_TRUE(log.read(seq - log.firstSeq(), expected));
+        TEST_ASSERT_EQUAL_MEMORY(&expected, &record, sizeof(record));
+        decoded++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(archived, decoded);
+
+    const ArchiveBlockHeader &header = cursor.block();
+    TEST_ASSERT_EQUAL_INT32(101, header.stations[1].id);
+    TEST_ASSERT_EQUAL_STRING("Downstream", header.stations[1].name);
+    TEST_ASSERT_EQUAL_INT32(102, header.stations[2].id);
+    TEST_ASSERT_EQUAL_UINT32(ARCHIVE_STATION_NAME_LENGTH - 1, strlen(header.stations[2].name));
+}
+
+static std::string drain(RecordStream &stream)
+{
+    std::string body;
+    uint8_t buffer[128];
+    size_t n;
+    while ((n = stream.fill(buffer, sizeof(buffer))) > 0)
+    {
+        body.append((const char *)buffer, n);
+    }
+    return body;
+}
+
+// Records archived before a station was reassigned are exported and
+// uploaded under the station they were measured at; the ring's records
+// under the current one
+static void test_streams_use_archived_stations()
+{
+    FileLogBackend backend(LOG_PATH);
+    DataLog log(backend);
+    TEST_ASSERT_TRUE(backend.open());
+    TEST_ASSERT_TRUE(log.begin(1024));
+    appendRecords(log, 1, 400);
+
+    FileLogBackend archiveBackend(ARCHIVE_PATH);
+    LogArchive archive(archiveBackend);
+    TEST_ASSERT_TRUE(archiveBackend.open());
+    TEST_ASSERT_TRUE(archive.begin(16));
+    StationTable before;
+    before.set(0, 100, "Old Station");
+    TEST_ASSERT_GREATER_THAN(0, archive.archive(log, log.lastSeq() + 1, 1, before));
+
+    StationTable now;
+    now.set(0, 200, "New Station");
+    LogHistory history(log, &archive);
+    uint32_t first = history.firstSeq();
+    uint32_t end = log.lastSeq() + 1;
+
+    CsvRecordStream csv(history, first, end, now);
+    std::string rows = drain(csv);
+    TEST_ASSERT_TRUE(rows.find("100,Old Station,") != std::string::npos);
+    TEST_ASSERT_TRUE(rows.find("200,New Station,") != std::string::npos);
+
+    BulkRecordStream bulk(history, first, end, now);
+    std::string json = drain(bulk);
+    TEST_ASSERT_TRUE(json.find("{\"station_name\":\"Old Station\",\"idwl\":100,") == 9);
+    TEST_ASSERT_TRUE(json.find("\"station_name\":\"New Station\",\"idwl\":200,") != std::string::npos);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_append_and_read);
+    RUN_TEST(test_wrap_around);
+    RUN_TEST(test_reopen_keeps_records);
+    RUN_TEST(test_torn_header_falls_back);
+    RUN_TEST(test_corrupt_headers_reformat);
+    RUN_TEST(test_epochs_never_go_back);
+    RUN_TEST(test_stage_recovers_record_past_count);
+    RUN_TEST(test_failed_header_write_retries_once);
+    RUN_TEST(test_archive_interleaved_channels);
+    RUN_TEST(test_failed_archive_header_keeps_records);
+    RUN_TEST(test_streams_use_archived_stations);
+    return UNITY_END();
+}
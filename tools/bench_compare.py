@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""Compare two runs of the host benchmarks (src/bench, [env:bench]).
+
+Matches results by case and log size and reports the change in median
+latency and throughput. Exits with status 1 if any case got slower than
+the threshold, so it can gate a change.
+
+    .pio/build/bench/program > baseline.jsonl
+    # ... change the code, rebuild ...
+    .pio/build/bench/program > results.jsonl
+    python3 tools/bench_compare.py baseline.jsonl results.jsonl --threshold 10
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith("{"):
+                continue
+            result = json.loads(line)
+            if result.get("bench") == "meta":
+                continue
+            results[(result["bench"], result["records"])] = result
+    return results
+
+
+def change(old, new):
+    if not old:
+        return 0.0
+    return (new - old) * 100.0 / old
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="percent increase in median latency counted as a regression")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    regressions = 0
+    print("%-20s %9s %12s %12s %8s %8s" % ("bench", "records", "p50 before", "p50 after", "p50", "items/s"))
+    for key in sorted(current, key=lambda k: (k[1], k[0])):
+        if key not in baseline:
+            print("%-20s %9d %12s %12d %8s %8s" % (key[0], key[1], "-", current[key]["p50_ns"], "new", ""))
+            continue
+        old = baseline[key]
+        new = current[key]
+        latency = change(old["p50_ns"], new["p50_ns"])
+        throughput = change(old["items_per_s"], new["items_per_s"])
+        flag = ""
+        if latency > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        print("%-20s %9d %12d %12d %+7.1f%% %+7.1f%%%s"
+              % (key[0], key[1], old["p50_ns"], new["p50_ns"], latency, throughput, flag))
+
+    for key in sorted(set(baseline) - set(current)):
+        print("%-20s %9d missing from %s" % (key[0], key[1], args.current))
+
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,48 @@
+"""PlatformIO pre-script: stage the SPIFFS image with compressed web assets.
+
+Copies data/ to .pio/webdata/, which is the filesystem image source
+(data_dir in platformio.ini). The files listed in COMPRESS are replaced
+by a gzip copy plus a .etag file, and the server sends them with
+Content-Encoding: gzip. The ETag is a hash of the uncompressed file, so it
+changes only when the page does. Runs on every build, so uploadfs always
+picks up the current page.
+"""
+
+import gzip
+import hashlib
+import os
+import shutil
+
+Import("env")  # noqa: F821 - provided by PlatformIO
+
+COMPRESS = {"index.html"}
+
+
+def stage(source_dir, target_dir):
+    if os.path.realpath(source_dir) == os.path.realpath(target_dir):
+        raise SystemExit("build_web: data_dir must not be data/, it would overwrite the sources")
+    if os.path.isdir(target_dir):
+        shutil.rmtree(target_dir)
+    os.makedirs(target_dir)
+
+    for name in sorted(os.listdir(source_dir)):
+        source = os.path.join(source_dir, name)
+        if not os.path.isfile(source):
+            continue
+        if name not in COMPRESS:
+            shutil.copy2(source, os.path.join(target_dir, name))
+            continue
+
+        with open(source, "rb") as f:
+            body = f.read()
+        # mtime=0 keeps the archive byte-identical between builds
+        with open(os.path.join(target_dir, name + ".gz"), "wb") as f:
+            f.write(gzip.compress(body, compresslevel=9, mtime=0))
+        with open(os.path.join(target_dir, name + ".etag"), "w") as f:
+            f.write('"%s"' % hashlib.sha1(body).hexdigest()[:16])
+        print("build_web: %s %d -> %d bytes gzip"
+              % (name, len(body), os.path.getsize(os.path.join(target_dir, name + ".gz"))))
+
+
+project_dir = env.subst("$PROJECT_DIR")  # noqa: F821
+stage(os.path.join(project_dir, "data"), env.subst("$PROJECT_DATA_DIR"))  # noqa: F821
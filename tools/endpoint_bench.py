@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""Compare what the dashboard graph costs over the air.
+
+Fetches the full-history CSV path (/getData) and the downsampled /series
+path from a running station and reports bytes transferred and request
+time for each.
+
+    python3 tools/endpoint_bench.py --host 192.168.4.1 --runs 10
+"""
+
+import argparse
+import statistics
+import time
+import urllib.request
+
+
+def fetch(url, timeout):
+    start = time.perf_counter()
+    with urllib.request.urlopen(url, timeout=timeout) as response:
+        body = response.read()
+    return len(body), (time.perf_counter() - start) * 1000.0
+
+
+def bench(name, url, runs, timeout):
+    sizes = []
+    times = []
+    for _ in range(runs):
+        size, elapsed = fetch(url, timeout)
+        sizes.append(size)
+        times.append(elapsed)
+    return {
+        "name": name,
+        "url": url,
+        "bytes": int(statistics.median(sizes)),
+        "median_ms": statistics.median(times),
+        "max_ms": max(times),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="192.168.4.1", help="station address (default: soft-AP IP)")
+    parser.add_argument("--runs", type=int, default=5)
+    parser.add_argument("--points", type=int, default=300, help="buckets requested from /series")
+    parser.add_argument("--span", type=int, default=86400, help="seconds of history for /series")
+    parser.add_argument("--timeout", type=float, default=60.0)
+    args = parser.parse_args()
+
+    base = "http://%s" % args.host
+    cases = [
+        ("full-csv", base + "/getData"),
+        ("series", "%s/series?span=%d&points=%d&field=blok" % (base, args.span, args.points)),
+    ]
+
+    results = [bench(name, url, args.runs, args.timeout) for name, url in cases]
+
+    print("%-10s %12s %12s %12s" % ("endpoint", "bytes", "median ms", "max ms"))
+    for r in results:
+        print("%-10s %12d %12.1f %12.1f" % (r["name"], r["bytes"], r["median_ms"], r["max_ms"]))
+
+    full, series = results
+    if series["bytes"] and series["median_ms"]:
+        print("\nseries vs full-csv: %.1fx fewer bytes, %.1fx faster"
+              % (full["bytes"] / series["bytes"], full["median_ms"] / series["median_ms"]))
+
+
+if __name__ == "__main__":
+    main()
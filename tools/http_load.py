@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+"""Measure web server latency under concurrent clients.
+
+Runs a number of client threads (default 10, the hotspot's MAX_CLIENTS)
+that each request the dashboard's endpoints in a loop, and reports p50/p99
+latency per endpoint. A slow full-history download can be mixed in to check
+that it does not hold up the other requests.
+
+    python3 tools/http_load.py --host 192.168.4.1 --clients 10 --requests 20
+"""
+
+import argparse
+import threading
+import time
+import urllib.error
+import urllib.request
+
+PATHS = ["/", "/currentLevel", "/config", "/serial", "/uptime", "/storageInfo",
+         "/series?span=86400&points=300&field=blok", "/data/since?seq=0"]
+
+
+def percentile(values, fraction):
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    index = min(len(ordered) - 1, int(round(fraction * (len(ordered) - 1))))
+    return ordered[index]
+
+
+def fetch(url, timeout):
+    start = time.perf_counter()
+    with urllib.request.urlopen(url, timeout=timeout) as response:
+        response.read()
+    return (time.perf_counter() - start) * 1000.0
+
+
+def client(number, base, requests, timeout, results, errors, lock):
+    for i in range(requests):
+        # Clients start at different endpoints so the mix stays even
+        path = PATHS[(number + i) % len(PATHS)]
+        try:
+            elapsed = fetch(base + path, timeout)
+        except (urllib.error.URLError, OSError) as e:
+            with lock:
+                errors.append((path, str(e)))
+            continue
+        with lock:
+            results.setdefault(path, []).append(elapsed)
+
+
+def slow_download(base, timeout, done):
+    # Reads /getData a little at a time, like a phone on a weak signal
+    try:
+        with urllib.request.urlopen(base + "/getData", timeout=timeout) as response:
+            while not done.is_set() and response.read(512):
+                time.sleep(0.05)
+    except (urllib.error.URLError, OSError):
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="192.168.4.1", help="station address (default: soft-AP IP)")
+    parser.add_argument("--clients", type=int, default=10)
+    parser.add_argument("--requests", type=int, default=20, help="requests per client")
+    parser.add_argument("--slow", action="store_true", help="keep a slow /getData download open meanwhile")
+    parser.add_argument("--timeout", type=float, default=30.0)
+    args = parser.parse_args()
+
+    base = "http://%s" % args.host
+    results = {}
+    errors = []
+    lock = threading.Lock()
+
+    done = threading.Event()
+    slow = None
+    if args.slow:
+        slow = threading.Thread(target=slow_download, args=(base, args.timeout, done))
+        slow.start()
+
+    threads = [threading.Thread(target=client, args=(n, base, args.requests, args.timeout, results, errors, lock))
+               for n in range(args.clients)]
+    start = time.perf_counter()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    wall = time.perf_counter() - start
+    done.set()
+    if slow:
+        slow.join()
+
+    print("%-45s %6s %10s %10s %10s" % ("endpoint", "n", "p50 ms", "p99 ms", "max ms"))
+    everything = []
+    for path in PATHS:
+        times = results.get(path, [])
+        everything.extend(times)
+        print("%-45s %6d %10.1f %10.1f %10.1f"
+              % (path, len(times), percentile(times, 0.5), percentile(times, 0.99), max(times or [0])))
+    print("%-45s %6d %10.1f %10.1f %10.1f"
+          % ("all", len(everything), percentile(everything, 0.5), percentile(everything, 0.99),
+             max(everything or [0])))
+    print("\n%d clients, %.1f requests/s, %d errors" % (args.clients, len(everything) / wall, len(errors)))
+    for path, message in errors[:10]:
+        print("  %s: %s" % (path, message))
+
+
+if __name__ == "__main__":
+    main()